@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Times removing the duplicates of N words drawn from 200 distinct ones by
+# comparing each word with eq against the distinct words found so far.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-5000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+# words sharing a long prefix, so that comparing characters is not free
+seq 1 "$N" | awk '{ printf "identifier%03d ", $1 % 200 }' > "$SOURCE_DIR/words"
+cat > "$SOURCE_DIR/dedup.wsp" <<WSP
+(= unique (vector))
+(dolist (word (split "$(cat "$SOURCE_DIR/words")" " "))
+  (progn
+    (= found false)
+    (dotimes (i (vector-length unique))
+      (if (eq (vector-ref unique i) word) (= found true)))
+    (if (not found) (vector-push unique word))))
+(print (vector-length unique))
+WSP
+
+TIMEFORMAT="%R s"
+
+echo "dedup"
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" "$SOURCE_DIR/dedup.wsp" > /dev/null
+done
@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Times a loop making CALLS calls to a small function defined after a few
+# other global bindings.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+CALLS=${CALLS:-10000000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+SOURCE="$SOURCE_DIR/script.wsp"
+
+cat > "$SOURCE" <<WSP
+(= a 1)
+(= b 2)
+(= c 3)
+(= d 4)
+(defun inc (x) (+ x 1))
+(= i 0)
+(while (< i $CALLS) (= i (inc i)))
+(print i)
+WSP
+
+TIMEFORMAT="%R s"
+
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" "$SOURCE" > /dev/null
+done
@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Times N lookups in a table of N string keys, scanning a list of keys with eq
+# against map-get on a hash map.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-2000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+KEYS=$(seq -f "key%g" 0 $((N - 1)) | tr '\n' ' ')
+
+cat > "$SOURCE_DIR/list.wsp" <<WSP
+(= keys (split "$KEYS" " "))
+(= found 0)
+(dolist (key (split "$KEYS" " "))
+  (dolist (k keys) (if (eq k key) (= found (+ found 1)) nil)))
+(print found)
+WSP
+cat > "$SOURCE_DIR/map.wsp" <<WSP
+(= table (make-map))
+(dolist (key (split "$KEYS" " ")) (map-set table key true))
+(= found 0)
+(dolist (key (split "$KEYS" " "))
+  (if (map-has table key) (= found (+ found 1)) nil))
+(print found)
+WSP
+
+TIMEFORMAT="%R s"
+
+for name in list map; do
+  echo "$name"
+  for ((i = 0; i < RUNS; i++)); do
+    time "$MAIN" "$SOURCE_DIR/$name.wsp" > /dev/null
+  done
+done
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# Times the iterative fib of tmp/fib.wsp, a loop of integer arithmetic and
+# comparisons, called CALLS times.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+CALLS=${CALLS:-300}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+SOURCE="$SOURCE_DIR/script.wsp"
+
+cat > "$SOURCE" <<WSP
+(defun fib (n)
+  (progn
+    (= a 1)
+    (= b 1)
+    (= i 3)
+    (while (< i (+ n 1))
+      (progn
+        (= c (+ a b))
+        (= a b)
+        (= b c)
+        (= i (+ i 1))))
+    (progn b)))
+(= j 0)
+(while (< j $CALLS) (progn (fib 10000) (= j (+ j 1))))
+(print (fib 40))
+WSP
+
+TIMEFORMAT="%R s"
+
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" "$SOURCE" > /dev/null
+done
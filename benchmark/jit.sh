@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Compares the interpreter with the JIT on recursive integer functions.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+cat > "$SOURCE_DIR/fib.wsp" <<WSP
+(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(print (fib ${FIB:-30}))
+WSP
+
+cat > "$SOURCE_DIR/fact.wsp" <<WSP
+(defun fact (n) (if (< n 1) 1 (* n (fact (- n 1)))))
+(= i 0)
+(= s 0)
+(while (< i ${FACT_CALLS:-300000})
+  (progn
+    (if (eq (fact 12) 479001600) (= s (+ s 1)) nil)
+    (= i (+ i 1))))
+(print s)
+WSP
+
+cat > "$SOURCE_DIR/tak.wsp" <<WSP
+(defun tak (x y z)
+  (if (not (< y x))
+      z
+      (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))))
+(print (tak 24 16 8))
+WSP
+
+TIMEFORMAT="%R s"
+
+for NAME in fib fact tak; do
+  for FLAGS in "" "--jit"; do
+    echo "$NAME ${FLAGS:-(interpreter)}:"
+    for ((i = 0; i < RUNS; i++)); do
+      time "$MAIN" $FLAGS "$SOURCE_DIR/$NAME.wsp" > /dev/null
+    done
+  done
+done
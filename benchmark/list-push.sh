@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Times growing a list of N elements with push while reading its length, then
+# emptying it with pop.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-20000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+cat > "$SOURCE_DIR/push.wsp" <<WSP
+(= l nil)
+(dotimes (i $N) (progn (push l i) (= n (length l))))
+(dotimes (i (- n 1)) (pop l))
+(print l)
+WSP
+
+TIMEFORMAT="%R s"
+
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" "$SOURCE_DIR/push.wsp" > /dev/null
+done
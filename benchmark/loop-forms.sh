@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Times dotimes and dolist against the equivalent while loops over N
+# integers and a list of N elements. The while loop indexing the list with
+# list-ref is quadratic, so it runs over LIST_REF_N elements only.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-1000000}
+LIST_REF_N=${LIST_REF_N:-20000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+# builds the list l of n elements before the loop
+prologue() {
+  echo "(= n $1) (= l nil) (= k 0)"
+  echo "(while (< k n) (progn (= l (cons k l)) (= k (+ k 1))))"
+  echo "(= s 0)"
+}
+
+prologue "$N" > "$SOURCE_DIR/prologue.wsp"
+{ prologue "$N"; echo "(dotimes (i n) (= s (+ s 1)))"; } > "$SOURCE_DIR/dotimes.wsp"
+{ prologue "$N"; echo "(= i 0) (while (< i n) (progn (= s (+ s 1)) (= i (+ i 1))))"; } > "$SOURCE_DIR/while-count.wsp"
+{ prologue "$N"; echo "(dolist (x l) (= s (+ s x)))"; } > "$SOURCE_DIR/dolist.wsp"
+{ prologue "$N"; echo "(= rest l) (while (not (eq rest nil)) (progn (= s (+ s (car rest))) (= rest (cdr rest))))"; } > "$SOURCE_DIR/while-cdr.wsp"
+{ prologue "$LIST_REF_N"; echo "(= i 0) (while (< i n) (progn (= s (+ s (list-ref l i))) (= i (+ i 1))))"; } > "$SOURCE_DIR/while-list-ref.wsp"
+{ prologue "$LIST_REF_N"; echo "(dolist (x l) (= s (+ s x)))"; } > "$SOURCE_DIR/dolist-small.wsp"
+
+TIMEFORMAT="%R s"
+
+for name in prologue dotimes while-count dolist while-cdr dolist-small while-list-ref; do
+  echo "$name"
+  for ((i = 0; i < RUNS; i++)); do
+    time "$MAIN" "$SOURCE_DIR/$name.wsp" > /dev/null
+  done
+done
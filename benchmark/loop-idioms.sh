@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Times a counted loop of N iterations whose condition compares locals and
+# whose body increments locals, the idioms run as superinstructions.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-3000000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+SOURCE="$SOURCE_DIR/script.wsp"
+
+cat > "$SOURCE" <<WSP
+(= n $N)
+(= i 0)
+(= s 0)
+(while (< i n)
+  (progn
+    (= s (+ s 2))
+    (= i (+ i 1))))
+(print s)
+WSP
+
+TIMEFORMAT="%R s"
+
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" "$SOURCE" > /dev/null
+done
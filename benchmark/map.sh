@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Times mapping a function over a list of N elements with the native map
+# against the interpreted loop of length, list-ref and push it replaces. The
+# loop is quadratic, so it runs over WHILE_N elements only.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-100000}
+WHILE_N=${WHILE_N:-20000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+# defines inc and builds the list l of n elements
+prologue() {
+  echo "(defun inc (x) (+ x 1))"
+  echo "(= l nil)"
+  echo "(dotimes (i $1) (= l (cons i l)))"
+}
+
+prologue "$N" > "$SOURCE_DIR/prologue.wsp"
+{ prologue "$N"; echo "(print (length (map inc l)))"; } > "$SOURCE_DIR/map.wsp"
+{ prologue "$WHILE_N"; echo "(print (length (map inc l)))"; } > "$SOURCE_DIR/map-small.wsp"
+{
+  prologue "$WHILE_N"
+  echo "(= results nil) (= n (length l)) (= i 0)"
+  echo "(while (< i n) (progn (push results (inc (list-ref l i))) (= i (+ i 1))))"
+  echo "(print (length results))"
+} > "$SOURCE_DIR/while.wsp"
+
+TIMEFORMAT="%R s"
+
+for name in prologue map map-small while; do
+  echo "$name"
+  for ((i = 0; i < RUNS; i++)); do
+    time "$MAIN" "$SOURCE_DIR/$name.wsp" > /dev/null
+  done
+done
@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Compares a loop full of constant subexpressions at each optimization level.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+ITERATIONS=${ITERATIONS:-1000000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+SOURCE="$SOURCE_DIR/script.wsp"
+
+cat > "$SOURCE" <<WSP
+(= i 0)
+(= s 0)
+(while (< i $ITERATIONS)
+  (progn
+    (= s (+ s (* (+ 2 3) (- 10 8))))
+    "loop body"
+    (progn
+      (if (&& true (< 1 2)) (= i (+ i 1)) (print "unreachable"))
+      (|| false (> 2 1)))))
+(print s)
+WSP
+
+TIMEFORMAT="%R s"
+
+for LEVEL in -O0 -O1 -O2; do
+  echo "$LEVEL:"
+  for ((i = 0; i < RUNS; i++)); do
+    time "$MAIN" $LEVEL "$SOURCE" > /dev/null
+  done
+done
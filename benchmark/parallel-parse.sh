@@ -0,0 +1,29 @@
+#!/bin/bash
+
+# Times parsing of a generated data-heavy script (large quoted lists inside
+# defuns that are never called) with an increasing number of parser threads.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+FORMS=${FORMS:-200000}
+THREADS=${THREADS:-"1 2 4 8 16"}
+
+SOURCE=$(mktemp --suffix=.wsp)
+trap 'rm -f "$SOURCE"' EXIT
+
+for ((i = 0; i < FORMS; i++)); do
+  echo "(defun table (n) '(\"row $i\" $i 1 2 3 4 5 6 7 8 9 10 (\"nested\" 1 2 3) true false))"
+done > "$SOURCE"
+
+echo "$(wc -c < "$SOURCE") bytes, $FORMS forms, $(nproc) cores"
+
+TIMEFORMAT="%R s"
+
+echo -n "sequential: "
+time "$MAIN" "$SOURCE" > /dev/null
+
+for N in $THREADS; do
+  echo -n "--parallel=$N: "
+  time "$MAIN" --parallel=$N "$SOURCE" > /dev/null
+done
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Times keeping a snapshot of a state of N integers after each of N updates,
+# copying a vector against updating a persistent vector with pvec-assoc.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-2000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+cat > "$SOURCE_DIR/vector.wsp" <<WSP
+(= state (vector))
+(dotimes (i $N) (vector-push state i))
+(= snapshots (vector))
+(dotimes (i $N)
+  (progn
+    (= copy (vector))
+    (dotimes (j $N) (vector-push copy (vector-ref state j)))
+    (vector-set copy i 0)
+    (vector-push snapshots copy)
+    (= state copy)))
+(print (vector-length snapshots))
+WSP
+cat > "$SOURCE_DIR/pvec.wsp" <<WSP
+(= state (pvec))
+(dotimes (i $N) (= state (pvec-conj state i)))
+(= snapshots (vector))
+(dotimes (i $N)
+  (progn
+    (= state (pvec-assoc state i 0))
+    (vector-push snapshots state)))
+(print (vector-length snapshots))
+WSP
+
+TIMEFORMAT="%R s"
+
+for name in vector pvec; do
+  echo "$name"
+  for ((i = 0; i < RUNS; i++)); do
+    time "$MAIN" "$SOURCE_DIR/$name.wsp" > /dev/null
+  done
+done
@@ -0,0 +1,36 @@
+#!/bin/bash
+
+# Times pmap computing fib of each of N elements with 1 to 16 threads, and
+# map for reference.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-64}
+FIB=${FIB:-20}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+for builtin in map pmap; do
+  cat > "$SOURCE_DIR/$builtin.wsp" <<WSP
+(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(= l nil)
+(dotimes (i $N) (= l (cons $FIB l)))
+(print (length ($builtin fib l)))
+WSP
+done
+
+TIMEFORMAT="%R s"
+
+echo "map"
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" "$SOURCE_DIR/map.wsp" > /dev/null
+done
+for threads in 1 2 4 8 16; do
+  echo "pmap, $threads threads"
+  for ((i = 0; i < RUNS; i++)); do
+    time "$MAIN" --pmap-threads=$threads "$SOURCE_DIR/pmap.wsp" > /dev/null
+  done
+done
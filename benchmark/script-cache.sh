@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Compares the start-up time of parsing a generated script from text with
+# loading it from the script cache.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+FORMS=${FORMS:-200000}
+RUNS=${RUNS:-5}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+SOURCE="$SOURCE_DIR/script.wsp"
+
+for ((i = 0; i < FORMS; i++)); do
+  echo "(defun table (n) '(\"row $i\" $i 1 2 3 4 5 6 7 8 9 10 (\"nested\" 1 2 3) true false))"
+done > "$SOURCE"
+
+echo "$(wc -c < "$SOURCE") bytes, $FORMS forms"
+
+TIMEFORMAT="%R s"
+
+echo "text:"
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" "$SOURCE" > /dev/null
+done
+
+"$MAIN" --cache "$SOURCE" > /dev/null
+echo "cache ($(wc -c < "${SOURCE}c") bytes):"
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" --cache "$SOURCE" > /dev/null
+done
@@ -0,0 +1,28 @@
+#!/bin/bash
+
+# Times splitting a string of N words into tokens and taking substrings of
+# each token.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-200000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+yes "token" | head -n "$N" | tr '\n' ' ' > "$SOURCE_DIR/words"
+cat > "$SOURCE_DIR/split.wsp" <<WSP
+(= words (split "$(cat "$SOURCE_DIR/words")" " "))
+(= n 0)
+(dolist (w words) (= n (+ n (length (substring w 1 4)))))
+(print n)
+WSP
+
+TIMEFORMAT="%R s"
+
+echo "split"
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" "$SOURCE_DIR/split.wsp" > /dev/null
+done
@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Times building a string of N pieces with + against sb-append.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-20000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+cat > "$SOURCE_DIR/concat.wsp" <<WSP
+(= s "")
+(dotimes (i $N) (= s (+ s "piece")))
+(print (length s))
+WSP
+cat > "$SOURCE_DIR/builder.wsp" <<WSP
+(= sb (make-string-builder))
+(dotimes (i $N) (sb-append sb "piece"))
+(print (length (sb-build sb)))
+WSP
+
+TIMEFORMAT="%R s"
+
+for name in concat builder; do
+  echo "$name"
+  for ((i = 0; i < RUNS; i++)); do
+    time "$MAIN" "$SOURCE_DIR/$name.wsp" > /dev/null
+  done
+done
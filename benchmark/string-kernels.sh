@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Times REPEAT calls of remove-whitespaces, is-int-string and parse-int and
+# REPEAT / 10 calls of split on strings of N bytes with each --simd level.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-4000000}
+RUNS=${RUNS:-3}
+REPEAT=${REPEAT:-100}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+# words of 7 to 16 letters between single spaces
+yes "worsp string builtins are scanned blockwise" | head -c "$N" |
+  tr '\n' ' ' > "$SOURCE_DIR/text"
+yes "1234567890" | head -c "$N" | tr -d '\n' > "$SOURCE_DIR/digits"
+
+# reading the literals alone, to subtract from the others
+cat > "$SOURCE_DIR/read.wsp" <<WSP
+(= s "$(cat "$SOURCE_DIR/text")")
+(= d "$(cat "$SOURCE_DIR/digits")")
+WSP
+cat > "$SOURCE_DIR/remove-whitespaces.wsp" <<WSP
+(= s "$(cat "$SOURCE_DIR/text")")
+(dotimes (i $REPEAT) (remove-whitespaces s))
+WSP
+cat > "$SOURCE_DIR/is-int-string.wsp" <<WSP
+(= s "$(cat "$SOURCE_DIR/digits")")
+(dotimes (i $REPEAT) (is-int-string s))
+WSP
+cat > "$SOURCE_DIR/parse-int.wsp" <<WSP
+(= s "$(cat "$SOURCE_DIR/digits")")
+(dotimes (i $REPEAT) (parse-int s))
+WSP
+cat > "$SOURCE_DIR/split.wsp" <<WSP
+(= s "$(cat "$SOURCE_DIR/text")")
+(dotimes (i $((REPEAT / 10))) (split s " "))
+WSP
+
+# user time, the kernels are CPU bound and the wall clock of a shared machine
+# is noisy
+TIMEFORMAT="%U s"
+
+echo "read"
+for ((i = 0; i < RUNS; i++)); do
+  time "$MAIN" "$SOURCE_DIR/read.wsp" > /dev/null
+done
+
+for name in remove-whitespaces is-int-string parse-int split; do
+  for level in 0 1 2; do
+    echo "$name --simd=$level"
+    for ((i = 0; i < RUNS; i++)); do
+      time "$MAIN" --simd=$level "$SOURCE_DIR/$name.wsp" > /dev/null
+    done
+  done
+done
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# Times walking a string of N characters with string-ref, which used to
+# measure the string on every index check, and with dolist over the
+# characters split from it.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-20000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+head -c "$N" /dev/zero | tr '\0' 'a' > "$SOURCE_DIR/chars"
+cat > "$SOURCE_DIR/string-ref.wsp" <<WSP
+(= s "$(cat "$SOURCE_DIR/chars")")
+(= n 0)
+(dotimes (i (length s)) (if (eq (string-ref s i) "a") (= n (+ n 1))))
+(print n)
+WSP
+cat > "$SOURCE_DIR/split.wsp" <<WSP
+(= s "$(cat "$SOURCE_DIR/chars")")
+(= n 0)
+(dolist (c (split s "")) (if (eq c "a") (= n (+ n 1))))
+(print n)
+WSP
+
+TIMEFORMAT="%R s"
+
+for name in string-ref split; do
+  echo "$name"
+  for ((i = 0; i < RUNS; i++)); do
+    time "$MAIN" "$SOURCE_DIR/$name.wsp" > /dev/null
+  done
+done
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# Times filling a sequence of N integers with push and summing it with
+# list-ref, against vector-push and vector-ref.
+
+SCRIPT_DIR=$(dirname "$0")
+MAIN="$SCRIPT_DIR/../main"
+
+N=${N:-20000}
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+cat > "$SOURCE_DIR/list.wsp" <<WSP
+(= l nil)
+(dotimes (i $N) (push l i))
+(= s 0)
+(dotimes (i (length l)) (= s (+ s (list-ref l i))))
+(print s)
+WSP
+cat > "$SOURCE_DIR/vector.wsp" <<WSP
+(= v (vector))
+(dotimes (i $N) (vector-push v i))
+(= s 0)
+(dotimes (i (vector-length v)) (= s (+ s (vector-ref v i))))
+(print s)
+WSP
+
+TIMEFORMAT="%R s"
+
+for name in list vector; do
+  echo "$name"
+  for ((i = 0; i < RUNS; i++)); do
+    time "$MAIN" "$SOURCE_DIR/$name.wsp" > /dev/null
+  done
+done
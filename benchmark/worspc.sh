@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Compares the interpreter with the program translated by worspc.
+
+SCRIPT_DIR=$(dirname "$0")
+ROOT_DIR="$SCRIPT_DIR/.."
+
+RUNS=${RUNS:-3}
+
+SOURCE_DIR=$(mktemp -d)
+trap 'rm -rf "$SOURCE_DIR"' EXIT
+
+cat > "$SOURCE_DIR/fib.wsp" <<WSP
+(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(print (fib ${FIB:-30}))
+WSP
+
+cat > "$SOURCE_DIR/loop.wsp" <<WSP
+(= i 0)
+(= s 0)
+(while (< i ${ITERATIONS:-3000000})
+  (progn
+    (= s (+ s (% i 7)))
+    (= i (+ i 1))))
+(print s)
+WSP
+
+make --no-print-directory -C "$ROOT_DIR" main worspc worsp_runtime.o > /dev/null
+
+TIMEFORMAT="%R s"
+
+for NAME in fib loop; do
+  "$ROOT_DIR/worspc" "$SOURCE_DIR/$NAME.wsp" > "$SOURCE_DIR/$NAME.c"
+  gcc -O2 -I"$ROOT_DIR" "$SOURCE_DIR/$NAME.c" "$ROOT_DIR/worsp_runtime.o" \
+    -o "$SOURCE_DIR/$NAME" -lm -lpthread
+  for ((i = 0; i < RUNS; i++)); do
+    echo -n "$NAME (interpreter): "
+    { time "$ROOT_DIR/main" "$SOURCE_DIR/$NAME.wsp" > /dev/null; } 2>&1
+    echo -n "$NAME (worspc): "
+    { time "$SOURCE_DIR/$NAME" > /dev/null; } 2>&1
+  done
+done
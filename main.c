@@ -1,14 +1,72 @@
 #include "worsp.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 int main(int argc, char *argv[]) {
-  if (argc != 2) {
+  bool stream_mode = false;
+  bool pipeline_mode = false;
+  int parse_threads = 0;
+  bool cache_mode = false;
+  char *cache_dir = NULL;
+  int optimize_level = 0;
+  char *filepath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stream") == 0) {
+      stream_mode = true;
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      pipeline_mode = true;
+    } else if (strcmp(argv[i], "--parallel") == 0) {
+      parse_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    } else if (strncmp(argv[i], "--parallel=", 11) == 0) {
+      parse_threads = atoi(&argv[i][11]);
+    } else if (strcmp(argv[i], "--cache") == 0) {
+      cache_mode = true;
+    } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+      cache_mode = true;
+      cache_dir = &argv[i][12];
+    } else if (strcmp(argv[i], "--jit") == 0) {
+      jit_call_threshold = JIT_DEFAULT_CALL_THRESHOLD;
+    } else if (strncmp(argv[i], "--jit=", 6) == 0) {
+      // number of calls before a function is compiled
+      jit_call_threshold = atoi(&argv[i][6]);
+    } else if (strncmp(argv[i], "--pmap-threads=", 15) == 0) {
+      pmap_thread_count = atoi(&argv[i][15]);
+    } else if (strncmp(argv[i], "--simd=", 7) == 0) {
+      // 0 scalar, 1 SSE2, 2 AVX2
+      simd_level = atoi(&argv[i][7]);
+    } else if (strncmp(argv[i], "-O", 2) == 0) {
+      optimize_level = atoi(&argv[i][2]);
+    } else {
+      filepath = argv[i];
+    }
+  }
+
+  if (filepath == NULL) {
     printf("filepath is required.\n");
     return 1;
   }
 
-  char *filepath = argv[1];
+  if (stream_mode || pipeline_mode) {
+    // parse and evaluate one top-level form at a time, "-" reads stdin
+    FILE *file = strcmp(filepath, "-") == 0 ? stdin : fopen(filepath, "rb");
+    if (file == NULL) {
+      perror("Cannot open file");
+      return 1;
+    }
+    if (pipeline_mode) {
+      evaluatePipelined(file, optimize_level);
+    } else {
+      evaluateStream(file, optimize_level);
+    }
+    if (file != stdin) {
+      fclose(file);
+    }
+    return 0;
+  }
 
   FILE *file =
       fopen(filepath, "rb"); // "rb" はバイナリモードで読み込むことを指定
@@ -34,13 +92,48 @@ int main(int argc, char *argv[]) {
 
   fclose(file);
 
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult *result = malloc(sizeof(struct ParseResult));
 
-  parse(file_contents, &state, result);
+  // the cache lives next to the source (foo.wsp -> foo.wspc) or in the cache
+  // directory under the hash of the source
+  char *cache_path = NULL;
+  uint64_t hash = 0;
+  result->program = NULL;
+  // parse() allocates each node with malloc, parallel parsing and the cache
+  // do not
+  bool owned_program = false;
+  if (cache_mode) {
+    hash = hashSource(file_contents, file_size);
+    size_t length = (cache_dir != NULL ? strlen(cache_dir) : strlen(filepath)) +
+                    sizeof("/0123456789abcdef.wspc");
+    cache_path = malloc(length);
+    if (cache_dir != NULL) {
+      snprintf(cache_path, length, "%s/%016llx.wspc", cache_dir,
+               (unsigned long long)hash);
+    } else {
+      snprintf(cache_path, length, "%sc", filepath);
+    }
+    result->program = loadScriptCache(cache_path, hash);
+  }
+
+  if (result->program == NULL) {
+    if (parse_threads > 0) {
+      parseParallel(file_contents, parse_threads, result);
+    } else {
+      parse(file_contents, &state, result);
+      owned_program = true;
+    }
+    if (cache_mode && !writeScriptCache(cache_path, hash, result->program)) {
+      perror("Cannot write cache");
+    }
+  }
+  // the cache keeps the unoptimized program so that it serves every level
+  optimizeProgram(result->program, optimize_level, owned_program);
   evaluate(result);
 
   free(file_contents);
+  free(cache_path);
   free(result);
 
   return 0;
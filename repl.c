@@ -25,7 +25,7 @@ int main() {
       break;
     }
 
-    struct ParseState state = (struct ParseState){NULL, 0};
+    struct ParseState state = (struct ParseState){NULL, 0, NULL};
     struct ParseResult *result = malloc(sizeof(struct ParseResult));
     struct Object *evaluated = allocate(context, &env);
     parse(input, &state, result);
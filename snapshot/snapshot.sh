@@ -20,29 +20,49 @@ done
 
 declare -a RESULTS
 
+CACHE_DIR=$(mktemp -d)
+trap 'rm -rf "$CACHE_DIR"' EXIT
+
+# every fixture must print the same output in each of these modes of main,
+# the cache mode runs twice to check both writing and loading the cache,
+# worspc runs the fixture translated to C
+MODES=("" "--stream" "--pipeline" "--parallel=3" "--cache-dir=$CACHE_DIR" "--cache-dir=$CACHE_DIR"
+       "-O1" "-O2" "--stream -O2" "--cache-dir=$CACHE_DIR -O2" "--jit=1" "--jit=1 -O2" "worspc")
+
+# pmap runs on four threads however many cores the machine has, so that the
+# fixtures always check it in parallel
+PMAP_FLAGS="--pmap-threads=4"
+
 ALL_TESTS_PASSED=true
 
 for FILE in $(find "$SCRIPT_DIR/fixtures" -name '*.wsp'); do
-  FULL_OUTPUT=$(make --no-print-directory run-main WORSP_FILE="$FILE")
-  OUTPUT=$(echo -e "$FULL_OUTPUT" | sed -n '2,$p')
-  EXIT_CODE=$?
-
-  if [ $EXIT_CODE -ne 0 ]; then
-    echo "Test failed for $FILE."
-    ALL_TESTS_PASSED=false
-    break
-  fi
-
-  if [ "$UPDATE_SNAPSHOT" = true ]; then
-    RESULTS+=("{\"fixture\":\"$FILE\",\"stdout\":\"$OUTPUT\"}")
-  else
-    EXPECTED_OUTPUT=$(jq -r --arg file "$FILE" '.[] | select(.fixture == $file) | .stdout' "$SNAPSHOT_FILE")
-
-    if [ "$OUTPUT" != "$EXPECTED_OUTPUT" ]; then
-      echo "Test failed for $FILE. Expected '$EXPECTED_OUTPUT', got '$OUTPUT'."
+  for MODE in "${MODES[@]}"; do
+    if [ "$MODE" = "worspc" ]; then
+      FULL_OUTPUT=$(make --no-print-directory run-worspc WORSP_FILE="$FILE" WORSPC_OUTPUT="$CACHE_DIR/program" WORSPC_FLAGS="$PMAP_FLAGS")
+    else
+      FULL_OUTPUT=$(make --no-print-directory run-main MAIN_FLAGS="$PMAP_FLAGS $MODE" WORSP_FILE="$FILE")
+    fi
+    OUTPUT=$(echo -e "$FULL_OUTPUT" | sed -n '2,$p')
+    EXIT_CODE=$?
+
+    if [ $EXIT_CODE -ne 0 ]; then
+      echo "Test failed for $FILE."
       ALL_TESTS_PASSED=false
+      break
     fi
-  fi
+
+    if [ "$UPDATE_SNAPSHOT" = true ]; then
+      RESULTS+=("{\"fixture\":\"$FILE\",\"stdout\":\"$OUTPUT\"}")
+      break
+    else
+      EXPECTED_OUTPUT=$(jq -r --arg file "$FILE" '.[] | select(.fixture == $file) | .stdout' "$SNAPSHOT_FILE")
+
+      if [ "$OUTPUT" != "$EXPECTED_OUTPUT" ]; then
+        echo "Test failed for $FILE${MODE:+ ($MODE)}. Expected '$EXPECTED_OUTPUT', got '$OUTPUT'."
+        ALL_TESTS_PASSED=false
+      fi
+    fi
+  done
 done
 
 
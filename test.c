@@ -1,8 +1,13 @@
 #include "worsp.h"
 #include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define TEST_ASSERT(expr)                                                      \
   do {                                                                         \
@@ -22,7 +27,7 @@
 
 void next_singleCharSymbol() {
   char *source = "a";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   next(source, &state);
   TEST_ASSERT(state.token->kind == TK_SYMBOL);
   TEST_ASSERT(strcmp(state.token->str, "a") == 0);
@@ -30,7 +35,7 @@ void next_singleCharSymbol() {
 
 void next_multipleCharSymbol() {
   char *source = "aaaa";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   next(source, &state);
   TEST_ASSERT(state.token->kind == TK_SYMBOL);
   TEST_ASSERT(strcmp(state.token->str, "aaaa") == 0);
@@ -38,7 +43,7 @@ void next_multipleCharSymbol() {
 
 void next_parenAndDigit() {
   char *source = "(1)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   next(source, &state);
   TEST_ASSERT(state.token->kind == TK_LPAREN);
   next(source, &state);
@@ -50,7 +55,7 @@ void next_parenAndDigit() {
 
 void next_ifAndSet() {
   char *source = "(if (set a 1) (set b 2) (set c 3))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   next(source, &state);
   TEST_ASSERT(state.token->kind == TK_LPAREN);
   next(source, &state);
@@ -101,7 +106,7 @@ void next_ifAndSet() {
 
 void next_string() {
   char *source = "\"hello\" () 1 \"foo\" \"bar\"";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   next(source, &state);
   TEST_ASSERT(state.token->kind == TK_STRING);
   TEST_ASSERT(strcmp(state.token->str, "hello") == 0);
@@ -122,7 +127,7 @@ void next_string() {
 
 void next_addOp() {
   char *source = "(+ 1 2)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   next(source, &state);
   TEST_ASSERT(state.token->kind == TK_LPAREN);
   next(source, &state);
@@ -140,7 +145,7 @@ void next_addOp() {
 
 void next_listExpr() {
   char *source = "'(1 2 3)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   next(source, &state);
   TEST_ASSERT(state.token->kind == TK_QUOTE);
   next(source, &state);
@@ -160,7 +165,7 @@ void next_listExpr() {
 
 void parse_intLiteral() {
   char *source = "3";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
   TEST_ASSERT(result.program->expressions->expression->type == EXP_LITERAL);
@@ -172,7 +177,7 @@ void parse_intLiteral() {
 
 void parse_stringLiteral() {
   char *source = "\"foo\"";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
   TEST_ASSERT(result.program->expressions->expression->type == EXP_LITERAL);
@@ -186,7 +191,7 @@ void parse_stringLiteral() {
 
 void parse_multipleLiteralExpressions() {
   char *source = "3 \"foo\"";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
   TEST_ASSERT(result.program->expressions->expression->type == EXP_LITERAL);
@@ -207,7 +212,7 @@ void parse_multipleLiteralExpressions() {
 
 void parse_integersSymbolicExpr() {
   char *source = "(1 2 3)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -237,7 +242,7 @@ void parse_integersSymbolicExpr() {
 
 void parse_integersList() {
   char *source = "'(1 2 3)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -264,11 +269,294 @@ void parse_integersList() {
   TEST_ASSERT(match(&state, TK_EOF));
 }
 
+void readTopLevelForm_splitsForms() {
+  char source[] = "(print \"a)\") ; (b\n'(1 (2)) foo\"bar\" 3 ; end";
+  FILE *file = fmemopen(source, strlen(source), "r");
+  struct StreamReader *reader = initStreamReader(file);
+  TEST_ASSERT(readTopLevelForm(reader));
+  TEST_ASSERT(strcmp(reader->form, "(print \"a)\")") == 0);
+  TEST_ASSERT(readTopLevelForm(reader));
+  TEST_ASSERT(strcmp(reader->form, "'(1 (2))") == 0);
+  TEST_ASSERT(readTopLevelForm(reader));
+  TEST_ASSERT(strcmp(reader->form, "foo") == 0);
+  TEST_ASSERT(readTopLevelForm(reader));
+  TEST_ASSERT(strcmp(reader->form, "\"bar\"") == 0);
+  TEST_ASSERT(readTopLevelForm(reader));
+  TEST_ASSERT(strcmp(reader->form, "3") == 0);
+  TEST_ASSERT(!readTopLevelForm(reader));
+  freeStreamReader(reader);
+  fclose(file);
+}
+
+void readTopLevelForm_largeForm() {
+  // a form larger than the refill buffer spans several reads
+  int count = STREAM_BUFFER_SIZE;
+  char *source = malloc(count * 2 + 4);
+  int pos = 0;
+  source[pos++] = '\'';
+  source[pos++] = '(';
+  for (int i = 0; i < count; i++) {
+    source[pos++] = '1';
+    source[pos++] = ' ';
+  }
+  source[pos++] = ')';
+  FILE *file = fmemopen(source, pos, "r");
+  struct StreamReader *reader = initStreamReader(file);
+  TEST_ASSERT(readTopLevelForm(reader));
+  TEST_ASSERT((int)reader->form_len == pos);
+  TEST_ASSERT(!readTopLevelForm(reader));
+  freeStreamReader(reader);
+  fclose(file);
+  free(source);
+}
+
+void *pushNumberedExpressions(void *arg) {
+  struct ExpressionQueue *queue = arg;
+  for (int i = 0; i < EXPRESSION_QUEUE_SIZE * 4; i++) {
+    struct ExpressionNode *expression = malloc(sizeof(struct ExpressionNode));
+    expression->type = EXP_LITERAL;
+    expression->data.literal = malloc(sizeof(struct LiteralNode));
+    expression->data.literal->type = LIT_INTERGER;
+    expression->data.literal->int_value = i;
+    pushExpressionQueue(queue, expression);
+  }
+  pushExpressionQueue(queue, NULL);
+  return NULL;
+}
+
+void expressionQueue_preservesOrder() {
+  struct ExpressionQueue queue;
+  initializeExpressionQueue(&queue);
+  pthread_t producer;
+  pthread_create(&producer, NULL, pushNumberedExpressions, &queue);
+  int expected = 0;
+  struct ExpressionNode *expression;
+  while ((expression = popExpressionQueue(&queue)) != NULL) {
+    TEST_ASSERT(expression->data.literal->int_value == expected);
+    expected++;
+    freeExpression(expression);
+  }
+  TEST_ASSERT(expected == EXPRESSION_QUEUE_SIZE * 4);
+  pthread_join(producer, NULL);
+  destroyExpressionQueue(&queue);
+}
+
+void releaseExpression_keepsRetainedNodes() {
+  char *source = "(progn (defun f (a) (+ a 1)) "
+                 "(= s \"a string longer than the interned ones\") "
+                 "(dotimes (i 3) i) "
+                 "'(\"another string that is not interned\" 1)) "
+                 "(+ (+ (f 1) (length s)) i)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  struct AllocatorContext *context = initAllocator();
+  struct ExpressionNode *form = result.program->expressions->expression;
+  struct Object evaluated = (struct Object){};
+  evaluateExpression(form, &evaluated, &env, context);
+
+  struct ExpressionList *operands = form->data.symbolic_exp->expressions->next;
+  TEST_ASSERT(!form->retained);
+  // the function, the binding of s and its string, the loop variable
+  TEST_ASSERT(operands->expression->retained);
+  struct ExpressionList *assignment =
+      operands->next->expression->data.symbolic_exp->expressions;
+  TEST_ASSERT(assignment->next->expression->retained);
+  TEST_ASSERT(assignment->next->next->expression->retained);
+  struct ExpressionList *loop =
+      operands->next->next->expression->data.symbolic_exp->expressions;
+  TEST_ASSERT(loop->next->expression->data.symbolic_exp->expressions
+                  ->expression->retained);
+  // the constant list shares the string of its literal, not the list itself
+  struct ExpressionNode *list = operands->next->next->next->expression;
+  TEST_ASSERT(!list->retained);
+  TEST_ASSERT(list->data.list->expressions->expression->retained);
+
+  releaseExpression(form);
+  evaluateExpression(result.program->expressions->next->expression,
+                     &evaluated, &env, context);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 2 + 38 + 2);
+}
+
+void parseParallel_keepsOrder() {
+  char *source = "(print \")(\") ; (\n'(1 2) a \"b\" (c (d)) 3 4 5";
+  struct ParseResult result = (struct ParseResult){NULL};
+  parseParallel(source, 3, &result);
+  struct ExpressionList *expressions = result.program->expressions;
+  TEST_ASSERT(expressions->expression->type == EXP_SYMBOLIC_EXP);
+  expressions = expressions->next;
+  TEST_ASSERT(expressions->expression->type == EXP_LIST);
+  expressions = expressions->next;
+  TEST_ASSERT(expressions->expression->type == EXP_SYMBOL);
+  TEST_ASSERT(
+      strcmp(expressions->expression->data.symbol->symbol_name, "a") == 0);
+  expressions = expressions->next;
+  TEST_ASSERT(expressions->expression->type == EXP_LITERAL);
+  TEST_ASSERT(
+      strcmp(expressions->expression->data.literal->string_value, "b") == 0);
+  expressions = expressions->next;
+  TEST_ASSERT(expressions->expression->type == EXP_SYMBOLIC_EXP);
+  for (int i = 3; i <= 5; i++) {
+    expressions = expressions->next;
+    TEST_ASSERT(expressions->expression->data.literal->int_value == i);
+  }
+  TEST_ASSERT(expressions->next == NULL);
+}
+
+void scriptCache_roundTrip() {
+  char *source = "(defun f (a) (+ a 1)) '(\"x\" true 2) (print \"x\") a";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+
+  char path[] = "/tmp/worsp-test-XXXXXX";
+  int fd = mkstemp(path);
+  TEST_ASSERT(fd >= 0);
+  close(fd);
+  uint64_t hash = hashSource(source, strlen(source));
+  TEST_ASSERT(writeScriptCache(path, hash, result.program));
+  TEST_ASSERT(loadScriptCache(path, hash + 1) == NULL);
+  struct ProgramNode *program = loadScriptCache(path, hash);
+  unlink(path);
+  TEST_ASSERT(program != NULL);
+
+  struct ExpressionList *expressions = program->expressions;
+  struct ExpressionNode *defun = expressions->expression;
+  TEST_ASSERT(defun->type == EXP_SYMBOLIC_EXP);
+  TEST_ASSERT(strcmp(defun->data.symbolic_exp->expressions->expression->data
+                         .symbol->symbol_name,
+                     "defun") == 0);
+  expressions = expressions->next;
+  struct ExpressionList *items = expressions->expression->data.list->expressions;
+  TEST_ASSERT(strcmp(items->expression->data.literal->string_value, "x") == 0);
+  TEST_ASSERT(items->next->expression->data.literal->boolean_value == true);
+  TEST_ASSERT(items->next->next->expression->data.literal->int_value == 2);
+  TEST_ASSERT(items->next->next->next == NULL);
+  expressions = expressions->next;
+  // equal strings are stored once
+  TEST_ASSERT(expressions->expression->data.symbolic_exp->expressions->next
+                  ->expression->data.literal->string_value ==
+              items->expression->data.literal->string_value);
+  expressions = expressions->next;
+  TEST_ASSERT(strcmp(expressions->expression->data.symbol->symbol_name, "a") ==
+              0);
+  TEST_ASSERT(expressions->next == NULL);
+}
+
+void scriptCache_rejectsCorruptImage() {
+  char *source = "(defun f (a) (+ a 1)) (print \"x\")";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  uint64_t hash = hashSource(source, strlen(source));
+
+  char path[] = "/tmp/worsp-test-XXXXXX";
+  int fd = mkstemp(path);
+  TEST_ASSERT(fd >= 0);
+  close(fd);
+  TEST_ASSERT(writeScriptCache(path, hash, result.program));
+  fd = open(path, O_RDWR);
+  struct ScriptCacheHeader header;
+  TEST_ASSERT(pread(fd, &header, sizeof(header), 0) == sizeof(header));
+  uint64_t program_offset = header.program_offset;
+
+  // the program lies outside of the image
+  header.program_offset = header.size;
+  TEST_ASSERT(pwrite(fd, &header, sizeof(header), 0) == sizeof(header));
+  TEST_ASSERT(loadScriptCache(path, hash) == NULL);
+
+  // another version of the format
+  header.program_offset = program_offset;
+  header.version = SCRIPT_CACHE_VERSION + 1;
+  TEST_ASSERT(pwrite(fd, &header, sizeof(header), 0) == sizeof(header));
+  TEST_ASSERT(loadScriptCache(path, hash) == NULL);
+  header.version = SCRIPT_CACHE_VERSION;
+  TEST_ASSERT(pwrite(fd, &header, sizeof(header), 0) == sizeof(header));
+  TEST_ASSERT(loadScriptCache(path, hash) != NULL);
+
+  // the first expression points past the end of the image
+  uint64_t expressions = header.size + 8;
+  TEST_ASSERT(pwrite(fd, &expressions, sizeof(expressions),
+                     program_offset +
+                         offsetof(struct ProgramNode, expressions)) ==
+              sizeof(expressions));
+  TEST_ASSERT(loadScriptCache(path, hash) == NULL);
+
+  // the first expression points into the header
+  expressions = 8;
+  TEST_ASSERT(pwrite(fd, &expressions, sizeof(expressions),
+                     program_offset +
+                         offsetof(struct ProgramNode, expressions)) ==
+              sizeof(expressions));
+  TEST_ASSERT(loadScriptCache(path, hash) == NULL);
+  close(fd);
+  unlink(path);
+}
+
+void optimize_foldsBuiltins() {
+  char *source = "(+ 1 (* 2 3)) (+ \"a\" \"b\") (/ 1 0)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  optimizeProgram(result.program, 1, true);
+
+  struct ExpressionList *expressions = result.program->expressions;
+  TEST_ASSERT(expressions->expression->type == EXP_LITERAL);
+  TEST_ASSERT(expressions->expression->data.literal->int_value == 7);
+  expressions = expressions->next;
+  TEST_ASSERT(expressions->expression->type == EXP_LITERAL);
+  TEST_ASSERT(
+      strcmp(expressions->expression->data.literal->string_value, "ab") == 0);
+  // errors are left for the evaluator to report
+  expressions = expressions->next;
+  TEST_ASSERT(expressions->expression->type == EXP_SYMBOLIC_EXP);
+}
+
+void optimize_prunesConstantConditions() {
+  char *source = "(if (< 2 1) (print 1) a) (|| x false true y) (&& false x)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  optimizeProgram(result.program, 1, true);
+
+  struct ExpressionList *expressions = result.program->expressions;
+  TEST_ASSERT(expressions->expression->type == EXP_SYMBOL);
+  TEST_ASSERT(
+      strcmp(expressions->expression->data.symbol->symbol_name, "a") == 0);
+  expressions = expressions->next;
+  struct ExpressionList *operands =
+      expressions->expression->data.symbolic_exp->expressions->next;
+  TEST_ASSERT(strcmp(operands->expression->data.symbol->symbol_name, "x") == 0);
+  TEST_ASSERT(operands->next->expression->data.literal->boolean_value == true);
+  TEST_ASSERT(operands->next->next == NULL);
+  expressions = expressions->next;
+  TEST_ASSERT(expressions->expression->type == EXP_LITERAL);
+  TEST_ASSERT(expressions->expression->data.literal->boolean_value == false);
+}
+
+void optimize_flattensProgn() {
+  char *source = "(progn 1 (progn (print 2) '(3)) x)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  optimizeProgram(result.program, 2, true);
+
+  struct ExpressionList *operands =
+      result.program->expressions->expression->data.symbolic_exp->expressions
+          ->next;
+  TEST_ASSERT(operands->expression->type == EXP_SYMBOLIC_EXP);
+  TEST_ASSERT(operands->next->expression->type == EXP_SYMBOL);
+  TEST_ASSERT(operands->next->next == NULL);
+}
+
 void evaluate_literalExpressionInt() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "3";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -286,7 +574,7 @@ void evaluate_literalExpressionString() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "\"foo\"";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -304,7 +592,7 @@ void evaluate_nil() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "nil";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -321,7 +609,7 @@ void evaluate_listWithInt() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "'(133)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -341,7 +629,7 @@ void evaluate_listWithMultipleInt() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "'(133 234 345)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -369,7 +657,7 @@ void evaluate_emptyList() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "'()";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -386,7 +674,7 @@ void evaluate_emptySymbolicExp() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "()";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -403,7 +691,7 @@ void evaluate_addOp() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(+ 1222 21)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -421,7 +709,7 @@ void evaluate_subOp() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(- 1222 21)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -439,7 +727,7 @@ void evaluate_mulOp() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(* 1222 21)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -457,7 +745,7 @@ void evaluate_divOp() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(/ 1222 21)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -475,7 +763,7 @@ void evaluate_modOp() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(% 1222 21)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -493,7 +781,7 @@ void evaluate_orOpTrue() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(|| true false)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -511,7 +799,7 @@ void evaluate_orOpFalse() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(|| false false)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -529,7 +817,7 @@ void evaluate_orOpTrueInt() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(|| 1 false)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -547,7 +835,7 @@ void evaluate_orOpTrueNil() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(|| 1 nil)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -565,7 +853,7 @@ void evaluted_nestedOps() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(+ 1 (- 2 (* 3 (/ 4 2))))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -583,7 +871,7 @@ void evaluate_andOpFalse() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(&& false false)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -601,7 +889,7 @@ void evaluate_andOpFalseInt() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(&& 1 false)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -619,7 +907,7 @@ void evaluate_andOpFalseNil() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(&& 1 nil)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -637,7 +925,7 @@ void evaluate_andOpTrue() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(&& true true)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -655,7 +943,7 @@ void evaluate_andOpTrueInt() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(&& 1 2)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -673,7 +961,7 @@ void evaluate_ltOpTrue() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(< 1 2)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -691,7 +979,7 @@ void evaluate_ltOpFalse() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(< 2 1)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -709,7 +997,7 @@ void evaluate_gtOpTrue() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(> 2 1)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -727,7 +1015,7 @@ void evaluate_gtOpFalse() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(> 1 2)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -745,7 +1033,7 @@ void evaluate_notTrue() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(not false)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -763,7 +1051,7 @@ void evaluate_notFalse() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(not true)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -781,7 +1069,7 @@ void evaluate_notFalseEq() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(not (eq 1 1))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -799,7 +1087,7 @@ void evaluate_eqTrue() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(eq 1 1)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -817,7 +1105,7 @@ void evaluate_eqFalse() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(eq 2 1)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -835,7 +1123,7 @@ void evaluate_eqTrueNil() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(eq nil nil)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -853,7 +1141,7 @@ void evaluate_eqTrueNilList() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(eq '() nil)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -871,7 +1159,7 @@ void evaluate_eqTrueNilSExp() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(eq () nil)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   parse(source, &state, &result);
 
@@ -889,7 +1177,7 @@ void evaluate_printString() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(print \"hello\")";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -902,7 +1190,7 @@ void evaluate_printInt() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(print 3)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -915,7 +1203,7 @@ void evaluate_printBooleanT() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(print true)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -928,7 +1216,7 @@ void evaluate_printBooleanF() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(print false)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -941,7 +1229,7 @@ void evaluate_printList() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(print '(1 2 3))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -954,7 +1242,7 @@ void evaluate_ifThen() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(if true 1)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -968,7 +1256,7 @@ void evaluate_ifThenElse() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(if false 1 2)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -982,7 +1270,7 @@ void evaluate_complexIf() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(if (|| (eq 1 1) false) (if true 1 2) 2)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -996,7 +1284,7 @@ void evaluate_car() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(car '(1 2 3))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1011,7 +1299,7 @@ void evaluate_cdr() {
   initEnv(&env);
 
   char *source = "(cdr '(1 2 3))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1029,7 +1317,7 @@ void evaluate_consIntList() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(cons 1 '(2 3))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1050,7 +1338,7 @@ void evaluate_consInt() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(cons 1 2)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1066,7 +1354,7 @@ void evaluate_consListList() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(cons '(1 2) '(3 4))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1088,7 +1376,7 @@ void evaluate_assignment() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "'((= a 1) a)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1105,7 +1393,7 @@ void evaluate_assignmentComplex() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "'((= a 1) (+ a 2))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1122,7 +1410,7 @@ void evaluate_defun() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "'((defun fn (a) (+ a 1)) (fn 1))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1138,7 +1426,7 @@ void evaluate_defunClosure() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "'((= a 2) (= b 3) (defun fn (c) (+(+ a b) c)) (fn 1))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1165,7 +1453,7 @@ void evaluate_fact() {
   // calc factorial with recursion
   char *source =
       "'((defun fact (n) (if (eq n 0) 1 (* n (fact (- n 1))))) (fact 5))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1181,7 +1469,7 @@ void evaluate_assignmentAndReuse() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "'((= a 1) (= a 2) a)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1204,7 +1492,7 @@ void evaluate_stringConcat() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(+ \"foo\" \"bar\")";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1219,7 +1507,7 @@ void evaluate_while() {
   initEnv(&env);
   char *source = "'((= counter 5) (while (> counter 0) (print counter) (= "
                  "counter (- counter 1))))";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1235,7 +1523,7 @@ void evalute_split() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(split \"1 + 1 + 1 \" \" \")";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1269,7 +1557,7 @@ void evaluate_splitWithEmptryChar() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(split \"foo\" \"\")";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1293,7 +1581,7 @@ void evaluate_progn() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(progn 1 2 3)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
@@ -1307,14 +1595,821 @@ void evaluate_listRef() {
   struct Env env = (struct Env){};
   initEnv(&env);
   char *source = "(list-ref '(1 2 3) 1)";
-  struct ParseState state = (struct ParseState){NULL, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 2);
+}
+
+void evaluate_constantListIsShared() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "'(1 \"a\" true)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct ExpressionNode *expr = result.program->expressions->expression;
+  struct AllocatorContext *context = initAllocator();
+
+  struct Object first = (struct Object){};
+  evaluateExpression(expr, &first, &env, context);
+  unsigned long allocation_count = context->allocation_count;
+  struct Object second = (struct Object){};
+  evaluateExpression(expr, &second, &env, context);
+
+  // only the head cell is fresh
+  TEST_ASSERT(context->allocation_count == allocation_count + 1);
+  TEST_ASSERT(first.list_value != second.list_value);
+  TEST_ASSERT(first.list_value->cdr->list_value ==
+              second.list_value->cdr->list_value);
+  TEST_ASSERT(strcmp(stringifyObject(&second), "(1 a T)") == 0);
+}
+
+void evaluate_pushCopiesConstantList() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (defun f () '(1 2)) (= a (f)) (push a 3) (f))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(strcmp(stringifyObject(&evaluated), "(1 2)") == 0);
+}
+
+void evaluate_callSiteCacheFollowsRebinding() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (defun f () 1) (defun g () (f)) (defun h (f) (g)) "
+                 "(defun f2 () 20) (= a (g)) (= b (h f2)) (defun f () 3) "
+                 "(+ (+ a b) (* (g) 100)))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 321);
+}
+
+// evaluates the program of source in a child process, which exits on errors,
+// and returns its exit status with what it printed in output
+int evaluateInChild(char *source, struct Env *env, char *output, int size) {
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  int fds[2];
+  TEST_ASSERT(pipe(fds) == 0);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    struct Object evaluated = (struct Object){};
+    for (struct ExpressionList *expressions = result.program->expressions;
+         expressions != NULL; expressions = expressions->next) {
+      evaluateExpressionWithContext(expressions->expression, &evaluated, env);
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  int length = 0;
+  int n;
+  while (length < size - 1 &&
+         (n = read(fds[0], output + length, size - 1 - length)) > 0) {
+    length += n;
+  }
+  output[length] = '\0';
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void evaluate_frameBindingShadowsCachedFunction() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char output[64];
+  // the first call of g caches the global f, which the parameter of h and
+  // the local of k shadow while they are called
+  TEST_ASSERT(evaluateInChild("(defun f () 1) (defun g () (f)) "
+                              "(defun h (f) (g)) (print (g)) (h 5)",
+                              &env, output, sizeof(output)) == 1);
+  TEST_ASSERT(strcmp(output, "1\nType error: f is not a function.\n") == 0);
+  TEST_ASSERT(evaluateInChild("(defun f () 1) (defun g () (f)) "
+                              "(defun k () (progn (= f 5) (g))) (print (g)) "
+                              "(k)",
+                              &env, output, sizeof(output)) == 1);
+  TEST_ASSERT(strcmp(output, "1\nType error: f is not a function.\n") == 0);
+}
+
+void evaluate_defunFrameLayout() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(defun f (a b) (progn (= c a) (= a 2) (defun g (x) (= d x)) "
+                 "(= c (+ c b))))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_FUNCTION);
+  TEST_ASSERT(evaluated.function_value->arity == 2);
+  // a and b, then c and g
+  TEST_ASSERT(evaluated.function_value->frame_size == 4);
+  TEST_ASSERT(strcmp(evaluated.function_value->param_symbol_names[1], "b") ==
+              0);
+
+  source = "(f 3 4)";
+  state = (struct ParseState){NULL, 0, NULL};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 7);
+}
+
+void evaluate_countedLoopDoesNotAllocate() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(= n 100) (defun count () (progn (= i 0) (= s 0) "
+                 "(while (< i n) (progn (= s (+ s i)) (= i (+ i 1)))) (progn s)))"
+                 " (count) (count)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct AllocatorContext *context = initAllocator();
+  struct ExpressionList *expressions = result.program->expressions;
+  struct Object evaluated = (struct Object){};
+  for (int i = 0; i < 3; i++) {
+    evaluateExpression(expressions->expression, &evaluated, &env, context);
+    expressions = expressions->next;
+  }
+  unsigned long allocation_count = context->allocation_count;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+
+  // the frame and the bindings of i and s, nothing per iteration
+  TEST_ASSERT(context->allocation_count <= allocation_count + 3);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 4950);
+}
+
+void evaluate_dolistBindsVariableInPlace() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= s 0) (dolist (x '(1 2 3)) (= s (+ s x))) "
+                 "(dotimes (i 4) (= s (+ s i))) (+ s x))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  // x keeps the last element after the loop
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 15);
+}
+
+void evaluate_mapCallsFunctionPerElement() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (defun inc (x) (+ x 1)) (defun add (a b) (+ a b)) "
+                 "(reduce add 0 (map inc '(1 2 3))))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 9);
+}
+
+void evaluate_pmapKeepsOrder() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (defun fib (n) (if (< n 2) n (+ (fib (- n 1)) "
+                 "(fib (- n 2))))) (pmap fib '(10 1 2 3 4 5 6 20)))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  pmap_thread_count = 3;
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  pmap_thread_count = 0;
+  TEST_ASSERT(strcmp(stringifyObject(&evaluated),
+                     "(55 1 1 2 3 5 8 6765)") == 0);
+}
+
+// the collections of the threads of pmap must leave the objects of the
+// caller alone, or the collection of the caller skips those that happen to
+// be marked with its epoch. The caller allocates a little more each round so
+// that its epoch meets those of the threads.
+void evaluate_pmapKeepsCallerObjects() {
+  pmap_thread_count = 2;
+  for (int round = 0; round < 48; round++) {
+    struct Env env = (struct Env){};
+    initEnv(&env);
+    char source[512];
+    snprintf(source, sizeof(source),
+             "(= L '(111 222)) (dotimes (k %d) (= junk (cons k nil))) "
+             "(defun heavy (x) (progn (= acc nil) "
+             "(dotimes (j 100) (= acc (cons j acc))) x)) "
+             "(pmap heavy '(1 2)) "
+             "(dotimes (i 2000) (progn (if (eq (%% i 10) 0) (push L i) nil) "
+             "(= junk (cons i (cons i nil))))) "
+             "(= sum 0) (dolist (x L) (= sum (+ sum x))) "
+             "(cons (length L) (cons sum nil))",
+             round);
+    struct ParseState state = (struct ParseState){NULL, 0, NULL};
+    struct ParseResult result = (struct ParseResult){NULL};
+    parse(source, &state, &result);
+    struct AllocatorContext *context = initAllocator();
+    struct Object evaluated = (struct Object){};
+    for (struct ExpressionList *expressions = result.program->expressions;
+         expressions != NULL; expressions = expressions->next) {
+      evaluateExpression(expressions->expression, &evaluated, &env, context);
+    }
+    TEST_ASSERT(strcmp(stringifyObject(&evaluated), "(202 199333)") == 0);
+  }
+  pmap_thread_count = 0;
+}
+
+void evaluate_vectorPushAndRef() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= v (vector 1 2)) (dotimes (i 100) (vector-push v i)) "
+                 "(vector-set v 0 (vector-length v)) (vector-pop v) v)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_VECTOR);
+  TEST_ASSERT(evaluated.vector_value->length == 101);
+  TEST_ASSERT(evaluated.vector_value->items[0]->int_value == 102);
+  TEST_ASSERT(evaluated.vector_value->items[100]->int_value == 98);
+}
+
+// the items of unreachable vectors are freed by the sweep, a vector shared
+// by a copy of its object stays
+void gc_freesVectorsOfUnreachableObjects() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= v (vector 1 2)) (= w v) "
+                 "(dotimes (i 10000) (vector i i)) (vector-push w 3) v)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct AllocatorContext *context = initAllocator();
+  struct Object evaluated = (struct Object){};
+  evaluateExpression(result.program->expressions->expression, &evaluated,
+                     &env, context);
+  TEST_ASSERT(strcmp(stringifyObject(&evaluated), "#(1 2 3)") == 0);
+  int buffer_count = 0;
+  for (struct HeapBuffer *buffer = context->buffers; buffer != NULL;
+       buffer = buffer->next) {
+    buffer_count++;
+  }
+  TEST_ASSERT(buffer_count < 1000);
+}
+
+void evaluate_listHeaderTracksPushAndPop() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source =
+      "(progn (= l '(1 2)) (dotimes (i 100) (push l i)) (pop l) l)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_LIST);
+  struct ListHeader *header = evaluated.list_value->header;
+  TEST_ASSERT(header != NULL);
+  TEST_ASSERT(header->length == 101);
+  TEST_ASSERT(header->tail->car->int_value == 98);
+  TEST_ASSERT(header->tail->cdr->type == OBJ_NIL);
+}
+
+void evaluate_hashMapDeleteKeepsClusters() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  // every deletion shifts entries back, the remaining keys must stay reachable
+  char *source = "(progn (= m (make-map)) (dotimes (i 200) (map-set m i i)) "
+                 "(dotimes (i 100) (map-del m (* i 2))) (= found 0) "
+                 "(dotimes (i 200) (if (map-has m i) (= found (+ found 1)) "
+                 "nil)) '(found (map-size m) (map-get m 199)))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
   struct ParseResult result = (struct ParseResult){NULL};
   struct Object evaluated = (struct Object){};
   parse(source, &state, &result);
   evaluateExpressionWithContext(result.program->expressions->expression,
                                 &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_LIST);
+  struct ConsCell *cell = evaluated.list_value;
+  TEST_ASSERT(cell->car->int_value == 100);
+  cell = cell->cdr->list_value;
+  TEST_ASSERT(cell->car->int_value == 100);
+  cell = cell->cdr->list_value;
+  TEST_ASSERT(cell->car->int_value == 199);
+}
+
+void gc_freesMapsOfUnreachableObjects() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= m (make-map)) (map-set m 1 2) "
+                 "(dotimes (i 10000) (map-set (make-map) i i)) "
+                 "(map-get m 1))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct AllocatorContext *context = initAllocator();
+  struct Object evaluated = (struct Object){};
+  evaluateExpression(result.program->expressions->expression, &evaluated,
+                     &env, context);
   TEST_ASSERT(evaluated.type == OBJ_INTEGER);
   TEST_ASSERT(evaluated.int_value == 2);
+  int buffer_count = 0;
+  for (struct HeapBuffer *buffer = context->buffers; buffer != NULL;
+       buffer = buffer->next) {
+    buffer_count++;
+  }
+  TEST_ASSERT(buffer_count < 1000);
+}
+
+void evaluate_pvecAssocSharesStructure() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= v (pvec)) (dotimes (i 100) (= v (pvec-conj v i))) "
+                 "(= w (pvec-assoc v 99 1000)) '(v w))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_LIST);
+  struct PVector *v = evaluated.list_value->car->pvector_value;
+  struct PVector *w = evaluated.list_value->cdr->list_value->car->pvector_value;
+  TEST_ASSERT(v->count == 100 && w->count == 100);
+  TEST_ASSERT(v->shift == PERSISTENT_BITS);
+  // only the path to index 99 is copied
+  TEST_ASSERT(v->root != w->root);
+  TEST_ASSERT(v->root->children[0] == w->root->children[0]);
+  TEST_ASSERT(v->root->children[3] != w->root->children[3]);
+  TEST_ASSERT(v->root->children[3]->items[3]->int_value == 99);
+  TEST_ASSERT(w->root->children[3]->items[3]->int_value == 1000);
+}
+
+// the nodes left behind by older versions are freed, those shared with the
+// live versions are kept
+void gc_freesNodesOfUnreachableVersions() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= v (pvec)) (= h (make-phash)) "
+                 "(dotimes (i 100) (progn (= v (pvec-conj v i)) "
+                 "(= h (phash-assoc h i i)))) "
+                 "(dotimes (i 20000) (progn (= v (pvec-assoc v (% i 100) i)) "
+                 "(= h (phash-assoc h (% i 100) i)))) "
+                 "(+ (pvec-ref v 99) (phash-get h 77)))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct AllocatorContext *context = initAllocator();
+  struct Object evaluated = (struct Object){};
+  evaluateExpression(result.program->expressions->expression, &evaluated,
+                     &env, context);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 19999 + 19977);
+  int node_count = 0;
+  for (struct HeapBuffer *buffer = context->buffers; buffer != NULL;
+       buffer = buffer->next) {
+    if (buffer->type == BUFFER_PVECTOR_NODE ||
+        buffer->type == BUFFER_PHASH_NODE) {
+      node_count++;
+    }
+  }
+  TEST_ASSERT(node_count > 0);
+  TEST_ASSERT(node_count < 1000);
+}
+
+void evaluate_defunResolvesLocalsToSlots() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(= y 1) (defun f (a b) (progn (= c a) (defun g (x) (+ x c)) "
+                 "(g b))) (defun k () (progn (= r y) (= y 5) (+ r y))) "
+                 "(defun call (h) (h))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  for (struct ExpressionList *expressions = result.program->expressions;
+       expressions != NULL; expressions = expressions->next) {
+    evaluateExpressionWithContext(expressions->expression, &evaluated, &env);
+  }
+  // (progn (= c a) (defun g (x) (+ x c)) (g b))
+  struct ExpressionList *body =
+      result.program->expressions->next->expression->data.symbolic_exp
+          ->expressions->next->next->next->expression->data.symbolic_exp
+          ->expressions;
+  struct ExpressionList *assignment =
+      body->next->expression->data.symbolic_exp->expressions;
+  TEST_ASSERT(assignment->next->expression->data.symbol->slot == 2);
+  TEST_ASSERT(assignment->next->next->expression->data.symbol->slot == 0);
+  struct ExpressionList *nested =
+      body->next->next->expression->data.symbolic_exp->expressions;
+  TEST_ASSERT(nested->next->expression->data.symbol->slot == 3);
+  // the body of g is resolved when g is defined
+  struct ExpressionList *addition = nested->next->next->next->expression->data
+                                        .symbolic_exp->expressions;
+  TEST_ASSERT(addition->next->expression->data.symbol->slot == -1);
+
+  source = "(f 3 4)";
+  state = (struct ParseState){NULL, 0, NULL};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 7);
+  TEST_ASSERT(addition->next->expression->data.symbol->slot == 0);
+  TEST_ASSERT(addition->next->next->expression->data.symbol->slot == -1);
+
+  // y is the global one until k binds its local
+  source = "(k)";
+  state = (struct ParseState){NULL, 0, NULL};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 6);
+
+  // passing a function leaves the caches of the call sites valid
+  unsigned long version = function_binding_version;
+  source = "(call k)";
+  state = (struct ParseState){NULL, 0, NULL};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.int_value == 6);
+  TEST_ASSERT(function_binding_version == version);
+}
+
+void evaluate_quickenedAddDeoptimizes() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(defun add (a b) (+ a b)) (add 1 2) (add 3 4) (add \"x\" \"y\")";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct AllocatorContext *context = initAllocator();
+  struct ExpressionList *expressions = result.program->expressions;
+  struct SymbolicExpNode *add = expressions->expression->data.symbolic_exp
+                                    ->expressions->next->next->next->expression
+                                    ->data.symbolic_exp;
+
+  struct Object evaluated = (struct Object){};
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(add->specialization == SPECIALIZATION_NONE);
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(add->specialization == SPECIALIZATION_ADD_INT);
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(evaluated.int_value == 7);
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(add->specialization == SPECIALIZATION_GENERIC);
+  TEST_ASSERT(strcmp(evaluated.string_value, "xy") == 0);
+}
+
+void evaluate_integerOverflowWraps() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  // the generic builtin, then the quickened operation and the
+  // superinstruction updating i in place
+  char *source = "(defun mul (a b) (* a b)) (mul 2147483647 3) "
+                 "(mul 65536 65536) (= i 2147483646) "
+                 "(dotimes (k 2) (= i (+ i 1))) (progn i)";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct AllocatorContext *context = initAllocator();
+  struct ExpressionList *expressions = result.program->expressions;
+  struct Object evaluated = (struct Object){};
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(evaluated.int_value == 2147483645);
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(evaluated.int_value == 0);
+  for (expressions = expressions->next; expressions != NULL;
+       expressions = expressions->next) {
+    evaluateExpression(expressions->expression, &evaluated, &env, context);
+  }
+  TEST_ASSERT(evaluated.int_value == -2147483647 - 1);
+}
+
+void evaluate_stringHeaderKeepsLength() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= s (+ \"ab\" \"cde\")) (+ s (string-ref s 4)))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_STRING);
+  TEST_ASSERT(stringLength(evaluated.string_value) == 6);
+  TEST_ASSERT(strcmp(evaluated.string_value, "abcdee") == 0);
+  TEST_ASSERT(stringHeader(evaluated.string_value)->hash == 0);
+}
+
+void evaluate_stringBuilderAppendsInPlace() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= sb (make-string-builder)) "
+                 "(dotimes (i 100) (sb-append sb \"ab\")) (sb-append sb 7))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_STRING_BUILDER);
+  TEST_ASSERT(evaluated.builder_value->length == 201);
+  TEST_ASSERT(evaluated.builder_value->capacity == 256);
+  struct Object built = (struct Object){};
+  definedFunctionSbBuild(&evaluated, &built);
+  TEST_ASSERT(stringLength(built.string_value) == 201);
+  TEST_ASSERT(built.string_value[199] == 'b' && built.string_value[200] == '7');
+}
+
+void gc_freesBuildersOfUnreachableObjects() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= sb (make-string-builder)) (sb-append sb \"ab\") "
+                 "(dotimes (i 10000) (sb-append (make-string-builder) i)) "
+                 "(sb-build sb))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct AllocatorContext *context = initAllocator();
+  struct Object evaluated = (struct Object){};
+  evaluateExpression(result.program->expressions->expression, &evaluated,
+                     &env, context);
+  TEST_ASSERT(evaluated.type == OBJ_STRING);
+  TEST_ASSERT(strcmp(evaluated.string_value, "ab") == 0);
+  int builder_count = 0;
+  for (struct HeapBuffer *buffer = context->buffers; buffer != NULL;
+       buffer = buffer->next) {
+    if (buffer->type == BUFFER_STRING_BUILDER) {
+      builder_count++;
+    }
+  }
+  TEST_ASSERT(builder_count > 0);
+  TEST_ASSERT(builder_count < 1000);
+}
+
+void evaluate_charStringsAreShared() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= s \"abca\") (cons (string-ref s 3) "
+                 "(split s \"\")))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  struct ConsCell *cell = evaluated.list_value;
+  TEST_ASSERT(cell->car->string_value == charString('a'));
+  cell = cell->cdr->list_value;
+  TEST_ASSERT(cell->car->string_value == charString('a'));
+  TEST_ASSERT(stringLength(charString('a')) == 1);
+  TEST_ASSERT(strcmp(cell->cdr->list_value->car->string_value, "b") == 0);
+}
+
+void evaluate_splitEmptyStringIntoEmptyString() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(split \"\" \"\")";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  TEST_ASSERT(evaluated.type == OBJ_LIST);
+  struct ConsCell *cell = evaluated.list_value;
+  TEST_ASSERT(cell->car->type == OBJ_STRING);
+  TEST_ASSERT(stringLength(cell->car->string_value) == 0);
+  TEST_ASSERT(strcmp(cell->car->string_value, "") == 0);
+  TEST_ASSERT(cell->cdr->type == OBJ_NIL);
+}
+
+void evaluate_substringSharesWholeString() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(progn (= s \"worsp\") (cons (substring s 0 5) "
+                 "(cons (substring s 1 2) (cons (substring s 1 4) nil))))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  char *literal = result.program->expressions->expression->data.symbolic_exp
+                      ->expressions->next->expression->data.symbolic_exp
+                      ->expressions->next->next->expression->data.literal
+                      ->string_value;
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  struct ConsCell *cell = evaluated.list_value;
+  TEST_ASSERT(cell->car->string_value == literal);
+  cell = cell->cdr->list_value;
+  TEST_ASSERT(cell->car->string_value == charString('o'));
+  cell = cell->cdr->list_value;
+  TEST_ASSERT(strcmp(cell->car->string_value, "ors") == 0);
+  TEST_ASSERT(stringLength(cell->car->string_value) == 3);
+  // short substrings share the storage of equal strings
+  TEST_ASSERT(cell->car->string_value == internString("ors", 3));
+}
+
+void stringKernels_agreeAcrossSimdLevels() {
+  char alphabet[] = "0123456789 \t\n\r,;ab\x80\xff";
+  char str[200];
+  char expected[200];
+  char actual[200];
+  unsigned int seed = 1;
+  for (int n = 0; n < 2000; n++) {
+    int length = n % 150;
+    for (int i = 0; i < length; i++) {
+      seed = seed * 1103515245 + 12345;
+      // mostly digits or mostly letters so that spans cross blocks
+      int range = n % 3 == 0 ? 10 : (int)sizeof(alphabet) - 1;
+      str[i] = alphabet[(seed >> 16) % range];
+    }
+    str[length] = '\0';
+    simd_level = SIMD_SCALAR;
+    int digits = digitSpan(str, length);
+    int compacted = removeSpaces(str, length, expected);
+    uint64_t separated[3];
+    uint64_t delimited[3];
+    uint64_t bitmap[3];
+    delimiterBitmap(str, length, " ,", separated);
+    delimiterBitmap(str, length, "0123", delimited);
+    for (SimdLevel level = SIMD_SSE2; level <= SIMD_AVX2; level++) {
+      simd_level = level;
+      TEST_ASSERT(digitSpan(str, length) == digits);
+      TEST_ASSERT(removeSpaces(str, length, actual) == compacted);
+      TEST_ASSERT(memcmp(actual, expected, compacted) == 0);
+      delimiterBitmap(str, length, " ,", bitmap);
+      TEST_ASSERT(memcmp(bitmap, separated, (length + 63) / 64 * 8) == 0);
+      delimiterBitmap(str, length, "0123", bitmap);
+      TEST_ASSERT(memcmp(bitmap, delimited, (length + 63) / 64 * 8) == 0);
+    }
+  }
+  simd_level = SIMD_AVX2;
+}
+
+void evaluate_internedStringsShareStorage() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(cons \"ab\" (split \"ab cd ab\" \" \"))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  struct Object evaluated = (struct Object){};
+  parse(source, &state, &result);
+  evaluateExpressionWithContext(result.program->expressions->expression,
+                                &evaluated, &env);
+  struct Object *items[4];
+  struct Object *cursor = &evaluated;
+  for (int i = 0; i < 4; i++) {
+    items[i] = cursor->list_value->car;
+    cursor = cursor->list_value->cdr;
+  }
+  TEST_ASSERT(items[0]->string_value == items[1]->string_value);
+  TEST_ASSERT(items[1]->string_value == items[3]->string_value);
+  TEST_ASSERT(stringHeader(items[2]->string_value)->interned);
+  struct Object same = (struct Object){};
+  definedFunctionEq(items[1], items[2], &same);
+  TEST_ASSERT(same.type == OBJ_BOOL && !same.bool_value);
+  TEST_ASSERT(internString("cd", 2) == items[2]->string_value);
+}
+
+void evaluate_jitCompilesHotFunction() {
+  struct Env env = (struct Env){};
+  initEnv(&env);
+  char *source = "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))) "
+                 "(defun greet (s) (+ \"hi \" s)) "
+                 "(fib 20) (greet \"you\") (defun twice (n) (+ n n)) "
+                 "(twice 4) (twice \"x\")";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+  struct AllocatorContext *context = initAllocator();
+  struct ExpressionList *expressions = result.program->expressions;
+  jit_call_threshold = 1;
+
+  struct Object evaluated = (struct Object){};
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  struct Function *fib = evaluated.function_value;
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  struct Function *greet = evaluated.function_value;
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(fib->jit_state == JIT_COMPILED);
+  TEST_ASSERT(evaluated.type == OBJ_INTEGER);
+  TEST_ASSERT(evaluated.int_value == 6765);
+  // strings are left to the interpreter
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(greet->jit_state == JIT_FAILED);
+  TEST_ASSERT(strcmp(evaluated.string_value, "hi you") == 0);
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  struct Function *twice = evaluated.function_value;
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(twice->jit_state == JIT_COMPILED);
+  TEST_ASSERT(evaluated.int_value == 8);
+  // a call with other arguments than integers is interpreted
+  expressions = expressions->next;
+  evaluateExpression(expressions->expression, &evaluated, &env, context);
+  TEST_ASSERT(strcmp(evaluated.string_value, "xx") == 0);
+  jit_call_threshold = 0;
+}
+
+// the names compared by the dispatch chain of evaluateSymbolicExpression,
+// read from its source, are all builtins for the JIT, which would compile a
+// call of a defined function of the same name otherwise
+void isBuiltinName_coversEvaluatorDispatch() {
+  FILE *file = fopen("worsp.c", "r");
+  TEST_ASSERT(file != NULL);
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *source = malloc(size + 1);
+  TEST_ASSERT(fread(source, 1, size, file) == (size_t)size);
+  source[size] = '\0';
+  fclose(file);
+
+  char *start = strstr(source, "\nvoid evaluateSymbolicExpression(");
+  TEST_ASSERT(start != NULL);
+  char *end = strstr(start, "\n}\n");
+  int count = 0;
+  for (char *call = strstr(start, "strcmp("); call != NULL && call < end;
+       call = strstr(call + 1, "strcmp(")) {
+    char *literal = strchr(call, ',') + 1;
+    while (isspace((unsigned char)*literal)) {
+      literal++;
+    }
+    if (*literal != '"') {
+      continue;
+    }
+    char *close = strchr(literal + 1, '"');
+    char name[64];
+    snprintf(name, sizeof(name), "%.*s", (int)(close - literal - 1),
+             literal + 1);
+    if (!isBuiltinName(name)) {
+      fprintf(stderr, "%s is missing from the builtins of the JIT\n", name);
+    }
+    TEST_ASSERT(isBuiltinName(name));
+    count++;
+  }
+  TEST_ASSERT(count > 50);
+  free(source);
+}
+
+void compile_translatesProgram() {
+  char *source = "(defun inc (n) (+ n 1)) (print (inc 1))";
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(source, &state, &result);
+
+  char *translated = NULL;
+  size_t size = 0;
+  FILE *out = open_memstream(&translated, &size);
+  compileProgram(result.program, out);
+  fclose(out);
+  TEST_ASSERT(strstr(translated, "void wsp_function_0(") != NULL);
+  TEST_ASSERT(strstr(translated, "newFunction(params") != NULL);
+  TEST_ASSERT(strstr(translated, "lookupCachedFunction(env, \"inc\"") != NULL);
+  TEST_ASSERT(strstr(translated, "WRAPPING_INT(") != NULL);
+  TEST_ASSERT(strstr(translated, "definedFunctionPrint(") != NULL);
+  TEST_ASSERT(strstr(translated, "int main(int argc, char *argv[]) {") != NULL);
+  free(translated);
 }
 
 int main() {
@@ -1332,6 +2427,17 @@ int main() {
   RUN_TEST(parse_integersSymbolicExpr);
   RUN_TEST(parse_integersList);
 
+  RUN_TEST(readTopLevelForm_splitsForms);
+  RUN_TEST(readTopLevelForm_largeForm);
+  RUN_TEST(expressionQueue_preservesOrder);
+  RUN_TEST(releaseExpression_keepsRetainedNodes);
+  RUN_TEST(parseParallel_keepsOrder);
+  RUN_TEST(scriptCache_roundTrip);
+  RUN_TEST(scriptCache_rejectsCorruptImage);
+  RUN_TEST(optimize_foldsBuiltins);
+  RUN_TEST(optimize_prunesConstantConditions);
+  RUN_TEST(optimize_flattensProgn);
+
   RUN_TEST(evaluate_literalExpressionInt);
   RUN_TEST(evaluate_literalExpressionString);
   RUN_TEST(evaluate_nil);
@@ -1389,7 +2495,39 @@ int main() {
   RUN_TEST(evalute_split);
   RUN_TEST(evaluate_splitWithEmptryChar);
   RUN_TEST(evaluate_listRef);
+  RUN_TEST(evaluate_constantListIsShared);
+  RUN_TEST(evaluate_pushCopiesConstantList);
+  RUN_TEST(evaluate_callSiteCacheFollowsRebinding);
+  RUN_TEST(evaluate_frameBindingShadowsCachedFunction);
+  RUN_TEST(evaluate_defunFrameLayout);
+  RUN_TEST(evaluate_defunResolvesLocalsToSlots);
+  RUN_TEST(evaluate_quickenedAddDeoptimizes);
+  RUN_TEST(evaluate_countedLoopDoesNotAllocate);
+  RUN_TEST(evaluate_dolistBindsVariableInPlace);
+  RUN_TEST(evaluate_mapCallsFunctionPerElement);
+  RUN_TEST(evaluate_pmapKeepsOrder);
+  RUN_TEST(evaluate_pmapKeepsCallerObjects);
+  RUN_TEST(evaluate_vectorPushAndRef);
+  RUN_TEST(gc_freesVectorsOfUnreachableObjects);
+  RUN_TEST(evaluate_listHeaderTracksPushAndPop);
+  RUN_TEST(evaluate_hashMapDeleteKeepsClusters);
+  RUN_TEST(gc_freesMapsOfUnreachableObjects);
+  RUN_TEST(evaluate_pvecAssocSharesStructure);
+  RUN_TEST(gc_freesNodesOfUnreachableVersions);
+  RUN_TEST(evaluate_integerOverflowWraps);
+  RUN_TEST(evaluate_stringHeaderKeepsLength);
+  RUN_TEST(evaluate_stringBuilderAppendsInPlace);
+  RUN_TEST(gc_freesBuildersOfUnreachableObjects);
+  RUN_TEST(evaluate_charStringsAreShared);
+  RUN_TEST(evaluate_splitEmptyStringIntoEmptyString);
+  RUN_TEST(evaluate_substringSharesWholeString);
+  RUN_TEST(stringKernels_agreeAcrossSimdLevels);
+  RUN_TEST(evaluate_internedStringsShareStorage);
+  RUN_TEST(evaluate_jitCompilesHotFunction);
   RUN_TEST(evaluate_progn);
 
+  RUN_TEST(isBuiltinName_coversEvaluatorDispatch);
+  RUN_TEST(compile_translatesProgram);
+
   return 0;
 }
@@ -1,10 +1,473 @@
 #include "worsp.h"
 #include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <math.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// =================================================
+//   strings
+// =================================================
+
+struct StringHeader *stringHeader(char *str) {
+  return (struct StringHeader *)(str - offsetof(struct StringHeader, chars));
+}
+
+// the header is initialized, the characters are left to the caller
+char *allocateString(void *memory, int length) {
+  struct StringHeader *header = memory;
+  header->hash = 0;
+  header->length = length;
+  header->interned = false;
+  header->chars[length] = '\0';
+  return header->chars;
+}
+
+char *newString(const char *chars, int length) {
+  char *str = allocateString(
+      malloc(sizeof(struct StringHeader) + length + 1), length);
+  memcpy(str, chars, length);
+  return str;
+}
+
+int stringLength(char *str) { return stringHeader(str)->length; }
+
+// the size of a string of length characters, rounded up so that strings can
+// be laid out one after another in a single allocation
+size_t stringSize(int length) {
+  size_t alignment = _Alignof(struct StringHeader);
+  return (sizeof(struct StringHeader) + length + 1 + alignment - 1) &
+         ~(alignment - 1);
+}
+
+// FNV-1a of the characters, computed once per string
+uint64_t stringHash(char *str) {
+  struct StringHeader *header = stringHeader(str);
+  if (header->hash != 0) {
+    return header->hash;
+  }
+  uint64_t hash = hashSource(str, header->length);
+  // literals are shared by the threads of pmap
+  if (!parallel_evaluation) {
+    header->hash = hash;
+  }
+  return hash;
+}
+
+// the strings of one character share these, laid out like StringHeader
+struct CharString {
+  uint64_t hash;
+  int length;
+  bool interned;
+  char chars[2];
+};
+_Static_assert(offsetof(struct CharString, chars) ==
+                   offsetof(struct StringHeader, chars),
+               "char strings must be laid out like StringHeader");
+
+#define CHAR_STRING(c) {0, 1, true, {(char)(c), '\0'}}
+#define CHAR_STRINGS_16(c)                                                     \
+  CHAR_STRING(c), CHAR_STRING((c) + 1), CHAR_STRING((c) + 2),                  \
+      CHAR_STRING((c) + 3), CHAR_STRING((c) + 4), CHAR_STRING((c) + 5),        \
+      CHAR_STRING((c) + 6), CHAR_STRING((c) + 7), CHAR_STRING((c) + 8),        \
+      CHAR_STRING((c) + 9), CHAR_STRING((c) + 10), CHAR_STRING((c) + 11),      \
+      CHAR_STRING((c) + 12), CHAR_STRING((c) + 13), CHAR_STRING((c) + 14),     \
+      CHAR_STRING((c) + 15)
+
+struct CharString char_strings[256] = {
+    CHAR_STRINGS_16(0x00), CHAR_STRINGS_16(0x10), CHAR_STRINGS_16(0x20),
+    CHAR_STRINGS_16(0x30), CHAR_STRINGS_16(0x40), CHAR_STRINGS_16(0x50),
+    CHAR_STRINGS_16(0x60), CHAR_STRINGS_16(0x70), CHAR_STRINGS_16(0x80),
+    CHAR_STRINGS_16(0x90), CHAR_STRINGS_16(0xa0), CHAR_STRINGS_16(0xb0),
+    CHAR_STRINGS_16(0xc0), CHAR_STRINGS_16(0xd0), CHAR_STRINGS_16(0xe0),
+    CHAR_STRINGS_16(0xf0),
+};
+
+// string-ref and split return these instead of allocating, they are the
+// interned strings of one character
+char *charString(char c) { return char_strings[(unsigned char)c].chars; }
+
+// open addressing with linear probing like the hash maps, shared by every
+// thread
+struct InternTable {
+  char **strings;
+  // a power of two
+  int capacity;
+  int size;
+};
+
+struct InternTable intern_table = {NULL, 0, 0};
+pthread_mutex_t intern_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void growInternTable() {
+  struct InternTable old = intern_table;
+  intern_table.capacity = old.capacity > 0 ? old.capacity * 2 : 64;
+  intern_table.strings = calloc(intern_table.capacity, sizeof(char *));
+  for (int i = 0; i < old.capacity; i++) {
+    if (old.strings[i] != NULL) {
+      int j = stringHeader(old.strings[i])->hash & (intern_table.capacity - 1);
+      while (intern_table.strings[j] != NULL) {
+        j = (j + 1) & (intern_table.capacity - 1);
+      }
+      intern_table.strings[j] = old.strings[i];
+    }
+  }
+  free(old.strings);
+}
+
+// the canonical string with these characters, created on first use with its
+// hash computed
+char *internString(const char *chars, int length) {
+  if (length == 1) {
+    return charString(chars[0]);
+  }
+  uint64_t hash = hashSource((char *)chars, length);
+  pthread_mutex_lock(&intern_mutex);
+  if (intern_table.size * 4 >= intern_table.capacity * 3) {
+    growInternTable();
+  }
+  int i = hash & (intern_table.capacity - 1);
+  while (intern_table.strings[i] != NULL) {
+    char *str = intern_table.strings[i];
+    if (stringHeader(str)->hash == hash && stringLength(str) == length &&
+        memcmp(str, chars, length) == 0) {
+      pthread_mutex_unlock(&intern_mutex);
+      return str;
+    }
+    i = (i + 1) & (intern_table.capacity - 1);
+  }
+  char *str = newString(chars, length);
+  stringHeader(str)->hash = hash;
+  stringHeader(str)->interned = true;
+  intern_table.strings[i] = str;
+  intern_table.size++;
+  pthread_mutex_unlock(&intern_mutex);
+  return str;
+}
+
+void freeString(char *str) {
+  if (str != NULL && !stringHeader(str)->interned) {
+    free(stringHeader(str));
+  }
+}
+
+void addHeapBuffer(struct AllocatorContext *context, struct HeapBuffer *buffer,
+                   HeapBufferType type);
+
+struct StringBuilder *newStringBuilder(int capacity,
+                                       struct AllocatorContext *context) {
+  struct StringBuilder *builder = malloc(sizeof(struct StringBuilder));
+  addHeapBuffer(context, &builder->buffer, BUFFER_STRING_BUILDER);
+  builder->capacity = capacity > 0 ? capacity : 16;
+  builder->chars = malloc(builder->capacity);
+  builder->length = 0;
+  return builder;
+}
+
+// the buffer grows geometrically, so appending is amortized O(length)
+void appendStringBuilder(struct StringBuilder *builder, const char *chars,
+                         int length) {
+  if (builder->length + length > builder->capacity) {
+    while (builder->length + length > builder->capacity) {
+      builder->capacity *= 2;
+    }
+    builder->chars = realloc(builder->chars, builder->capacity);
+  }
+  memcpy(&builder->chars[builder->length], chars, length);
+  builder->length += length;
+}
+
+// =================================================
+//   string kernels
+// =================================================
+
+// remove-whitespaces, is-int-string, parse-int and split scan strings 16 or
+// 32 bytes at a time with SSE2 or AVX2, blocks that need per-byte work and
+// the tail of the string go through the same scalar loop as other CPUs
+SimdLevel simd_level = SIMD_AVX2;
+
+bool useAvx2() {
+#if defined(__x86_64__)
+  return simd_level >= SIMD_AVX2 && __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+bool useSse2() {
+#if defined(__x86_64__)
+  // every x86-64 CPU has SSE2
+  return simd_level >= SIMD_SSE2;
+#else
+  return false;
+#endif
+}
+
+// the C locale isspace, without the table lookup
+bool isSpaceChar(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+bool isDigitChar(char c) { return c >= '0' && c <= '9'; }
+
+#if defined(__x86_64__)
+// the loops over whole blocks return where the scalar loop continues, which
+// stops right away when a block stopped at a character. The masks are
+// computed in the loops themselves, where the digits are the bytes whose
+// offset from '0' is at most 9 when compared as unsigned, likewise for the
+// whitespaces from '\t' to '\r'.
+__attribute__((target("avx2"))) int digitSpanAvx2(const char *str,
+                                                  int length) {
+  __m256i zero = _mm256_set1_epi8('0');
+  __m256i nine = _mm256_set1_epi8(9);
+  int i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i offset = _mm256_sub_epi8(
+        _mm256_loadu_si256((const __m256i *)&str[i]), zero);
+    uint32_t others = ~(uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(offset, nine), offset));
+    if (others != 0) {
+      return i + __builtin_ctz(others);
+    }
+  }
+  return i;
+}
+
+int digitSpanSse2(const char *str, int length) {
+  __m128i zero = _mm_set1_epi8('0');
+  __m128i nine = _mm_set1_epi8(9);
+  int i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i offset =
+        _mm_sub_epi8(_mm_loadu_si128((const __m128i *)&str[i]), zero);
+    uint32_t others = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+                          _mm_min_epu8(offset, nine), offset)) &
+                      0xffff;
+    if (others != 0) {
+      return i + __builtin_ctz(others);
+    }
+  }
+  return i;
+}
+
+// the indices of the set bits of each byte value, in order, for moving the
+// kept characters of 8 bytes to the front with one shuffle
+uint64_t compaction_shuffles[256];
+pthread_once_t compaction_shuffles_once = PTHREAD_ONCE_INIT;
+
+void initCompactionShuffles() {
+  for (int keep = 0; keep < 256; keep++) {
+    uint64_t shuffle = 0;
+    int count = 0;
+    for (int k = 0; k < 8; k++) {
+      if (keep >> k & 1) {
+        shuffle |= (uint64_t)k << (count++ * 8);
+      }
+    }
+    compaction_shuffles[keep] = shuffle;
+  }
+}
+
+// blocks without whitespace are copied whole, others are compacted 8 bytes
+// at a time. dst never gets ahead of src, so the stores stay within the
+// length of the source.
+__attribute__((target("avx2"))) int
+removeSpacesAvx2(const char *src, int length, char *dst, int *written) {
+  pthread_once(&compaction_shuffles_once, initCompactionShuffles);
+  __m256i tab = _mm256_set1_epi8('\t');
+  __m256i range = _mm256_set1_epi8('\r' - '\t');
+  __m256i space = _mm256_set1_epi8(' ');
+  int i = 0;
+  int j = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)&src[i]);
+    __m256i offset = _mm256_sub_epi8(block, tab);
+    uint32_t spaces = _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(offset, range), offset),
+        _mm256_cmpeq_epi8(block, space)));
+    if (spaces == 0) {
+      _mm256_storeu_si256((__m256i *)&dst[j], block);
+      j += 32;
+      continue;
+    }
+    for (int k = 0; k < 32; k += 8) {
+      int keep = ~spaces >> k & 0xff;
+      __m128i chars = _mm_loadl_epi64((const __m128i *)&src[i + k]);
+      __m128i shuffle =
+          _mm_loadl_epi64((const __m128i *)&compaction_shuffles[keep]);
+      _mm_storel_epi64((__m128i *)&dst[j], _mm_shuffle_epi8(chars, shuffle));
+      j += __builtin_popcount(keep);
+    }
+  }
+  *written = j;
+  return i;
+}
+
+// SSE2 has no byte shuffle, so mixed blocks are copied byte by byte
+int removeSpacesSse2(const char *src, int length, char *dst, int *written) {
+  __m128i tab = _mm_set1_epi8('\t');
+  __m128i range = _mm_set1_epi8('\r' - '\t');
+  __m128i space = _mm_set1_epi8(' ');
+  int i = 0;
+  int j = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)&src[i]);
+    __m128i offset = _mm_sub_epi8(block, tab);
+    uint32_t spaces = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(offset, range), offset),
+                     _mm_cmpeq_epi8(block, space)));
+    if (spaces == 0) {
+      _mm_storeu_si128((__m128i *)&dst[j], block);
+      j += 16;
+      continue;
+    }
+    for (int k = 0; k < 16; k++) {
+      if ((spaces >> k & 1) == 0) {
+        dst[j++] = src[i + k];
+      }
+    }
+  }
+  *written = j;
+  return i;
+}
+
+// a word per 64 bytes, with a bit set for each byte that is a delimiter
+__attribute__((target("avx2"))) int
+delimiterBitmapAvx2(const char *str, int length, const char *delimiters,
+                    int count, uint64_t *bitmap) {
+  __m256i broadcast[SIMD_MAX_DELIMITERS];
+  for (int d = 0; d < count; d++) {
+    broadcast[d] = _mm256_set1_epi8(delimiters[d]);
+  }
+  int i = 0;
+  for (; i + 64 <= length; i += 64) {
+    __m256i low = _mm256_loadu_si256((const __m256i *)&str[i]);
+    __m256i high = _mm256_loadu_si256((const __m256i *)&str[i + 32]);
+    __m256i low_matched = _mm256_setzero_si256();
+    __m256i high_matched = _mm256_setzero_si256();
+    for (int d = 0; d < count; d++) {
+      low_matched = _mm256_or_si256(low_matched,
+                                    _mm256_cmpeq_epi8(low, broadcast[d]));
+      high_matched = _mm256_or_si256(high_matched,
+                                     _mm256_cmpeq_epi8(high, broadcast[d]));
+    }
+    bitmap[i / 64] =
+        (uint32_t)_mm256_movemask_epi8(low_matched) |
+        (uint64_t)(uint32_t)_mm256_movemask_epi8(high_matched) << 32;
+  }
+  return i;
+}
+
+int delimiterBitmapSse2(const char *str, int length, const char *delimiters,
+                        int count, uint64_t *bitmap) {
+  __m128i broadcast[SIMD_MAX_DELIMITERS];
+  for (int d = 0; d < count; d++) {
+    broadcast[d] = _mm_set1_epi8(delimiters[d]);
+  }
+  int i = 0;
+  for (; i + 64 <= length; i += 64) {
+    uint64_t word = 0;
+    for (int part = 0; part < 4; part++) {
+      __m128i block = _mm_loadu_si128((const __m128i *)&str[i + part * 16]);
+      __m128i matched = _mm_setzero_si128();
+      for (int d = 0; d < count; d++) {
+        matched = _mm_or_si128(matched, _mm_cmpeq_epi8(block, broadcast[d]));
+      }
+      word |= (uint64_t)_mm_movemask_epi8(matched) << (part * 16);
+    }
+    bitmap[i / 64] = word;
+  }
+  return i;
+}
+#endif
+
+// the number of leading digits of str
+int digitSpan(const char *str, int length) {
+  int i = 0;
+#if defined(__x86_64__)
+  if (useAvx2()) {
+    i = digitSpanAvx2(str, length);
+  } else if (useSse2()) {
+    i = digitSpanSse2(str, length);
+  }
+#endif
+  while (i < length && isDigitChar(str[i])) {
+    i++;
+  }
+  return i;
+}
+
+// copies the characters of src other than whitespaces to dst, which has room
+// for length characters, and returns how many were copied
+int removeSpaces(const char *src, int length, char *dst) {
+  int i = 0;
+  int j = 0;
+#if defined(__x86_64__)
+  if (useAvx2()) {
+    i = removeSpacesAvx2(src, length, dst, &j);
+  } else if (useSse2()) {
+    i = removeSpacesSse2(src, length, dst, &j);
+  }
+#endif
+  for (; i < length; i++) {
+    if (!isSpaceChar(src[i])) {
+      dst[j++] = src[i];
+    }
+  }
+  return j;
+}
+
+// sets the bit of bitmap, which has a word per 64 characters, for each
+// character of str that is one of the delimiters. The bits past the end are
+// set too, so that a token always ends at a set bit. Only sets of up to
+// SIMD_MAX_DELIMITERS are compared with SIMD, larger ones go through a table.
+void delimiterBitmap(const char *str, int length, const char *delimiters,
+                     uint64_t *bitmap) {
+  int count = strlen(delimiters);
+  int i = 0;
+#if defined(__x86_64__)
+  if (count <= SIMD_MAX_DELIMITERS && useAvx2()) {
+    i = delimiterBitmapAvx2(str, length, delimiters, count, bitmap);
+  } else if (count <= SIMD_MAX_DELIMITERS && useSse2()) {
+    i = delimiterBitmapSse2(str, length, delimiters, count, bitmap);
+  }
+#endif
+  bool is_delimiter[256] = {false};
+  for (int d = 0; d < count; d++) {
+    is_delimiter[(unsigned char)delimiters[d]] = true;
+  }
+  for (; i < (length + 63) / 64 * 64; i += 64) {
+    uint64_t word = 0;
+    for (int k = 0; k < 64; k++) {
+      if (i + k >= length || is_delimiter[(unsigned char)str[i + k]]) {
+        word |= (uint64_t)1 << k;
+      }
+    }
+    bitmap[i / 64] = word;
+  }
+}
+
+// the first index from start on whose bit equals set, or length
+int nextBitmapIndex(const uint64_t *bitmap, int start, int length, bool set) {
+  for (int i = start; i < length; i = (i / 64 + 1) * 64) {
+    uint64_t word = set ? bitmap[i / 64] : ~bitmap[i / 64];
+    word &= ~(uint64_t)0 << (i % 64);
+    if (word != 0) {
+      int index = i / 64 * 64 + __builtin_ctzll(word);
+      return index < length ? index : length;
+    }
+  }
+  return length;
+}
 
 // =================================================
 //   tokenizer
@@ -15,6 +478,24 @@ int isop(int ch) {
          ch == '|' || ch == '&' || ch == '=' || ch == '<' || ch == '>';
 }
 
+void *parseAlloc(struct ParseState *state, size_t size) {
+  struct ParseArena *arena = state->arena;
+  if (arena == NULL) {
+    return malloc(size);
+  }
+  size = (size + 15) & ~(size_t)15;
+  if (arena->block == NULL || arena->used + size > arena->capacity) {
+    // the AST lives as long as the program, so full blocks are never freed
+    arena->capacity =
+        size > PARSE_ARENA_BLOCK_SIZE ? size : PARSE_ARENA_BLOCK_SIZE;
+    arena->block = malloc(arena->capacity);
+    arena->used = 0;
+  }
+  void *ptr = arena->block + arena->used;
+  arena->used += size;
+  return ptr;
+}
+
 int match(struct ParseState *state, TokenKind kind) {
   return state->token->kind == kind ? 1 : 0;
 }
@@ -51,17 +532,14 @@ void next(char *source, struct ParseState *state) {
     }
     int length = state->pos - start;
 
-    char *str = malloc(length + 1);
-    strncpy(str, &source[start], length);
-    str[length] = '\0';
-
-    if (strcmp(str, "true") == 0) {
+    if (length == 4 && strncmp(&source[start], "true", 4) == 0) {
       new->kind = TK_TRUE;
-      free(str);
-    } else if (strcmp(str, "false") == 0) {
+    } else if (length == 5 && strncmp(&source[start], "false", 5) == 0) {
       new->kind = TK_FALSE;
-      free(str);
     } else {
+      char *str = parseAlloc(state, length + 1);
+      strncpy(str, &source[start], length);
+      str[length] = '\0';
       new->kind = TK_SYMBOL;
       new->str = str;
     }
@@ -90,9 +568,13 @@ void next(char *source, struct ParseState *state) {
     }
     int length = state->pos - start;
     new->kind = TK_STRING;
-    new->str = malloc(length + 1);
-    strncpy(new->str, &source[start], length);
-    new->str[length] = '\0';
+    if (length <= INTERN_MAX_LENGTH) {
+      new->str = internString(&source[start], length);
+    } else {
+      new->str = allocateString(
+          parseAlloc(state, sizeof(struct StringHeader) + length + 1), length);
+      memcpy(new->str, &source[start], length);
+    }
     if (source[state->pos] == '"') {
       state->pos++; // Skip quote
     }
@@ -101,6 +583,7 @@ void next(char *source, struct ParseState *state) {
     while (source[state->pos] != '\n' && source[state->pos] != '\0') {
       state->pos++;
     }
+    free(new);
     next(source, state);
     return;
   } else {
@@ -108,11 +591,13 @@ void next(char *source, struct ParseState *state) {
     exit(1);
   }
 
-  if (current == NULL) {
-    state->token = new;
-    return;
+  // the parser only looks at the current token, so the previous one can be
+  // released as soon as it is consumed
+  new->next = NULL;
+  if (current != NULL) {
+    free(current);
   }
-  state->token = current->next = new;
+  state->token = new;
 }
 
 // =================================================
@@ -136,37 +621,15 @@ void next(char *source, struct ParseState *state) {
 //     <boolean_literal>  ::= 'true' | 'false'
 // =================================================
 
-void appendExpressionToListExpression(struct ListNode *listNode,
-                                      struct ExpressionNode *expression) {
-  struct ExpressionList *expressions = malloc(sizeof(struct ExpressionList));
-  expressions->expression = expression;
-  expressions->next = NULL;
-  if (listNode->expressions == NULL) {
-    listNode->expressions = expressions;
-    return;
-  }
-  struct ExpressionList *current = listNode->expressions;
-  while (current->next != NULL) {
-    current = current->next;
-  }
-  current->next = expressions;
-}
-
-void appendExpressionToSymbolicExpression(
-    struct SymbolicExpNode *symbolicExpNode,
-    struct ExpressionNode *expression) {
-  struct ExpressionList *expressions = malloc(sizeof(struct ExpressionList));
+struct ExpressionList **appendExpression(struct ParseState *state,
+                                         struct ExpressionList **tail,
+                                         struct ExpressionNode *expression) {
+  struct ExpressionList *expressions =
+      parseAlloc(state, sizeof(struct ExpressionList));
   expressions->expression = expression;
   expressions->next = NULL;
-  if (symbolicExpNode->expressions == NULL) {
-    symbolicExpNode->expressions = expressions;
-    return;
-  }
-  struct ExpressionList *current = symbolicExpNode->expressions;
-  while (current->next != NULL) {
-    current = current->next;
-  }
-  current->next = expressions;
+  *tail = expressions;
+  return &expressions->next;
 }
 
 void parseExpression(char *source, struct ParseState *state,
@@ -174,35 +637,42 @@ void parseExpression(char *source, struct ParseState *state,
 
 void parseSymbolicExpression(char *source, struct ParseState *state,
                              struct ExpressionNode *expression) {
-  struct SymbolicExpNode *symbolicExp = malloc(sizeof(struct SymbolicExpNode));
+  struct SymbolicExpNode *symbolicExp =
+      parseAlloc(state, sizeof(struct SymbolicExpNode));
 
   expression->type = EXP_SYMBOLIC_EXP;
   expression->data.symbolic_exp = symbolicExp;
   expression->data.symbolic_exp->expressions = NULL;
+  expression->data.symbolic_exp->specialization = SPECIALIZATION_NONE;
+  expression->data.symbolic_exp->cached_function = NULL;
+  expression->data.symbolic_exp->cached_version = 0;
+  struct ExpressionList **tail = &symbolicExp->expressions;
   next(source, state); // eat '('
   while (!match(state, TK_RPAREN)) {
     struct ExpressionNode *expressionItem =
-        malloc(sizeof(struct ExpressionNode));
+        parseAlloc(state, sizeof(struct ExpressionNode));
     parseExpression(source, state, expressionItem);
-    appendExpressionToSymbolicExpression(symbolicExp, expressionItem);
+    tail = appendExpression(state, tail, expressionItem);
   }
   next(source, state); // eat ')'
 }
 
 void parseListExpression(char *source, struct ParseState *state,
                          struct ExpressionNode *expression) {
-  struct ListNode *list = malloc(sizeof(struct ListNode));
+  struct ListNode *list = parseAlloc(state, sizeof(struct ListNode));
 
   expression->type = EXP_LIST;
   expression->data.list = list;
   expression->data.list->expressions = NULL;
+  expression->data.list->constant = NULL;
+  struct ExpressionList **tail = &list->expressions;
   next(source, state); // eat quote
   next(source, state); // eat '('
   while (!match(state, TK_RPAREN)) {
     struct ExpressionNode *expressionItem =
-        malloc(sizeof(struct ExpressionNode));
+        parseAlloc(state, sizeof(struct ExpressionNode));
     parseExpression(source, state, expressionItem);
-    appendExpressionToListExpression(list, expressionItem);
+    tail = appendExpression(state, tail, expressionItem);
   }
   next(source, state); // eat ')'
 }
@@ -210,8 +680,9 @@ void parseListExpression(char *source, struct ParseState *state,
 void parseSymbolExpression(char *source, struct ParseState *state,
                            struct ExpressionNode *expression) {
   expression->type = EXP_SYMBOL;
-  expression->data.symbol = malloc(sizeof(struct SymbolNode));
+  expression->data.symbol = parseAlloc(state, sizeof(struct SymbolNode));
   expression->data.symbol->symbol_name = state->token->str;
+  expression->data.symbol->slot = -1;
   next(source, state);
 }
 
@@ -219,25 +690,25 @@ void parseLiteralExpression(char *source, struct ParseState *state,
                             struct ExpressionNode *expression) {
   if (match(state, TK_DIGIT)) {
     expression->type = EXP_LITERAL;
-    expression->data.literal = malloc(sizeof(struct LiteralNode));
+    expression->data.literal = parseAlloc(state, sizeof(struct LiteralNode));
     expression->data.literal->type = LIT_INTERGER;
     expression->data.literal->int_value = state->token->val;
     next(source, state);
   } else if (match(state, TK_STRING)) {
     expression->type = EXP_LITERAL;
-    expression->data.literal = malloc(sizeof(struct LiteralNode));
+    expression->data.literal = parseAlloc(state, sizeof(struct LiteralNode));
     expression->data.literal->type = LIT_STRING;
     expression->data.literal->string_value = state->token->str;
     next(source, state);
   } else if (match(state, TK_TRUE)) {
     expression->type = EXP_LITERAL;
-    expression->data.literal = malloc(sizeof(struct LiteralNode));
+    expression->data.literal = parseAlloc(state, sizeof(struct LiteralNode));
     expression->data.literal->type = LIT_BOOLEAN;
     expression->data.literal->boolean_value = true;
     next(source, state);
   } else if (match(state, TK_FALSE)) {
     expression->type = EXP_LITERAL;
-    expression->data.literal = malloc(sizeof(struct LiteralNode));
+    expression->data.literal = parseAlloc(state, sizeof(struct LiteralNode));
     expression->data.literal->type = LIT_BOOLEAN;
     expression->data.literal->boolean_value = false;
     next(source, state);
@@ -249,6 +720,7 @@ void parseLiteralExpression(char *source, struct ParseState *state,
 
 void parseExpression(char *source, struct ParseState *state,
                      struct ExpressionNode *expression) {
+  expression->retained = false;
   if (match(state, TK_LPAREN)) {
     parseSymbolicExpression(source, state, expression);
   } else if (match(state, TK_QUOTE)) {
@@ -264,35 +736,21 @@ void parseExpression(char *source, struct ParseState *state,
   }
 }
 
-void appendExpressionToProgram(struct ProgramNode *program,
-                               struct ExpressionNode *expression) {
-  struct ExpressionList *expressions = malloc(sizeof(struct ExpressionList));
-  expressions->expression = expression;
-  expressions->next = NULL;
-  if (program->expressions == NULL) {
-    program->expressions = expressions;
-    return;
-  }
-  struct ExpressionList *current = program->expressions;
-  while (current->next != NULL) {
-    current = current->next;
-  }
-  current->next = expressions;
-}
-
 void parseProgram(char *source, struct ParseState *state,
                   struct ParseResult *result) {
   // Set first token
   next(source, state);
-  struct ProgramNode *program = malloc(sizeof(struct ProgramNode));
+  struct ProgramNode *program = parseAlloc(state, sizeof(struct ProgramNode));
   program->expressions = NULL;
 
   result->program = program;
 
+  struct ExpressionList **tail = &program->expressions;
   while (!match(state, TK_EOF)) {
-    struct ExpressionNode *expression = malloc(sizeof(struct ExpressionNode));
+    struct ExpressionNode *expression =
+        parseAlloc(state, sizeof(struct ExpressionNode));
     parseExpression(source, state, expression);
-    appendExpressionToProgram(program, expression);
+    tail = appendExpression(state, tail, expression);
   }
 }
 
@@ -301,774 +759,4468 @@ void parse(char *source, struct ParseState *state, struct ParseResult *result) {
 }
 
 // =================================================
-//   garbage collector
+//   stream reader
+//     Splits a FILE* into top-level forms without reading the whole source
+//     into memory. Only the form being read is buffered, so memory usage is
+//     bounded by the largest top-level form instead of the program size.
 // =================================================
 
-void initializeObjectStack(struct ObjectStack *stack) { stack->top = -1; }
-
-int isFullObjectStack(struct ObjectStack *stack) {
-  return stack->top == OBJECT_NUMBER;
+void initializeFormScanner(struct FormScanner *scanner) {
+  scanner->depth = 0;
+  scanner->started = false;
+  scanner->in_string = false;
+  scanner->in_comment = false;
 }
 
-int isEmptyObjectStack(struct ObjectStack *stack) { return stack->top == -1; }
-
-void pushObjectStack(struct ObjectStack *stack, struct Object *obj) {
-  if (isFullObjectStack(stack)) {
-    printf("Object stack is full.\n");
-    exit(1);
+enum FormScanResult scanFormChar(struct FormScanner *scanner, int ch) {
+  if (scanner->in_string) {
+    if (ch == '"') {
+      scanner->in_string = false;
+      if (scanner->depth == 0) {
+        return SCAN_DONE;
+      }
+    }
+    return SCAN_CONTINUE;
   }
-  stack->top++;
-  stack->objects[stack->top] = obj;
-}
-
-struct Object *popObjectStack(struct ObjectStack *stack) {
-  if (isEmptyObjectStack(stack)) {
-    printf("Object stack is empty.\n");
-    exit(1);
+  if (scanner->in_comment) {
+    if (ch == '\n') {
+      scanner->in_comment = false;
+    }
+    return SCAN_CONTINUE;
   }
-  struct Object *obj = stack->objects[stack->top];
-  stack->top--;
-  return obj;
+  // a top-level atom ends at the first delimiter
+  if (scanner->depth == 0 && scanner->started &&
+      (isspace(ch) || ch == '(' || ch == ')' || ch == '\'' || ch == '"' ||
+       ch == ';')) {
+    return SCAN_DONE_BEFORE;
+  }
+  if (ch == '"') {
+    scanner->in_string = true;
+    scanner->started = true;
+  } else if (ch == ';') {
+    scanner->in_comment = true;
+  } else if (ch == '(') {
+    scanner->depth++;
+    scanner->started = true;
+  } else if (ch == ')') {
+    scanner->depth--;
+    if (scanner->depth <= 0) {
+      return SCAN_DONE;
+    }
+  } else if (ch != '\'' && !isspace(ch)) {
+    scanner->started = true;
+  }
+  return SCAN_CONTINUE;
 }
 
-struct AllocatorContext *initAllocator() {
-  struct AllocatorContext *context = malloc(sizeof(struct AllocatorContext));
-
-  context->memory_pool = (struct Object *)malloc(MEMORY_SIZE);
-  for (unsigned long i = 0; i < FREE_BITMAP_SIZE; ++i) {
-    context->free_bitmap[i] = 0;
+int scanTopLevelForm(char *source, int pos) {
+  struct FormScanner scanner;
+  initializeFormScanner(&scanner);
+  while (source[pos] != '\0') {
+    enum FormScanResult scanned = scanFormChar(&scanner, source[pos]);
+    if (scanned == SCAN_DONE_BEFORE) {
+      break;
+    }
+    pos++;
+    if (scanned == SCAN_DONE) {
+      break;
+    }
   }
+  return pos;
+}
 
-  context->gc_less_mode = 0;
-
-  struct ObjectStack *stack = malloc(sizeof(struct ObjectStack));
-  initializeObjectStack(stack);
-  context->stack = stack;
-
-  return context;
+struct StreamReader *initStreamReader(FILE *file) {
+  struct StreamReader *reader = malloc(sizeof(struct StreamReader));
+  reader->file = file;
+  reader->buffer_pos = 0;
+  reader->buffer_len = 0;
+  reader->form_capacity = STREAM_BUFFER_SIZE;
+  reader->form = malloc(reader->form_capacity);
+  reader->form_len = 0;
+  reader->form[0] = '\0';
+  return reader;
 }
 
-void freeObject(struct AllocatorContext *context, struct Object *object) {
-  int index = object - context->memory_pool;
-  context->free_bitmap[index] = 0;
+void freeStreamReader(struct StreamReader *reader) {
+  free(reader->form);
+  free(reader);
 }
 
-void sweep(struct AllocatorContext *context) {
-  for (unsigned long i = 0; i < FREE_BITMAP_SIZE; ++i) {
-    if (context->free_bitmap[i] == 1) {
-      struct Object *obj = &context->memory_pool[i];
-      if (obj->marked) {
-        obj->marked = false;
-      } else {
-        freeObject(context, obj);
-      }
+int peekStreamChar(struct StreamReader *reader) {
+  if (reader->buffer_pos == reader->buffer_len) {
+    reader->buffer_len =
+        fread(reader->buffer, 1, STREAM_BUFFER_SIZE, reader->file);
+    reader->buffer_pos = 0;
+    if (reader->buffer_len == 0) {
+      return EOF;
     }
   }
+  return (unsigned char)reader->buffer[reader->buffer_pos];
 }
 
-int isLastConsCell(struct ConsCell *conscell) {
-  return conscell->cdr->type == OBJ_NIL;
+int readStreamChar(struct StreamReader *reader) {
+  int ch = peekStreamChar(reader);
+  if (ch != EOF) {
+    reader->buffer_pos++;
+  }
+  return ch;
 }
 
-void mark(struct Object *obj) {
-  if (obj->marked) {
-    return;
+void appendFormChar(struct StreamReader *reader, char ch) {
+  if (reader->form_len + 1 >= reader->form_capacity) {
+    reader->form_capacity *= 2;
+    reader->form = realloc(reader->form, reader->form_capacity);
   }
-  obj->marked = true;
-  if (obj->type == OBJ_LIST) {
-    struct Object *current = obj;
-    while (1) {
-      mark(current);
-      // evaluating list object can be nil
-      if (current->list_value == NULL) {
-        break;
-      }
-      mark(current->list_value->car);
-      if (isLastConsCell(current->list_value)) {
-        break;
+  reader->form[reader->form_len++] = ch;
+  reader->form[reader->form_len] = '\0';
+}
+
+int readTopLevelForm(struct StreamReader *reader) {
+  reader->form_len = 0;
+  reader->form[0] = '\0';
+
+  // Skip whitespaces and comments between forms
+  while (1) {
+    int ch = peekStreamChar(reader);
+    if (ch == EOF) {
+      return 0;
+    }
+    if (isspace(ch)) {
+      readStreamChar(reader);
+    } else if (ch == ';') {
+      while (ch != '\n' && ch != EOF) {
+        ch = readStreamChar(reader);
       }
-      current = current->list_value->cdr;
+    } else {
+      break;
     }
   }
-}
 
-void markAll(struct Env *env, struct AllocatorContext *context) {
-  // mark objects in stack
-  for (int i = 0; i <= context->stack->top; i++) {
-    struct Object *obj = context->stack->objects[i];
-    mark(obj);
+  struct FormScanner scanner;
+  initializeFormScanner(&scanner);
+  while (1) {
+    int ch = peekStreamChar(reader);
+    if (ch == EOF) {
+      break;
+    }
+    enum FormScanResult scanned = scanFormChar(&scanner, ch);
+    if (scanned == SCAN_DONE_BEFORE) {
+      break;
+    }
+    appendFormChar(reader, readStreamChar(reader));
+    if (scanned == SCAN_DONE) {
+      break;
+    }
   }
 
-  int i = 0;
-  while (env->bindings[i].symbol_name != NULL) {
-    struct Object *obj = env->bindings[i].value;
-    mark(obj);
-    i++;
-  }
-  if (env->parent != NULL) {
-    markAll(env->parent, context);
-  }
+  return reader->form_len > 0;
 }
 
-void gc(struct AllocatorContext *context, struct Env *env) {
-  markAll(env, context);
-  sweep(context);
+// =================================================
+//   parallel parser
+//     Cuts the source at top-level form boundaries into one chunk per thread,
+//     parses the chunks concurrently into per-thread arenas and links the
+//     resulting expression lists back together in source order.
+// =================================================
+
+struct ParseChunk {
+  char *source;
+  int start;
+  int end;
+  struct ProgramNode *program;
+};
+
+void *runParseChunk(void *arg) {
+  struct ParseChunk *chunk = arg;
+  int length = chunk->end - chunk->start;
+
+  // the tokenizer stops at NUL, so every chunk gets its own copy
+  char *text = malloc(length + 1);
+  memcpy(text, &chunk->source[chunk->start], length);
+  text[length] = '\0';
+
+  struct ParseArena *arena = malloc(sizeof(struct ParseArena));
+  *arena = (struct ParseArena){NULL, 0, 0};
+  struct ParseState state = (struct ParseState){NULL, 0, arena};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(text, &state, &result);
+  chunk->program = result.program;
+
+  free(state.token);
+  free(text);
+  return NULL;
 }
 
-struct Object *allocate(struct AllocatorContext *context, struct Env *env) {
-  size_t object_size = sizeof(struct Object);
-  if (context->gc_less_mode) {
-    return malloc(object_size);
+void parseParallel(char *source, int thread_count, struct ParseResult *result) {
+  if (thread_count < 1) {
+    thread_count = 1;
   }
+  struct ParseChunk *chunks = malloc(sizeof(struct ParseChunk) * thread_count);
+  pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
 
-  for (unsigned long i = 0; i < FREE_BITMAP_SIZE; ++i) {
-    if (context->free_bitmap[i] == 0) {
-      context->free_bitmap[i] = 1; // Mark the block as used
-      return &context->memory_pool[i];
+  int length = strlen(source);
+  int target = length / thread_count;
+  int pos = 0;
+  for (int i = 0; i < thread_count; i++) {
+    chunks[i].source = source;
+    chunks[i].start = pos;
+    if (i == thread_count - 1) {
+      pos = length;
+    } else {
+      while (pos < length && pos - chunks[i].start < target) {
+        pos = scanTopLevelForm(source, pos);
+      }
     }
+    chunks[i].end = pos;
+    chunks[i].program = NULL;
   }
 
-  gc(context, env);
+  for (int i = 0; i < thread_count; i++) {
+    if (pthread_create(&threads[i], NULL, runParseChunk, &chunks[i]) != 0) {
+      printf("Failed to start parser thread.\n");
+      exit(1);
+    }
+  }
 
-  for (unsigned long i = 0; i < FREE_BITMAP_SIZE; ++i) {
-    if (context->free_bitmap[i] == 0) {
-      context->free_bitmap[i] = 1; // Mark the block as used
-      return &context->memory_pool[i];
+  struct ProgramNode *program = malloc(sizeof(struct ProgramNode));
+  program->expressions = NULL;
+  struct ExpressionList **tail = &program->expressions;
+  for (int i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+    *tail = chunks[i].program->expressions;
+    while (*tail != NULL) {
+      tail = &(*tail)->next;
     }
   }
+  result->program = program;
 
-  fprintf(stderr, "Out of Memory\n");
-  exit(1);
+  free(chunks);
+  free(threads);
 }
 
 // =================================================
-//   defined functions
+//   script cache
+//     A parsed program is written as a flat image of its AST structs where
+//     every pointer holds an offset from the start of the file and equal
+//     strings are stored once. Loading is a single mmap followed by one walk
+//     over the nodes that checks every offset and adds the mapping address to
+//     it. The image is not compact, each node takes as much room as in memory
+//     so that it is used in place, which makes it about 13 times the size of
+//     the source.
+//
+//     | header | AST nodes and interned strings |
 // =================================================
 
-bool boolVal(struct Object *obj) {
-  if (obj->type == OBJ_BOOL) {
-    return obj->bool_value;
-  } else if (obj->type == OBJ_NIL) {
-    return false;
-  } else {
-    return true;
+uint64_t hashSource(char *source, size_t length) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)source[i];
+    hash *= 1099511628211ULL;
   }
+  return hash;
 }
 
-int eq(struct Object *op1, struct Object *op2) {
-  if (op1->type != op2->type) {
-    return 0;
-  } else {
-    if (op1->type == OBJ_INTEGER) {
-      return op1->int_value == op2->int_value;
-    } else if (op1->type == OBJ_STRING) {
-      return strcmp(op1->string_value, op2->string_value) == 0;
-    } else if (op1->type == OBJ_BOOL) {
-      return op1->bool_value == op2->bool_value;
-    } else if (op1->type == OBJ_LIST) {
-      return op1->list_value == op2->list_value;
-    } else if (op1->type == OBJ_NIL) {
-      return 1;
-    }
+uint64_t scriptCacheLayout() {
+  // changes whenever the AST structs change shape
+  return sizeof(void *) | sizeof(struct ExpressionNode) << 8 |
+         sizeof(struct ExpressionList) << 16 | sizeof(struct LiteralNode) << 24 |
+         (uint64_t)sizeof(struct SymbolNode) << 32 |
+         (uint64_t)sizeof(struct SymbolicExpNode) << 40 |
+         (uint64_t)sizeof(struct ListNode) << 48 |
+         (uint64_t)offsetof(struct StringHeader, chars) << 56;
+}
+
+struct CacheString {
+  char *str;
+  uint64_t offset;
+};
+
+struct CacheWriter {
+  char *data;
+  size_t size;
+  size_t capacity;
+  // open addressing table of interned strings
+  struct CacheString *strings;
+  size_t string_capacity;
+  size_t string_count;
+};
+
+uint64_t reserveCache(struct CacheWriter *writer, size_t size) {
+  size_t offset = (writer->size + 7) & ~(size_t)7;
+  while (offset + size > writer->capacity) {
+    writer->capacity *= 2;
+    writer->data = realloc(writer->data, writer->capacity);
   }
-  return 0;
+  memset(&writer->data[writer->size], 0, offset + size - writer->size);
+  writer->size = offset + size;
+  return offset;
 }
 
-char *stringifyObject(struct Object *obj) {
-  if (obj->type == OBJ_INTEGER) {
-    if (obj->int_value == 0) {
-      char *str = (char *)malloc(2 * sizeof(char));
-      strncpy(str, "0", 2);
-      return str;
-    }
-    int digits = (int)log10(obj->int_value) + 1;
-    char *str = (char *)malloc((digits + 1) * sizeof(char));
-    sprintf(str, "%d", obj->int_value);
-    return str;
-  } else if (obj->type == OBJ_STRING) {
-    char *str = (char *)malloc((strlen(obj->string_value) + 1) * sizeof(char));
-    strncpy(str, obj->string_value, strlen(obj->string_value) + 1);
-    return str;
-  } else if (obj->type == OBJ_BOOL) {
-    char *str = (char *)malloc(1 * sizeof(char));
-    if (obj->bool_value) {
-      strncpy(str, "T", 2);
-    } else {
-      strncpy(str, "F", 2);
-    }
-    return str;
-  } else if (obj->type == OBJ_LIST) {
-    int length = 2; // '(' and ')'
-    char *str = (char *)malloc(length + 1 * sizeof(char));
-    memset(str, 0, length + 1);
-    str[0] = '(';
-    struct ConsCell *current = obj->list_value;
-    while (1) {
-      char *serialized = stringifyObject(current->car);
-      length += strlen(serialized);
-      str = realloc(str, length + 1);
-      strncat(str, serialized, strlen(serialized));
-      if (isLastConsCell(current)) {
-        break;
-      } else {
-        length += 1; // " "
-        str = realloc(str, length + 1);
-        strncat(str, " ", 1);
+void setCachePointer(struct CacheWriter *writer, uint64_t field,
+                     uint64_t target) {
+  // offset 0 is the header, so NULL pointers stay 0
+  memcpy(&writer->data[field], &target, sizeof(uint64_t));
+}
+
+uint64_t writeCacheString(struct CacheWriter *writer, char *str) {
+  if (str == NULL) {
+    return 0;
+  }
+  if (writer->string_count * 2 >= writer->string_capacity) {
+    struct CacheString *old = writer->strings;
+    size_t old_capacity = writer->string_capacity;
+    writer->string_capacity *= 2;
+    writer->strings =
+        calloc(writer->string_capacity, sizeof(struct CacheString));
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old[i].str != NULL) {
+        size_t j = hashSource(old[i].str, strlen(old[i].str)) &
+                   (writer->string_capacity - 1);
+        while (writer->strings[j].str != NULL) {
+          j = (j + 1) & (writer->string_capacity - 1);
+        }
+        writer->strings[j] = old[i];
       }
-      current = current->cdr->list_value;
     }
-    str[length - 1] = ')';
-    str[length] = '\0';
-    return str;
-  } else if (obj->type == OBJ_NIL) {
-    char *str = (char *)malloc(4 * sizeof(char));
-    strncpy(str, "nil", 4);
-    return str;
-  } else if (obj->type == OBJ_FUNCTION) {
-    char *str = (char *)malloc(9 * sizeof(char));
-    strncpy(str, "<function>", 10);
-    return str;
-  } else {
-    printf("Unexpected object type: %d\n", obj->type);
-    exit(1);
+    free(old);
   }
-}
 
-void definedFunctionAdd(struct Object *op1, struct Object *op2,
-                        struct Object *evaluated) {
-  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
-    evaluated->type = OBJ_INTEGER;
-    evaluated->int_value = op1->int_value + op2->int_value;
-  } else if (op1->type == OBJ_STRING && op2->type == OBJ_STRING) {
-    evaluated->type = OBJ_STRING;
-    evaluated->string_value =
-        malloc((strlen(op1->string_value) + strlen(op2->string_value) + 1) *
-               sizeof(char));
-    strncpy(evaluated->string_value, op1->string_value,
-            strlen(op1->string_value) + 1);
-    strcat(evaluated->string_value, op2->string_value);
-  } else {
-    printf("Type error: operands for + must be integers or strings.\n");
-    exit(1);
+  size_t length = strlen(str);
+  size_t i = hashSource(str, length) & (writer->string_capacity - 1);
+  while (writer->strings[i].str != NULL) {
+    if (strcmp(writer->strings[i].str, str) == 0) {
+      return writer->strings[i].offset;
+    }
+    i = (i + 1) & (writer->string_capacity - 1);
   }
+  // stored with a header, so that string literals can be used as they are
+  uint64_t offset = reserveCache(writer, sizeof(struct StringHeader) + length + 1);
+  allocateString(&writer->data[offset], length);
+  offset += offsetof(struct StringHeader, chars);
+  memcpy(&writer->data[offset], str, length);
+  writer->strings[i] = (struct CacheString){str, offset};
+  writer->string_count++;
+  return offset;
 }
 
-void definedFunctionSub(struct Object *op1, struct Object *op2,
-                        struct Object *evaluated) {
-  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
-    evaluated->type = OBJ_INTEGER;
-    evaluated->int_value = op1->int_value - op2->int_value;
-  } else {
-    printf("Type error: operands for - must be integers.\n");
-    exit(1);
-  }
-}
+uint64_t writeCacheExpressionList(struct CacheWriter *writer,
+                                  struct ExpressionList *expressions);
 
-void definedFunctionMul(struct Object *op1, struct Object *op2,
-                        struct Object *evaluated) {
-  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
-    evaluated->type = OBJ_INTEGER;
-    evaluated->int_value = op1->int_value * op2->int_value;
-  } else {
-    printf("Type error: operands for * must be integers.\n");
-    exit(1);
+uint64_t writeCacheExpression(struct CacheWriter *writer,
+                              struct ExpressionNode *expression) {
+  uint64_t offset = reserveCache(writer, sizeof(struct ExpressionNode));
+  struct ExpressionNode node = *expression;
+  node.retained = false;
+  node.data.symbolic_exp = NULL;
+  memcpy(&writer->data[offset], &node, sizeof(struct ExpressionNode));
+
+  uint64_t data = 0;
+  if (expression->type == EXP_SYMBOLIC_EXP) {
+    data = reserveCache(writer, sizeof(struct SymbolicExpNode));
+    uint64_t expressions = writeCacheExpressionList(
+        writer, expression->data.symbolic_exp->expressions);
+    setCachePointer(writer,
+                    data + offsetof(struct SymbolicExpNode, expressions),
+                    expressions);
+  } else if (expression->type == EXP_LIST) {
+    data = reserveCache(writer, sizeof(struct ListNode));
+    uint64_t expressions =
+        writeCacheExpressionList(writer, expression->data.list->expressions);
+    setCachePointer(writer, data + offsetof(struct ListNode, expressions),
+                    expressions);
+  } else if (expression->type == EXP_LITERAL) {
+    data = reserveCache(writer, sizeof(struct LiteralNode));
+    struct LiteralNode literal = *expression->data.literal;
+    if (literal.type == LIT_STRING) {
+      literal.string_value = NULL;
+    }
+    memcpy(&writer->data[data], &literal, sizeof(struct LiteralNode));
+    if (expression->data.literal->type == LIT_STRING) {
+      uint64_t str =
+          writeCacheString(writer, expression->data.literal->string_value);
+      setCachePointer(writer, data + offsetof(struct LiteralNode, string_value),
+                      str);
+    }
+  } else if (expression->type == EXP_SYMBOL) {
+    data = reserveCache(writer, sizeof(struct SymbolNode));
+    uint64_t name =
+        writeCacheString(writer, expression->data.symbol->symbol_name);
+    setCachePointer(writer, data + offsetof(struct SymbolNode, symbol_name),
+                    name);
   }
+  setCachePointer(writer, offset + offsetof(struct ExpressionNode, data), data);
+  return offset;
 }
 
-void definedFunctionDiv(struct Object *op1, struct Object *op2,
-                        struct Object *evaluated) {
-  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
-    evaluated->type = OBJ_INTEGER;
-    evaluated->int_value = op1->int_value / op2->int_value;
-  } else {
-    printf("Type error: operands for / must be integers.\n");
-    exit(1);
+uint64_t writeCacheExpressionList(struct CacheWriter *writer,
+                                  struct ExpressionList *expressions) {
+  uint64_t first = 0;
+  uint64_t prev = 0;
+  while (expressions != NULL) {
+    uint64_t offset = reserveCache(writer, sizeof(struct ExpressionList));
+    uint64_t expression =
+        writeCacheExpression(writer, expressions->expression);
+    setCachePointer(writer, offset + offsetof(struct ExpressionList, expression),
+                    expression);
+    if (prev == 0) {
+      first = offset;
+    } else {
+      setCachePointer(writer, prev + offsetof(struct ExpressionList, next),
+                      offset);
+    }
+    prev = offset;
+    expressions = expressions->next;
   }
+  return first;
 }
 
-void definedFunctionMod(struct Object *op1, struct Object *op2,
-                        struct Object *evaluated) {
-  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
-    evaluated->type = OBJ_INTEGER;
-    evaluated->int_value = op1->int_value % op2->int_value;
-  } else {
-    printf("Type error: operands for % must be integers.\n");
-    exit(1);
+int writeScriptCache(char *path, uint64_t hash, struct ProgramNode *program) {
+  struct CacheWriter writer;
+  writer.capacity = 4096;
+  writer.data = malloc(writer.capacity);
+  writer.size = 0;
+  writer.string_capacity = 256;
+  writer.string_count = 0;
+  writer.strings = calloc(writer.string_capacity, sizeof(struct CacheString));
+
+  uint64_t header = reserveCache(&writer, sizeof(struct ScriptCacheHeader));
+  uint64_t program_offset = reserveCache(&writer, sizeof(struct ProgramNode));
+  uint64_t expressions =
+      writeCacheExpressionList(&writer, program->expressions);
+  setCachePointer(&writer,
+                  program_offset + offsetof(struct ProgramNode, expressions),
+                  expressions);
+
+  struct ScriptCacheHeader values;
+  memcpy(values.magic, SCRIPT_CACHE_MAGIC, sizeof(values.magic));
+  values.version = SCRIPT_CACHE_VERSION;
+  values.layout = scriptCacheLayout();
+  values.hash = hash;
+  values.size = writer.size;
+  values.program_offset = program_offset;
+  memcpy(&writer.data[header], &values, sizeof(struct ScriptCacheHeader));
+
+  // write to a temporary file and rename it, so that concurrent runs never
+  // see a partially written cache
+  size_t path_length = strlen(path);
+  char *tmp_path = malloc(path_length + 8);
+  snprintf(tmp_path, path_length + 8, "%s.XXXXXX", path);
+  int fd = mkstemp(tmp_path);
+  int ok = fd >= 0;
+  if (ok) {
+    fchmod(fd, 0644);
+    ok = write(fd, writer.data, writer.size) == (ssize_t)writer.size;
+    close(fd);
+    ok = ok && rename(tmp_path, path) == 0;
+    if (!ok) {
+      unlink(tmp_path);
+    }
   }
+
+  free(tmp_path);
+  free(writer.data);
+  free(writer.strings);
+  return ok;
 }
 
-void definedFunctionOr(struct Object *op1, struct Object *op2,
-                       struct Object *evaluated) {
-  if (boolVal(op1) || boolVal(op2)) {
-    evaluated->type = OBJ_BOOL;
-    evaluated->bool_value = 1;
-  } else {
-    evaluated->type = OBJ_BOOL;
-    evaluated->bool_value = 0;
+// the image is checked while it is relocated. Every offset has to point to
+// a whole struct after the header, and every string has to end inside of the
+// image. A relocated pointer is never below the image size, so a node that is
+// reached twice, e.g. through a cycle, is rejected as well.
+struct CacheImage {
+  char *base;
+  uint64_t size;
+};
+
+bool relocateCacheNode(struct CacheImage *image, void **field, size_t size) {
+  uint64_t offset = (uintptr_t)*field;
+  if (offset < sizeof(struct ScriptCacheHeader) || offset % 8 != 0 ||
+      offset > image->size || size > image->size - offset) {
+    return false;
   }
+  *field = image->base + offset;
+  return true;
 }
 
-void definedFunctionAnd(struct Object *op1, struct Object *op2,
-                        struct Object *evaluated) {
-  if (boolVal(op1) && boolVal(op2)) {
-    evaluated->type = OBJ_BOOL;
-    evaluated->bool_value = 1;
-  } else {
-    evaluated->type = OBJ_BOOL;
-    evaluated->bool_value = 0;
+bool relocateCacheString(struct CacheImage *image, char **field) {
+  uint64_t offset = (uintptr_t)*field;
+  uint64_t chars = offsetof(struct StringHeader, chars);
+  if (offset < sizeof(struct ScriptCacheHeader) + chars ||
+      (offset - chars) % 8 != 0 || offset >= image->size) {
+    return false;
   }
+  struct StringHeader *header =
+      (struct StringHeader *)(image->base + offset - chars);
+  // bools are read as bytes, a corrupt image can hold other values in them
+  if (header->hash != 0 || *(unsigned char *)&header->interned != 0 ||
+      header->length < 0 ||
+      (uint64_t)header->length >= image->size - offset ||
+      image->base[offset + header->length] != '\0') {
+    return false;
+  }
+  *field = image->base + offset;
+  return true;
 }
 
-void definedFunctionLt(struct Object *op1, struct Object *op2,
-                       struct Object *evaluated) {
-  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
-    if (op1->int_value < op2->int_value) {
-      evaluated->type = OBJ_BOOL;
-      evaluated->bool_value = 1;
-    } else {
-      evaluated->type = OBJ_BOOL;
-      evaluated->bool_value = 0;
+bool relocateExpressionList(struct CacheImage *image,
+                            struct ExpressionList **expressions);
+
+bool relocateExpression(struct CacheImage *image,
+                        struct ExpressionNode **expression) {
+  if (!relocateCacheNode(image, (void **)expression,
+                         sizeof(struct ExpressionNode))) {
+    return false;
+  }
+  struct ExpressionNode *node = *expression;
+  node->retained = false;
+  if (node->type == EXP_SYMBOLIC_EXP) {
+    if (!relocateCacheNode(image, (void **)&node->data.symbolic_exp,
+                           sizeof(struct SymbolicExpNode))) {
+      return false;
     }
-  } else {
-    printf("Type error: operands for < must be integers.\n");
-    exit(1);
+    // what the evaluator caches in the node is never taken from the file
+    node->data.symbolic_exp->specialization = SPECIALIZATION_NONE;
+    node->data.symbolic_exp->cached_function = NULL;
+    node->data.symbolic_exp->cached_version = 0;
+    return relocateExpressionList(image,
+                                  &node->data.symbolic_exp->expressions);
+  } else if (node->type == EXP_LIST) {
+    if (!relocateCacheNode(image, (void **)&node->data.list,
+                           sizeof(struct ListNode))) {
+      return false;
+    }
+    node->data.list->constant = NULL;
+    return relocateExpressionList(image, &node->data.list->expressions);
+  } else if (node->type == EXP_LITERAL) {
+    if (!relocateCacheNode(image, (void **)&node->data.literal,
+                           sizeof(struct LiteralNode))) {
+      return false;
+    }
+    struct LiteralNode *literal = node->data.literal;
+    if (literal->type == LIT_STRING) {
+      if (!relocateCacheString(image, &literal->string_value)) {
+        return false;
+      }
+      // literals are interned like when they are parsed
+      char *str = literal->string_value;
+      if (stringLength(str) <= INTERN_MAX_LENGTH) {
+        literal->string_value = internString(str, stringLength(str));
+      }
+      return true;
+    }
+    return literal->type == LIT_INTERGER ||
+           (literal->type == LIT_BOOLEAN &&
+            *(unsigned char *)&literal->boolean_value <= 1);
+  } else if (node->type == EXP_SYMBOL) {
+    if (!relocateCacheNode(image, (void **)&node->data.symbol,
+                           sizeof(struct SymbolNode)) ||
+        !relocateCacheString(image, &node->data.symbol->symbol_name)) {
+      return false;
+    }
+    // resolved again when its function is defined
+    node->data.symbol->slot = -1;
+    return true;
   }
+  return false;
 }
 
-void definedFunctionGt(struct Object *op1, struct Object *op2,
-                       struct Object *evaluated) {
-  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
-    if (op1->int_value > op2->int_value) {
-      evaluated->type = OBJ_BOOL;
-      evaluated->bool_value = 1;
-    } else {
-      evaluated->type = OBJ_BOOL;
-      evaluated->bool_value = 0;
+bool relocateExpressionList(struct CacheImage *image,
+                            struct ExpressionList **expressions) {
+  while (*expressions != NULL) {
+    if (!relocateCacheNode(image, (void **)expressions,
+                           sizeof(struct ExpressionList)) ||
+        !relocateExpression(image, &(*expressions)->expression)) {
+      return false;
     }
-  } else {
-    printf("Type error: operands for < must be integers.\n");
-    exit(1);
+    expressions = &(*expressions)->next;
   }
+  return true;
 }
 
-void definedFunctionEq(struct Object *op1, struct Object *op2,
-                       struct Object *evaluated) {
-  if (eq(op1, op2)) {
-    evaluated->type = OBJ_BOOL;
-    evaluated->bool_value = 1;
-  } else {
-    evaluated->type = OBJ_BOOL;
-    evaluated->bool_value = 0;
+struct ProgramNode *loadScriptCache(char *path, uint64_t hash) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < (off_t)sizeof(struct ScriptCacheHeader)) {
+    close(fd);
+    return NULL;
+  }
+  // private mapping, relocated pages are copied on write
+  char *base =
+      mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
   }
-}
 
-void definedFunctionCar(struct Object *op, struct Object *evaluated) {
-  if (op->type != OBJ_LIST) {
-    printf("Type error: car operand must be list.\n");
-    exit(1);
+  struct CacheImage image = {base, (uint64_t)st.st_size};
+  struct ScriptCacheHeader *header = (struct ScriptCacheHeader *)base;
+  void *program = (void *)(uintptr_t)header->program_offset;
+  if (memcmp(header->magic, SCRIPT_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SCRIPT_CACHE_VERSION ||
+      header->layout != scriptCacheLayout() || header->hash != hash ||
+      header->size != image.size || (uintptr_t)base < image.size ||
+      !relocateCacheNode(&image, &program, sizeof(struct ProgramNode)) ||
+      !relocateExpressionList(
+          &image, &((struct ProgramNode *)program)->expressions)) {
+    munmap(base, st.st_size);
+    return NULL;
   }
-  *evaluated = *(op->list_value->car);
+  return program;
 }
 
-void definedFunctionCdr(struct Object *op, struct Object *evaluated) {
-  if (op->type != OBJ_LIST) {
-    printf("Type error: cdr operand must be list.\n");
-    exit(1);
-  }
-  *evaluated = *op->list_value->cdr;
+// =================================================
+//   garbage collector
+// =================================================
+
+void initializeObjectStack(struct ObjectStack *stack) {
+  stack->capacity = OBJECT_NUMBER;
+  stack->objects = malloc(sizeof(struct Object *) * stack->capacity);
+  stack->top = -1;
 }
 
-void definedFunctionCons(struct Object *op1, struct Object *op2,
-                         struct Object *evaluated, struct Env *env,
-                         struct AllocatorContext *context) {
-  evaluated->type = OBJ_LIST;
-  evaluated->list_value = malloc(sizeof(struct ConsCell));
-  evaluated->list_value->car = op1;
+int isFullObjectStack(struct ObjectStack *stack) {
+  return stack->top == stack->capacity - 1;
+}
 
-  if (op2->type == OBJ_LIST) {
-    evaluated->list_value->type = CONSCELL_TYPE_CELL;
-    evaluated->list_value->cdr = op2;
-  } else if (op2->type == OBJ_NIL) {
-    evaluated->list_value->cdr = op2;
-  } else {
-    struct Object *cdr_obj = allocate(context, env);
-    cdr_obj->type = OBJ_LIST;
-    struct ConsCell *new_conscell = malloc(sizeof(struct ConsCell));
-    new_conscell->car = op2;
-    new_conscell->type = CONSCELL_TYPE_CELL;
-    new_conscell->cdr = allocate(context, env);
-    new_conscell->cdr->type = OBJ_NIL;
-    cdr_obj->list_value = new_conscell;
-    evaluated->list_value->cdr = cdr_obj;
+int isEmptyObjectStack(struct ObjectStack *stack) { return stack->top == -1; }
+
+void pushObjectStack(struct ObjectStack *stack, struct Object *obj) {
+  if (isFullObjectStack(stack)) {
+    stack->capacity *= 2;
+    stack->objects =
+        realloc(stack->objects, sizeof(struct Object *) * stack->capacity);
   }
+  stack->top++;
+  stack->objects[stack->top] = obj;
 }
 
-void definedFunctionNot(struct Object *op, struct Object *evaluated) {
-  if (op->type != OBJ_BOOL) {
-    printf("Type error: not operand must be boolean.\n");
+struct Object *popObjectStack(struct ObjectStack *stack) {
+  if (isEmptyObjectStack(stack)) {
+    printf("Object stack is empty.\n");
     exit(1);
   }
-  evaluated->type = OBJ_BOOL;
-  if (op->bool_value) {
-    evaluated->bool_value = 0;
-  } else {
-    evaluated->bool_value = 1;
-  }
+  struct Object *obj = stack->objects[stack->top];
+  stack->top--;
+  return obj;
 }
 
-void definedFunctionSplit(struct Object *op1, struct Object *op2,
-                          struct Object *evaluated, struct Env *env,
-                          struct AllocatorContext *context) {
-  if (op1->type != OBJ_STRING) {
-    printf("Type error: split first operand must be string.\n");
-    exit(1);
-  }
-  if (op2->type != OBJ_STRING) {
-    printf("Type error: split second operand must be string.\n");
-    exit(1);
-  }
+unsigned long heapChunkSlot(uintptr_t address, unsigned long capacity) {
+  return (unsigned long)((address >> HEAP_CHUNK_BITS) * 0x9e3779b97f4a7c15ULL) &
+         (capacity - 1);
+}
 
-  // when op2 is "", return list of characters
-  if (strcmp(op2->string_value, "") == 0) {
-    evaluated->type = OBJ_LIST;
-    evaluated->list_value = malloc(sizeof(struct ConsCell));
-    evaluated->list_value->type = CONSCELL_TYPE_CELL;
-    evaluated->list_value->car = allocate(context, env);
-    evaluated->list_value->car->type = OBJ_STRING;
-    evaluated->list_value->car->string_value = malloc(sizeof(char));
-    evaluated->list_value->car->string_value[0] = op1->string_value[0];
-    evaluated->list_value->cdr = allocate(context, env);
-    evaluated->list_value->cdr->type = OBJ_NIL;
-    struct ConsCell *current = evaluated->list_value;
-    for (unsigned long i = 1; i < strlen(op1->string_value); i++) {
-      struct ConsCell *new_conscell = malloc(sizeof(struct ConsCell));
-      new_conscell->type = CONSCELL_TYPE_CELL;
-      new_conscell->car = allocate(context, env);
-      new_conscell->car->type = OBJ_STRING;
-      new_conscell->car->string_value = malloc(sizeof(char));
-      new_conscell->car->string_value[0] = op1->string_value[i];
-      new_conscell->cdr = allocate(context, env);
-      new_conscell->cdr->type = OBJ_NIL;
-      current->cdr = allocate(context, env);
-      current->cdr->type = OBJ_LIST;
-      current->cdr->list_value = new_conscell;
-      current = current->cdr->list_value;
+void insertHeapChunk(struct AllocatorContext *context, uintptr_t address,
+                     struct MemoryBlock *block) {
+  if ((context->chunk_count + 1) * 2 > context->chunk_capacity) {
+    struct HeapChunk *chunks = context->chunks;
+    unsigned long capacity = context->chunk_capacity;
+    context->chunk_capacity = capacity == 0 ? 16 : capacity * 2;
+    context->chunks =
+        calloc(context->chunk_capacity, sizeof(struct HeapChunk));
+    context->chunk_count = 0;
+    for (unsigned long i = 0; i < capacity; i++) {
+      if (chunks[i].block != NULL) {
+        insertHeapChunk(context, chunks[i].address, chunks[i].block);
+      }
     }
-    return;
+    free(chunks);
   }
-
-  // split op1 string by op2 string and return list of strings
-  evaluated->type = OBJ_LIST;
-  evaluated->list_value = malloc(sizeof(struct ConsCell));
-  evaluated->list_value->type = CONSCELL_TYPE_CELL;
-  evaluated->list_value->car = allocate(context, env);
-  evaluated->list_value->car->type = OBJ_STRING;
-  evaluated->list_value->car->string_value =
-      strtok(op1->string_value, op2->string_value);
-  evaluated->list_value->cdr = allocate(context, env);
-  evaluated->list_value->cdr->type = OBJ_NIL;
-  struct ConsCell *current = evaluated->list_value;
-  while (1) {
-    char *token = strtok(NULL, op2->string_value);
-    if (token == NULL) {
-      break;
-    }
-    struct ConsCell *new_conscell = malloc(sizeof(struct ConsCell));
-    new_conscell->type = CONSCELL_TYPE_CELL;
-    new_conscell->car = allocate(context, env);
-    new_conscell->car->type = OBJ_STRING;
-    new_conscell->car->string_value = token;
-    new_conscell->cdr = allocate(context, env);
-    new_conscell->cdr->type = OBJ_NIL;
-    current->cdr = allocate(context, env);
-    current->cdr->type = OBJ_LIST;
-    current->cdr->list_value = new_conscell;
-    current = current->cdr->list_value;
+  unsigned long i = heapChunkSlot(address, context->chunk_capacity);
+  while (context->chunks[i].block != NULL) {
+    i = (i + 1) & (context->chunk_capacity - 1);
   }
+  context->chunks[i].address = address;
+  context->chunks[i].block = block;
+  context->chunk_count++;
 }
 
-void definedFunctionListRef(struct Object *op1, struct Object *op2,
-                            struct Object *evaluated) {
-  if (op1->type != OBJ_LIST) {
-    printf("Type error: list-ref first operand must be list.\n");
-    exit(1);
-  }
-  if (op2->type != OBJ_INTEGER) {
-    printf("Type error: list-ref second operand must be integer.\n");
-    exit(1);
-  }
-  int index = op2->int_value;
-  struct ConsCell *current = op1->list_value;
-  for (int i = 0; i < index; i++) {
-    if (current->cdr->type == OBJ_NIL) {
-      printf("Index out of range.\n");
-      exit(1);
+// the block of context that holds obj, or NULL when obj lives outside of its
+// heap, e.g. in the heap of another thread or in the constants of a program.
+// Only the address is looked at, obj itself is not read.
+struct MemoryBlock *findMemoryBlock(struct AllocatorContext *context,
+                                    struct Object *obj) {
+  uintptr_t address = (uintptr_t)obj & ~(uintptr_t)(HEAP_CHUNK_BYTES - 1);
+  unsigned long i = heapChunkSlot(address, context->chunk_capacity);
+  while (context->chunks[i].block != NULL) {
+    if (context->chunks[i].address == address) {
+      return context->chunks[i].block;
     }
-    current = current->cdr->list_value;
+    i = (i + 1) & (context->chunk_capacity - 1);
   }
-  *evaluated = *current->car;
+  return NULL;
 }
 
-void definedFunctionRemoveWhitespaces(struct Object *op1,
-                                      struct Object *evaluated) {
-  if (op1->type != OBJ_STRING) {
-    printf("Type error: remove-whitespaces operand must be string.\n");
-    exit(1);
+void addMemoryBlock(struct AllocatorContext *context, unsigned long size) {
+  // blocks are made of whole chunks
+  unsigned long chunk_size = HEAP_CHUNK_BYTES / sizeof(struct Object);
+  size = (size + chunk_size - 1) / chunk_size * chunk_size;
+  struct MemoryBlock *block = malloc(sizeof(struct MemoryBlock));
+  block->objects =
+      aligned_alloc(HEAP_CHUNK_BYTES, sizeof(struct Object) * size);
+  block->free_bitmap = calloc(size, sizeof(uint8_t));
+  block->size = size;
+  block->next = context->blocks;
+  context->blocks = block;
+  for (unsigned long i = 0; i < size; i += chunk_size) {
+    insertHeapChunk(context, (uintptr_t)&block->objects[i], block);
   }
-  char *str = op1->string_value;
-  char *new_str = malloc(sizeof(char) * (strlen(str) + 1));
-  int i = 0;
-  int j = 0;
-  while (str[i]) {
-    if (!isspace(str[i])) {
-      new_str[j++] = str[i];
-    }
-    i++;
+
+  for (unsigned long i = 0; i < size; ++i) {
+    block->objects[i].next_free = context->free_list;
+    context->free_list = &block->objects[i];
   }
-  new_str[j] = '\0';
-  evaluated->type = OBJ_STRING;
-  evaluated->string_value = new_str;
+  context->object_count += size;
+  context->free_count += size;
 }
 
-void definedFunctionPop(struct Object *op, struct Object *evaluated) {
-  // empty list is evaluted as nil
-  if (op->type == OBJ_NIL) {
-    evaluated->type = OBJ_NIL;
-    return;
+struct AllocatorContext *initAllocator() {
+  struct AllocatorContext *context = malloc(sizeof(struct AllocatorContext));
+
+  context->blocks = NULL;
+  context->free_list = NULL;
+  context->object_count = 0;
+  context->free_count = 0;
+  context->allocation_count = 0;
+  context->epoch = 1;
+  context->buffers = NULL;
+  context->chunks = NULL;
+  context->chunk_capacity = 0;
+  context->chunk_count = 0;
+  addMemoryBlock(context, OBJECT_NUMBER);
+
+  context->gc_less_mode = 0;
+
+  struct ObjectStack *stack = malloc(sizeof(struct ObjectStack));
+  initializeObjectStack(stack);
+  context->stack = stack;
+
+  return context;
+}
+
+void freeObject(struct AllocatorContext *context, struct MemoryBlock *block,
+                unsigned long index) {
+  block->free_bitmap[index] = 0;
+  block->objects[index].next_free = context->free_list;
+  context->free_list = &block->objects[index];
+  context->free_count++;
+}
+
+void addHeapBuffer(struct AllocatorContext *context, struct HeapBuffer *buffer,
+                   HeapBufferType type) {
+  buffer->marked = 0;
+  buffer->type = type;
+  buffer->owner = context;
+  buffer->next = context->buffers;
+  context->buffers = buffer;
+}
+
+// false when the buffer is marked already or belongs to another heap, then
+// what it refers to is not marked again
+bool markHeapBuffer(struct HeapBuffer *buffer,
+                    struct AllocatorContext *context) {
+  if (buffer->owner != context || buffer->marked == context->epoch) {
+    return false;
   }
-  if (op->type != OBJ_LIST) {
-    printf("Type error: pop operand must be list.\n");
-    exit(1);
+  buffer->marked = context->epoch;
+  return true;
+}
+
+void freeHeapBuffer(struct HeapBuffer *buffer) {
+  switch (buffer->type) {
+  case BUFFER_VECTOR:
+    free(((struct Vector *)buffer)->items);
+    break;
+  case BUFFER_HASHMAP:
+    free(((struct HashMap *)buffer)->entries);
+    break;
+  case BUFFER_STRING_BUILDER:
+    free(((struct StringBuilder *)buffer)->chars);
+    break;
+  default:
+    // the nodes of persistent collections are a single allocation
+    break;
   }
-  struct ConsCell *current = op->list_value;
-  struct ConsCell *prev = NULL;
-  while (1) {
-    if (isLastConsCell(current)) {
-      if (prev == NULL) {
-        *evaluated = *current->car;
-      } else {
-        prev->cdr->type = OBJ_NIL;
-        prev->cdr->list_value = NULL;
-        *evaluated = *current->car;
+  free(buffer);
+}
+
+void sweep(struct AllocatorContext *context) {
+  for (struct MemoryBlock *block = context->blocks; block != NULL;
+       block = block->next) {
+    for (unsigned long i = 0; i < block->size; ++i) {
+      if (block->free_bitmap[i] == 1 &&
+          block->objects[i].marked != context->epoch) {
+        freeObject(context, block, i);
       }
-      break;
     }
-    prev = current;
-    current = current->cdr->list_value;
+  }
+  struct HeapBuffer **link = &context->buffers;
+  while (*link != NULL) {
+    struct HeapBuffer *buffer = *link;
+    if (buffer->marked != context->epoch) {
+      *link = buffer->next;
+      freeHeapBuffer(buffer);
+    } else {
+      link = &buffer->next;
+    }
   }
 }
 
-void definedFunctionPush(struct Object *op1, struct Object *op2,
-                         struct Object *evaluated, struct Env *env,
-                         struct AllocatorContext *context) {
-  if (op1->type == OBJ_NIL) {
-    *evaluated = *op2;
+int isLastConsCell(struct ConsCell *conscell) {
+  return conscell->cdr->type == OBJ_NIL;
+}
 
-    int i = 0;
-    while (env->bindings[i].symbol_name != NULL) {
-      if (env->bindings[i].value == op1) {
-        struct Object *new_list = allocate(context, env);
-        new_list->type = OBJ_LIST;
-        new_list->list_value = malloc(sizeof(struct ConsCell));
-        new_list->list_value->type = CONSCELL_TYPE_CELL;
-        new_list->list_value->car = op2;
-        new_list->list_value->cdr = allocate(context, env);
-        new_list->list_value->cdr->type = OBJ_NIL;
-        env->bindings[i].value = new_list;
-        break;
-      }
-      i++;
-    }
+void mark(struct Object *obj, struct AllocatorContext *context);
 
+// nodes are shared between versions, a node reachable from several versions
+// is only walked when it is first marked
+void markPVectorNode(struct PVectorNode *node, int shift,
+                     struct AllocatorContext *context) {
+  if (node == NULL || !markHeapBuffer(&node->buffer, context)) {
     return;
   }
-
-  if (op1->type != OBJ_LIST) {
-    printf("Type error: push second operand must be list.\n");
-    exit(1);
-  }
-
-  struct ConsCell *current = op1->list_value;
-  while (1) {
-    if (isLastConsCell(current)) {
-      struct ConsCell *new_conscell = malloc(sizeof(struct ConsCell));
-      new_conscell->type = CONSCELL_TYPE_CELL;
-      new_conscell->car = op2;
-      new_conscell->cdr = allocate(context, env);
-      new_conscell->cdr->type = OBJ_NIL;
-      current->cdr->type = OBJ_LIST;
-      current->cdr->list_value = new_conscell;
-      break;
+  for (int i = 0; i < PERSISTENT_WIDTH; i++) {
+    if (shift == 0) {
+      mark(node->items[i], context);
+    } else {
+      markPVectorNode(node->children[i], shift - PERSISTENT_BITS, context);
     }
-    current = current->cdr->list_value;
   }
-
-  *evaluated = *op2;
 }
 
-void definedFunctionLength(struct Object *op, struct Object *evaluated) {
-  if (op->type == OBJ_NIL) {
-    evaluated->type = OBJ_INTEGER;
-    evaluated->int_value = 0;
+void markPHashNode(struct PHashNode *node, struct AllocatorContext *context) {
+  if (node == NULL || !markHeapBuffer(&node->buffer, context)) {
     return;
   }
-  if (op->type == OBJ_LIST) {
-    int length = 1;
-    struct ConsCell *current = op->list_value;
-    while (1) {
-      if (isLastConsCell(current)) {
-        break;
-      }
-      length++;
-      current = current->cdr->list_value;
+  for (int i = 0; i < node->length; i++) {
+    if (node->entries[i].node != NULL) {
+      markPHashNode(node->entries[i].node, context);
+    } else {
+      mark(node->entries[i].key, context);
+      mark(node->entries[i].value, context);
     }
-    evaluated->type = OBJ_INTEGER;
-    evaluated->int_value = length;
-  } else if (op->type == OBJ_STRING) {
-    evaluated->type = OBJ_INTEGER;
-    evaluated->int_value = strlen(op->string_value);
-  } else {
-    printf("Type error: length operand must be list or string.\n");
-    exit(1);
   }
 }
 
-void definedFunctionIsIntString(struct Object *op, struct Object *evaluated) {
-  if (op->type == OBJ_STRING) {
-    char *str = op->string_value;
-    int i = 0;
-    while (str[i]) {
-      if (!isdigit(str[i])) {
-        evaluated->type = OBJ_BOOL;
-        evaluated->bool_value = false;
-        return;
+// only objects of the heap of context are marked. Objects outside of it are
+// never written, so the threads of pmap can collect their heaps while they
+// share the objects of the caller and the constants of the program.
+void mark(struct Object *obj, struct AllocatorContext *context) {
+  uint32_t epoch = context->epoch;
+  // walk down the cdr chain iteratively so that long lists do not overflow
+  // the C stack
+  // cells under construction can have no car or cdr yet
+  while (obj != NULL && findMemoryBlock(context, obj) != NULL &&
+         obj->marked != epoch) {
+    obj->marked = epoch;
+    // evaluating list object can be nil, and constant cells only refer to
+    // constant objects which live outside of the heap
+    if (obj->type == OBJ_VECTOR) {
+      struct Vector *vector = obj->vector_value;
+      if (markHeapBuffer(&vector->buffer, context)) {
+        for (int i = 0; i < vector->length; i++) {
+          mark(vector->items[i], context);
+        }
       }
-      i++;
+      return;
     }
-    evaluated->type = OBJ_BOOL;
-    evaluated->bool_value = true;
-  } else {
-    evaluated->type = OBJ_BOOL;
-    evaluated->bool_value = false;
+    if (obj->type == OBJ_PVECTOR) {
+      struct PVector *vector = obj->pvector_value;
+      if (markHeapBuffer(&vector->buffer, context)) {
+        markPVectorNode(vector->root, vector->shift, context);
+      }
+      return;
+    }
+    if (obj->type == OBJ_PHASH) {
+      struct PHash *map = obj->phash_value;
+      if (markHeapBuffer(&map->buffer, context)) {
+        markPHashNode(map->root, context);
+      }
+      return;
+    }
+    if (obj->type == OBJ_STRING_BUILDER) {
+      markHeapBuffer(&obj->builder_value->buffer, context);
+      return;
+    }
+    if (obj->type == OBJ_HASHMAP) {
+      struct HashMap *map = obj->hashmap_value;
+      if (markHeapBuffer(&map->buffer, context)) {
+        for (int i = 0; i < map->capacity; i++) {
+          if (map->entries[i].key != NULL) {
+            mark(map->entries[i].key, context);
+            mark(map->entries[i].value, context);
+          }
+        }
+      }
+      return;
+    }
+    if (obj->type != OBJ_LIST || obj->list_value == NULL ||
+        obj->list_value->constant) {
+      return;
+    }
+    mark(obj->list_value->car, context);
+    obj = obj->list_value->cdr;
   }
 }
 
-void definedFunctionParseInt(struct Object *op, struct Object *evaluated) {
-  if (op->type != OBJ_STRING) {
-    printf("Type error: parse-int operand must be string.\n");
-    exit(1);
+void markEnv(struct Env *env, struct AllocatorContext *context) {
+  for (int i = 0; i < env->size; i++) {
+    mark(env->bindings[i].value, context);
   }
-  char *str = op->string_value;
-  int i = 0;
-  while (str[i]) {
-    if (!isdigit(str[i])) {
-      printf("Type error: parse-int operand must be string of digits.\n");
-      exit(1);
-    }
-    i++;
+  if (env->parent != NULL) {
+    markEnv(env->parent, context);
   }
-  evaluated->type = OBJ_INTEGER;
-  evaluated->int_value = atoi(str);
 }
 
-void definedFunctionStringRef(struct Object *op1, struct Object *op2, struct Object *evaluated) {
-  if (op1->type != OBJ_STRING) {
-    printf("Type error: string-ref first operand must be string.\n");
-    exit(1);
-  }
-  if (op2->type != OBJ_INTEGER) {
-    printf("Type error: string-ref second operand must be integer.\n");
-    exit(1);
+void markAll(struct Env *env, struct AllocatorContext *context) {
+  // mark objects in stack
+  for (int i = 0; i <= context->stack->top; i++) {
+    struct Object *obj = context->stack->objects[i];
+    mark(obj, context);
   }
-  int index = op2->int_value;
+  markEnv(env, context);
+}
 
-  if (index < 0 || index >= (int)strlen(op1->string_value)) {
-    printf("Index out of range.\n");
-    exit(1);
+void gc(struct AllocatorContext *context, struct Env *env) {
+  // objects marked in an older epoch are garbage now, so marks never need to
+  // be cleared
+  context->epoch++;
+  if (context->epoch == 0) {
+    context->epoch = 1;
   }
-  evaluated->type = OBJ_STRING;
-  evaluated->string_value = malloc(sizeof(char) * 2);
-  evaluated->string_value[0] = op1->string_value[index];
-  evaluated->string_value[1] = '\0';
+  markAll(env, context);
+  sweep(context);
 }
 
-// =================================================
-//   evaluator
-// =================================================
-
-void evaluateListExpression(struct ExpressionNode *expression,
-                            struct Object *evaluated, struct Env *env,
-                            struct AllocatorContext *context) {
-  struct ExpressionList *expressions = expression->data.list->expressions;
+struct Object *allocate(struct AllocatorContext *context, struct Env *env) {
+  size_t object_size = sizeof(struct Object);
+  if (context->gc_less_mode) {
+    return malloc(object_size);
+  }
 
-  // empty data list is evaluated as nil
-  if (expressions == NULL) {
-    evaluated->type = OBJ_NIL;
-    return;
+  if (context->free_list == NULL) {
+    gc(context, env);
+    // keep at least half of the heap free so that collections stay rare
+    if (context->free_count < context->object_count / 2) {
+      addMemoryBlock(context, context->object_count);
+    }
   }
 
-  evaluated->type = OBJ_LIST;
+  struct Object *obj = context->free_list;
+  context->free_list = obj->next_free;
+  context->free_count--;
+  context->allocation_count++;
 
-  struct ConsCell *car_conscell = NULL;
-  struct ConsCell *prev_conscell = NULL;
+  struct MemoryBlock *block = findMemoryBlock(context, obj);
+  block->free_bitmap[obj - block->objects] = 1; // Mark the block as used
+  obj->marked = 0;
+  obj->type = OBJ_NIL;
 
-  while (expressions != NULL) {
-    struct ConsCell *new_conscell = malloc(sizeof(struct ConsCell));
-    if (car_conscell == NULL) {
-      car_conscell = new_conscell;
-    }
+  // temporaries stay reachable until the expression allocating them is done
+  pushObjectStack(context->stack, obj);
+  return obj;
+}
 
-    struct Object *evaluatedItem = allocate(context, env);
-    new_conscell->car = evaluatedItem;
-    evaluateExpression(expressions->expression, evaluatedItem, env, context);
+void freeAllocator(struct AllocatorContext *context) {
+  struct MemoryBlock *block = context->blocks;
+  while (block != NULL) {
+    struct MemoryBlock *next = block->next;
+    free(block->objects);
+    free(block->free_bitmap);
+    free(block);
+    block = next;
+  }
+  while (context->buffers != NULL) {
+    struct HeapBuffer *next = context->buffers->next;
+    freeHeapBuffer(context->buffers);
+    context->buffers = next;
+  }
+  free(context->chunks);
+  free(context->stack->objects);
+  free(context->stack);
+  free(context);
+}
 
-    expressions = expressions->next;
+struct ConsCell *newConsCell() {
+  struct ConsCell *conscell = malloc(sizeof(struct ConsCell));
+  conscell->constant = false;
+  conscell->car = NULL;
+  conscell->cdr = NULL;
+  conscell->prev = NULL;
+  conscell->header = NULL;
+  return conscell;
+}
 
-    if (prev_conscell != NULL) {
-      struct Object *new_cdr = allocate(context, env);
-      new_cdr->type = OBJ_LIST;
-      new_cdr->list_value = new_conscell;
-      prev_conscell->cdr = new_cdr;
-      prev_conscell->type = CONSCELL_TYPE_CELL;
-    }
-    prev_conscell = new_conscell;
+// bumped whenever a list is mutated without going through its header, its
+// cells may be the tail of a list with a header that is then out of date
+_Atomic unsigned long list_header_version = 0;
 
-    if (expressions == NULL) {
-      struct Object *nilObj = allocate(context, env);
-      nilObj->type = OBJ_NIL;
-      prev_conscell->type = CONSCELL_TYPE_NIL;
+void attachListHeader(struct ConsCell *head, struct ConsCell *tail,
+                      int length) {
+  struct ListHeader *header = malloc(sizeof(struct ListHeader));
+  header->tail = tail;
+  header->length = length;
+  header->version = list_header_version;
+  head->header = header;
+}
+
+// returns the up to date header of the list starting with head, or NULL when
+// the list has to be walked
+struct ListHeader *listHeader(struct ConsCell *head) {
+  struct ListHeader *header = head->header;
+  if (header == NULL) {
+    return NULL;
+  }
+  unsigned long version = list_header_version;
+  if (header->version == version) {
+    return header;
+  }
+  // the threads of pmap may share the list, so they do not refresh it
+  if (parallel_evaluation) {
+    return NULL;
+  }
+  int length = 1;
+  struct ConsCell *current = head;
+  while (!isLastConsCell(current)) {
+    length++;
+    current = current->cdr->list_value;
+  }
+  header->tail = current;
+  header->length = length;
+  header->version = version;
+  return header;
+}
+
+struct Vector *newVector(int capacity, struct AllocatorContext *context) {
+  struct Vector *vector = malloc(sizeof(struct Vector));
+  addHeapBuffer(context, &vector->buffer, BUFFER_VECTOR);
+  vector->capacity = capacity > 0 ? capacity : 1;
+  vector->items = malloc(sizeof(struct Object *) * vector->capacity);
+  vector->length = 0;
+  return vector;
+}
+
+struct HashMap *newHashMap(int capacity, struct AllocatorContext *context) {
+  struct HashMap *map = malloc(sizeof(struct HashMap));
+  addHeapBuffer(context, &map->buffer, BUFFER_HASHMAP);
+  map->capacity = capacity;
+  map->entries = calloc(capacity, sizeof(struct HashMapEntry));
+  map->size = 0;
+  return map;
+}
+
+// a copy of source, or an empty node when source is NULL
+struct PVectorNode *newPVectorNode(struct PVectorNode *source,
+                                   struct AllocatorContext *context) {
+  struct PVectorNode *node = malloc(sizeof(struct PVectorNode));
+  addHeapBuffer(context, &node->buffer, BUFFER_PVECTOR_NODE);
+  if (source != NULL) {
+    memcpy(node->children, source->children, sizeof(node->children));
+  } else {
+    memset(node->children, 0, sizeof(node->children));
+  }
+  return node;
+}
+
+struct PVector *newPVector(struct AllocatorContext *context) {
+  struct PVector *vector = malloc(sizeof(struct PVector));
+  addHeapBuffer(context, &vector->buffer, BUFFER_PVECTOR);
+  vector->count = 0;
+  vector->shift = 0;
+  vector->root = NULL;
+  return vector;
+}
+
+// copies the path from node down to index, which stores item in the copy
+struct PVectorNode *assocPVectorNode(struct PVectorNode *node, int shift,
+                                     int index, struct Object *item,
+                                     struct AllocatorContext *context) {
+  struct PVectorNode *copy = newPVectorNode(node, context);
+  int slot = (index >> shift) & (PERSISTENT_WIDTH - 1);
+  if (shift == 0) {
+    copy->items[slot] = item;
+  } else {
+    copy->children[slot] =
+        assocPVectorNode(copy->children[slot], shift - PERSISTENT_BITS, index,
+                         item, context);
+  }
+  return copy;
+}
+
+struct PVector *assocPVector(struct PVector *vector, int index,
+                             struct Object *item,
+                             struct AllocatorContext *context) {
+  struct PVector *result = newPVector(context);
+  result->count = vector->count;
+  result->shift = vector->shift;
+  result->root = vector->root;
+  if (index == vector->count) {
+    result->count++;
+    // the trie is full, it becomes the first child of a new root
+    if (vector->count == 1 << (vector->shift + PERSISTENT_BITS)) {
+      struct PVectorNode *root = newPVectorNode(NULL, context);
+      root->children[0] = vector->root;
+      result->root = root;
+      result->shift += PERSISTENT_BITS;
+    }
+  }
+  result->root =
+      assocPVectorNode(result->root, result->shift, index, item, context);
+  return result;
+}
+
+struct Object *pvectorItem(struct PVector *vector, int index) {
+  struct PVectorNode *node = vector->root;
+  for (int shift = vector->shift; shift > 0; shift -= PERSISTENT_BITS) {
+    node = node->children[(index >> shift) & (PERSISTENT_WIDTH - 1)];
+  }
+  return node->items[index & (PERSISTENT_WIDTH - 1)];
+}
+
+uint64_t hashMapHash(struct Object *key);
+bool isSameKey(struct Object *key1, struct Object *key2);
+
+struct PHash *newPHash(struct AllocatorContext *context) {
+  struct PHash *map = malloc(sizeof(struct PHash));
+  addHeapBuffer(context, &map->buffer, BUFFER_PHASH);
+  map->count = 0;
+  map->root = NULL;
+  return map;
+}
+
+struct PHashNode *newPHashNode(int length, struct AllocatorContext *context) {
+  struct PHashNode *node =
+      malloc(sizeof(struct PHashNode) + sizeof(struct PHashEntry) * length);
+  addHeapBuffer(context, &node->buffer, BUFFER_PHASH_NODE);
+  node->bitmap = 0;
+  node->length = length;
+  node->collision = false;
+  return node;
+}
+
+struct PHashNode *clonePHashNode(struct PHashNode *source,
+                                 struct AllocatorContext *context) {
+  struct PHashNode *node = newPHashNode(source->length, context);
+  node->bitmap = source->bitmap;
+  node->collision = source->collision;
+  memcpy(node->entries, source->entries,
+         sizeof(struct PHashEntry) * source->length);
+  return node;
+}
+
+// copy of node with its entry index removed, the bitmap is left to the caller
+struct PHashNode *removePHashEntry(struct PHashNode *node, int index,
+                                   struct AllocatorContext *context) {
+  struct PHashNode *copy = newPHashNode(node->length - 1, context);
+  copy->bitmap = node->bitmap;
+  copy->collision = node->collision;
+  memcpy(copy->entries, node->entries, sizeof(struct PHashEntry) * index);
+  memcpy(copy->entries + index, node->entries + index + 1,
+         sizeof(struct PHashEntry) * (node->length - index - 1));
+  return copy;
+}
+
+int phashFragment(uint64_t hash, int shift) {
+  return (hash >> shift) & (PERSISTENT_WIDTH - 1);
+}
+
+// a node for two entries whose hashes agree on the bits below shift
+struct PHashNode *mergePHashEntries(struct PHashEntry *entry1,
+                                    struct PHashEntry *entry2, int shift,
+                                    struct AllocatorContext *context) {
+  if (shift >= 64) {
+    struct PHashNode *node = newPHashNode(2, context);
+    node->collision = true;
+    node->entries[0] = *entry1;
+    node->entries[1] = *entry2;
+    return node;
+  }
+  int fragment1 = phashFragment(entry1->hash, shift);
+  int fragment2 = phashFragment(entry2->hash, shift);
+  if (fragment1 == fragment2) {
+    struct PHashNode *node = newPHashNode(1, context);
+    node->bitmap = 1u << fragment1;
+    node->entries[0] = (struct PHashEntry){
+        NULL, NULL, 0,
+        mergePHashEntries(entry1, entry2, shift + PERSISTENT_BITS, context)};
+    return node;
+  }
+  struct PHashNode *node = newPHashNode(2, context);
+  node->bitmap = 1u << fragment1 | 1u << fragment2;
+  node->entries[fragment1 < fragment2 ? 0 : 1] = *entry1;
+  node->entries[fragment1 < fragment2 ? 1 : 0] = *entry2;
+  return node;
+}
+
+// copies the path from node down to the key of entry, which is stored in the
+// copy, added is set when the key was not present
+struct PHashNode *assocPHashNode(struct PHashNode *node, int shift,
+                                 struct PHashEntry *entry, bool *added,
+                                 struct AllocatorContext *context) {
+  if (node == NULL) {
+    node = newPHashNode(1, context);
+    node->bitmap = 1u << phashFragment(entry->hash, shift);
+    node->entries[0] = *entry;
+    *added = true;
+    return node;
+  }
+  if (node->collision) {
+    for (int i = 0; i < node->length; i++) {
+      if (isSameKey(node->entries[i].key, entry->key)) {
+        struct PHashNode *copy = clonePHashNode(node, context);
+        copy->entries[i] = *entry;
+        return copy;
+      }
+    }
+    struct PHashNode *copy = newPHashNode(node->length + 1, context);
+    copy->collision = true;
+    memcpy(copy->entries, node->entries,
+           sizeof(struct PHashEntry) * node->length);
+    copy->entries[node->length] = *entry;
+    *added = true;
+    return copy;
+  }
+
+  uint32_t bit = 1u << phashFragment(entry->hash, shift);
+  int index = __builtin_popcount(node->bitmap & (bit - 1));
+  if ((node->bitmap & bit) == 0) {
+    struct PHashNode *copy = newPHashNode(node->length + 1, context);
+    copy->bitmap = node->bitmap | bit;
+    memcpy(copy->entries, node->entries, sizeof(struct PHashEntry) * index);
+    copy->entries[index] = *entry;
+    memcpy(copy->entries + index + 1, node->entries + index,
+           sizeof(struct PHashEntry) * (node->length - index));
+    *added = true;
+    return copy;
+  }
+
+  struct PHashNode *copy = clonePHashNode(node, context);
+  struct PHashEntry *existing = &copy->entries[index];
+  if (existing->node != NULL) {
+    existing->node = assocPHashNode(existing->node, shift + PERSISTENT_BITS,
+                                    entry, added, context);
+  } else if (existing->hash == entry->hash &&
+             isSameKey(existing->key, entry->key)) {
+    *existing = *entry;
+  } else {
+    struct PHashNode *merged =
+        mergePHashEntries(existing, entry, shift + PERSISTENT_BITS, context);
+    *existing = (struct PHashEntry){NULL, NULL, 0, merged};
+    *added = true;
+  }
+  return copy;
+}
+
+// node without key, node itself when key is not present and NULL when no
+// entry is left
+struct PHashNode *dissocPHashNode(struct PHashNode *node, int shift,
+                                  struct Object *key, uint64_t hash,
+                                  bool *removed,
+                                  struct AllocatorContext *context) {
+  if (node->collision) {
+    for (int i = 0; i < node->length; i++) {
+      if (isSameKey(node->entries[i].key, key)) {
+        *removed = true;
+        return node->length == 1 ? NULL : removePHashEntry(node, i, context);
+      }
+    }
+    return node;
+  }
+
+  uint32_t bit = 1u << phashFragment(hash, shift);
+  if ((node->bitmap & bit) == 0) {
+    return node;
+  }
+  int index = __builtin_popcount(node->bitmap & (bit - 1));
+  struct PHashEntry *entry = &node->entries[index];
+  if (entry->node != NULL) {
+    struct PHashNode *child =
+        dissocPHashNode(entry->node, shift + PERSISTENT_BITS, key, hash,
+                        removed, context);
+    if (child == entry->node) {
+      return node;
+    }
+    if (child != NULL) {
+      struct PHashNode *copy = clonePHashNode(node, context);
+      copy->entries[index].node = child;
+      return copy;
+    }
+  } else if (entry->hash != hash || !isSameKey(entry->key, key)) {
+    return node;
+  } else {
+    *removed = true;
+  }
+  if (node->length == 1) {
+    return NULL;
+  }
+  struct PHashNode *copy = removePHashEntry(node, index, context);
+  copy->bitmap &= ~bit;
+  return copy;
+}
+
+struct PHashEntry *findPHashEntry(struct PHashNode *node, struct Object *key,
+                                  uint64_t hash) {
+  for (int shift = 0; node != NULL; shift += PERSISTENT_BITS) {
+    if (node->collision) {
+      for (int i = 0; i < node->length; i++) {
+        if (isSameKey(node->entries[i].key, key)) {
+          return &node->entries[i];
+        }
+      }
+      return NULL;
+    }
+    uint32_t bit = 1u << phashFragment(hash, shift);
+    if ((node->bitmap & bit) == 0) {
+      return NULL;
+    }
+    struct PHashEntry *entry =
+        &node->entries[__builtin_popcount(node->bitmap & (bit - 1))];
+    if (entry->node == NULL) {
+      return entry->hash == hash && isSameKey(entry->key, key) ? entry : NULL;
+    }
+    node = entry->node;
+  }
+  return NULL;
+}
+
+struct PHash *assocPHash(struct PHash *map, struct Object *key,
+                         struct Object *value,
+                         struct AllocatorContext *context) {
+  struct PHashEntry entry = {key, value, hashMapHash(key), NULL};
+  bool added = false;
+  struct PHash *result = newPHash(context);
+  result->root = assocPHashNode(map->root, 0, &entry, &added, context);
+  result->count = map->count + (added ? 1 : 0);
+  return result;
+}
+
+// collects the key and value entries of node in the order of the trie
+void collectPHashEntries(struct PHashNode *node, struct PHashEntry **entries,
+                         int *count) {
+  if (node == NULL) {
+    return;
+  }
+  for (int i = 0; i < node->length; i++) {
+    if (node->entries[i].node != NULL) {
+      collectPHashEntries(node->entries[i].node, entries, count);
+    } else {
+      entries[(*count)++] = &node->entries[i];
+    }
+  }
+}
+
+// =================================================
+//   defined functions
+// =================================================
+
+bool boolVal(struct Object *obj) {
+  if (obj->type == OBJ_BOOL) {
+    return obj->bool_value;
+  } else if (obj->type == OBJ_NIL) {
+    return false;
+  } else {
+    return true;
+  }
+}
+
+int eq(struct Object *op1, struct Object *op2) {
+  if (op1->type != op2->type) {
+    return 0;
+  } else {
+    if (op1->type == OBJ_INTEGER) {
+      return op1->int_value == op2->int_value;
+    } else if (op1->type == OBJ_STRING) {
+      if (op1->string_value == op2->string_value) {
+        return 1;
+      }
+      if (stringHeader(op1->string_value)->interned &&
+          stringHeader(op2->string_value)->interned) {
+        return 0;
+      }
+      int length = stringLength(op1->string_value);
+      return length == stringLength(op2->string_value) &&
+             memcmp(op1->string_value, op2->string_value, length) == 0;
+    } else if (op1->type == OBJ_BOOL) {
+      return op1->bool_value == op2->bool_value;
+    } else if (op1->type == OBJ_LIST) {
+      return op1->list_value == op2->list_value;
+    } else if (op1->type == OBJ_VECTOR) {
+      return op1->vector_value == op2->vector_value;
+    } else if (op1->type == OBJ_HASHMAP) {
+      return op1->hashmap_value == op2->hashmap_value;
+    } else if (op1->type == OBJ_PVECTOR) {
+      return op1->pvector_value == op2->pvector_value;
+    } else if (op1->type == OBJ_PHASH) {
+      return op1->phash_value == op2->phash_value;
+    } else if (op1->type == OBJ_STRING_BUILDER) {
+      return op1->builder_value == op2->builder_value;
+    } else if (op1->type == OBJ_NIL) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+char *stringifyObject(struct Object *obj) {
+  if (obj->type == OBJ_INTEGER) {
+    if (obj->int_value == 0) {
+      char *str = (char *)malloc(2 * sizeof(char));
+      strncpy(str, "0", 2);
+      return str;
+    }
+    int digits = (int)log10(obj->int_value) + 1;
+    char *str = (char *)malloc((digits + 1) * sizeof(char));
+    sprintf(str, "%d", obj->int_value);
+    return str;
+  } else if (obj->type == OBJ_STRING) {
+    int length = stringLength(obj->string_value);
+    char *str = (char *)malloc((length + 1) * sizeof(char));
+    memcpy(str, obj->string_value, length + 1);
+    return str;
+  } else if (obj->type == OBJ_BOOL) {
+    char *str = (char *)malloc(2 * sizeof(char));
+    if (obj->bool_value) {
+      strncpy(str, "T", 2);
+    } else {
+      strncpy(str, "F", 2);
+    }
+    return str;
+  } else if (obj->type == OBJ_LIST) {
+    int length = 2; // '(' and ')'
+    char *str = (char *)malloc(length + 1 * sizeof(char));
+    memset(str, 0, length + 1);
+    str[0] = '(';
+    struct ConsCell *current = obj->list_value;
+    while (1) {
+      char *serialized = stringifyObject(current->car);
+      length += strlen(serialized);
+      str = realloc(str, length + 1);
+      strncat(str, serialized, strlen(serialized));
+      if (isLastConsCell(current)) {
+        break;
+      } else {
+        length += 1; // " "
+        str = realloc(str, length + 1);
+        strncat(str, " ", 1);
+      }
+      current = current->cdr->list_value;
+    }
+    str[length - 1] = ')';
+    str[length] = '\0';
+    return str;
+  } else if (obj->type == OBJ_NIL) {
+    char *str = (char *)malloc(4 * sizeof(char));
+    strncpy(str, "nil", 4);
+    return str;
+  } else if (obj->type == OBJ_FUNCTION) {
+    char *str = (char *)malloc(11 * sizeof(char));
+    strncpy(str, "<function>", 11);
+    return str;
+  } else if (obj->type == OBJ_STRING_BUILDER) {
+    char *str = (char *)malloc(17 * sizeof(char));
+    strncpy(str, "<string-builder>", 17);
+    return str;
+  } else if (obj->type == OBJ_VECTOR) {
+    // #(1 2 3)
+    struct Vector *vector = obj->vector_value;
+    char **serialized = malloc(sizeof(char *) * (vector->length + 1));
+    size_t length = 3; // "#(" and ")"
+    for (int i = 0; i < vector->length; i++) {
+      serialized[i] = stringifyObject(vector->items[i]);
+      length += strlen(serialized[i]) + 1;
+    }
+    char *str = (char *)malloc(length + 1);
+    strcpy(str, "#(");
+    for (int i = 0; i < vector->length; i++) {
+      if (i > 0) {
+        strcat(str, " ");
+      }
+      strcat(str, serialized[i]);
+      free(serialized[i]);
+    }
+    strcat(str, ")");
+    free(serialized);
+    return str;
+  } else if (obj->type == OBJ_HASHMAP) {
+    // #{a 1, b 2} in the order of the slots
+    struct HashMap *map = obj->hashmap_value;
+    char **serialized = malloc(sizeof(char *) * (map->size * 2 + 1));
+    size_t length = 3; // "#{" and "}"
+    int count = 0;
+    for (int i = 0; i < map->capacity; i++) {
+      if (map->entries[i].key != NULL) {
+        serialized[count] = stringifyObject(map->entries[i].key);
+        serialized[count + 1] = stringifyObject(map->entries[i].value);
+        length += strlen(serialized[count]) + strlen(serialized[count + 1]) + 3;
+        count += 2;
+      }
+    }
+    char *str = (char *)malloc(length + 1);
+    strcpy(str, "#{");
+    for (int i = 0; i < count; i += 2) {
+      if (i > 0) {
+        strcat(str, ", ");
+      }
+      strcat(str, serialized[i]);
+      strcat(str, " ");
+      strcat(str, serialized[i + 1]);
+      free(serialized[i]);
+      free(serialized[i + 1]);
+    }
+    strcat(str, "}");
+    free(serialized);
+    return str;
+  } else if (obj->type == OBJ_PVECTOR) {
+    // [1 2 3]
+    struct PVector *vector = obj->pvector_value;
+    char **serialized = malloc(sizeof(char *) * (vector->count + 1));
+    size_t length = 2; // "[" and "]"
+    for (int i = 0; i < vector->count; i++) {
+      serialized[i] = stringifyObject(pvectorItem(vector, i));
+      length += strlen(serialized[i]) + 1;
+    }
+    char *str = (char *)malloc(length + 1);
+    strcpy(str, "[");
+    for (int i = 0; i < vector->count; i++) {
+      if (i > 0) {
+        strcat(str, " ");
+      }
+      strcat(str, serialized[i]);
+      free(serialized[i]);
+    }
+    strcat(str, "]");
+    free(serialized);
+    return str;
+  } else if (obj->type == OBJ_PHASH) {
+    // {a 1, b 2} in the order of the trie
+    struct PHash *map = obj->phash_value;
+    struct PHashEntry **entries =
+        malloc(sizeof(struct PHashEntry *) * (map->count + 1));
+    int count = 0;
+    collectPHashEntries(map->root, entries, &count);
+    char **serialized = malloc(sizeof(char *) * (count * 2 + 1));
+    size_t length = 2; // "{" and "}"
+    for (int i = 0; i < count; i++) {
+      serialized[i * 2] = stringifyObject(entries[i]->key);
+      serialized[i * 2 + 1] = stringifyObject(entries[i]->value);
+      length += strlen(serialized[i * 2]) + strlen(serialized[i * 2 + 1]) + 3;
+    }
+    char *str = (char *)malloc(length + 1);
+    strcpy(str, "{");
+    for (int i = 0; i < count * 2; i += 2) {
+      if (i > 0) {
+        strcat(str, ", ");
+      }
+      strcat(str, serialized[i]);
+      strcat(str, " ");
+      strcat(str, serialized[i + 1]);
+      free(serialized[i]);
+      free(serialized[i + 1]);
+    }
+    strcat(str, "}");
+    free(serialized);
+    free(entries);
+    return str;
+  } else {
+    printf("Unexpected object type: %d\n", obj->type);
+    exit(1);
+  }
+}
+
+void definedFunctionAdd(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated) {
+  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
+    evaluated->type = OBJ_INTEGER;
+    evaluated->int_value = WRAPPING_INT(op1->int_value, +, op2->int_value);
+  } else if (op1->type == OBJ_STRING && op2->type == OBJ_STRING) {
+    int length1 = stringLength(op1->string_value);
+    int length2 = stringLength(op2->string_value);
+    char *str = allocateString(
+        malloc(sizeof(struct StringHeader) + length1 + length2 + 1),
+        length1 + length2);
+    memcpy(str, op1->string_value, length1);
+    memcpy(str + length1, op2->string_value, length2);
+    evaluated->type = OBJ_STRING;
+    evaluated->string_value = str;
+  } else {
+    printf("Type error: operands for + must be integers or strings.\n");
+    exit(1);
+  }
+}
+
+void definedFunctionSub(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated) {
+  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
+    evaluated->type = OBJ_INTEGER;
+    evaluated->int_value = WRAPPING_INT(op1->int_value, -, op2->int_value);
+  } else {
+    printf("Type error: operands for - must be integers.\n");
+    exit(1);
+  }
+}
+
+void definedFunctionMul(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated) {
+  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
+    evaluated->type = OBJ_INTEGER;
+    evaluated->int_value = WRAPPING_INT(op1->int_value, *, op2->int_value);
+  } else {
+    printf("Type error: operands for * must be integers.\n");
+    exit(1);
+  }
+}
+
+void definedFunctionDiv(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated) {
+  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
+    evaluated->type = OBJ_INTEGER;
+    evaluated->int_value = op1->int_value / op2->int_value;
+  } else {
+    printf("Type error: operands for / must be integers.\n");
+    exit(1);
+  }
+}
+
+void definedFunctionMod(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated) {
+  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
+    evaluated->type = OBJ_INTEGER;
+    evaluated->int_value = op1->int_value % op2->int_value;
+  } else {
+    printf("Type error: operands for % must be integers.\n");
+    exit(1);
+  }
+}
+
+void definedFunctionOr(struct Object *op1, struct Object *op2,
+                       struct Object *evaluated) {
+  if (boolVal(op1) || boolVal(op2)) {
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = 1;
+  } else {
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = 0;
+  }
+}
+
+void definedFunctionAnd(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated) {
+  if (boolVal(op1) && boolVal(op2)) {
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = 1;
+  } else {
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = 0;
+  }
+}
+
+void definedFunctionLt(struct Object *op1, struct Object *op2,
+                       struct Object *evaluated) {
+  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
+    if (op1->int_value < op2->int_value) {
+      evaluated->type = OBJ_BOOL;
+      evaluated->bool_value = 1;
+    } else {
+      evaluated->type = OBJ_BOOL;
+      evaluated->bool_value = 0;
+    }
+  } else {
+    printf("Type error: operands for < must be integers.\n");
+    exit(1);
+  }
+}
+
+void definedFunctionGt(struct Object *op1, struct Object *op2,
+                       struct Object *evaluated) {
+  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
+    if (op1->int_value > op2->int_value) {
+      evaluated->type = OBJ_BOOL;
+      evaluated->bool_value = 1;
+    } else {
+      evaluated->type = OBJ_BOOL;
+      evaluated->bool_value = 0;
+    }
+  } else {
+    printf("Type error: operands for < must be integers.\n");
+    exit(1);
+  }
+}
+
+void definedFunctionEq(struct Object *op1, struct Object *op2,
+                       struct Object *evaluated) {
+  if (eq(op1, op2)) {
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = 1;
+  } else {
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = 0;
+  }
+}
+
+void definedFunctionCar(struct Object *op, struct Object *evaluated) {
+  if (op->type != OBJ_LIST) {
+    printf("Type error: car operand must be list.\n");
+    exit(1);
+  }
+  *evaluated = *(op->list_value->car);
+}
+
+void ensureMutableList(struct Object *list, struct Env *env,
+                       struct AllocatorContext *context);
+
+void definedFunctionCdr(struct Object *op, struct Object *evaluated,
+                        struct Env *env, struct AllocatorContext *context) {
+  if (op->type != OBJ_LIST) {
+    printf("Type error: cdr operand must be list.\n");
+    exit(1);
+  }
+  // the result must not start with a constant cell, which could not be
+  // copied in place once it is mutated
+  struct Object *cdr = op->list_value->cdr;
+  if (cdr->type == OBJ_LIST && cdr->list_value->constant) {
+    ensureMutableList(op, env, context);
+  }
+  *evaluated = *op->list_value->cdr;
+}
+
+void definedFunctionCons(struct Object *op1, struct Object *op2,
+                         struct Object *evaluated, struct Env *env,
+                         struct AllocatorContext *context) {
+  evaluated->type = OBJ_LIST;
+  evaluated->list_value = newConsCell();
+  evaluated->list_value->car = op1;
+
+  if (op2->type == OBJ_LIST) {
+    // the cells of op2 are shared, so the result has no header
+    evaluated->list_value->type = CONSCELL_TYPE_CELL;
+    evaluated->list_value->cdr = op2;
+  } else if (op2->type == OBJ_NIL) {
+    evaluated->list_value->cdr = op2;
+    attachListHeader(evaluated->list_value, evaluated->list_value, 1);
+  } else {
+    struct Object *cdr_obj = allocate(context, env);
+    cdr_obj->type = OBJ_LIST;
+    struct ConsCell *new_conscell = newConsCell();
+    new_conscell->car = op2;
+    new_conscell->type = CONSCELL_TYPE_CELL;
+    new_conscell->cdr = allocate(context, env);
+    new_conscell->cdr->type = OBJ_NIL;
+    new_conscell->prev = evaluated->list_value;
+    cdr_obj->list_value = new_conscell;
+    evaluated->list_value->cdr = cdr_obj;
+    attachListHeader(evaluated->list_value, new_conscell, 2);
+  }
+}
+
+void definedFunctionNot(struct Object *op, struct Object *evaluated) {
+  if (op->type != OBJ_BOOL) {
+    printf("Type error: not operand must be boolean.\n");
+    exit(1);
+  }
+  evaluated->type = OBJ_BOOL;
+  if (op->bool_value) {
+    evaluated->bool_value = 0;
+  } else {
+    evaluated->bool_value = 1;
+  }
+}
+
+void appendToList(struct Object *head, struct ConsCell **tail,
+                  struct Object *item, struct Env *env,
+                  struct AllocatorContext *context);
+
+void definedFunctionSplit(struct Object *op1, struct Object *op2,
+                          struct Object *evaluated, struct Env *env,
+                          struct AllocatorContext *context) {
+  if (op1->type != OBJ_STRING) {
+    printf("Type error: split first operand must be string.\n");
+    exit(1);
+  }
+  if (op2->type != OBJ_STRING) {
+    printf("Type error: split second operand must be string.\n");
+    exit(1);
+  }
+
+  // when op2 is "", return list of characters
+  if (strcmp(op2->string_value, "") == 0) {
+    evaluated->type = OBJ_NIL;
+    struct ConsCell *tail = NULL;
+    int length = stringLength(op1->string_value);
+    // "" is split into a list of one "" rather than of its terminator
+    if (length == 0) {
+      struct Object *empty = allocate(context, env);
+      empty->type = OBJ_STRING;
+      empty->string_value = internString("", 0);
+      appendToList(evaluated, &tail, empty, env, context);
+      return;
+    }
+    for (int i = 0; i < length; i++) {
+      struct Object *character = allocate(context, env);
+      character->type = OBJ_STRING;
+      character->string_value = charString(op1->string_value[i]);
+      appendToList(evaluated, &tail, character, env, context);
+    }
+    return;
+  }
+
+  // split op1 string by the characters of op2, empty tokens are skipped like
+  // strtok does, but op1 is left intact so that threads can share it
+  char *str = op1->string_value;
+  int length = stringLength(str);
+  uint64_t *bitmap = malloc(sizeof(uint64_t) * ((length + 63) / 64 + 1));
+  delimiterBitmap(str, length, op2->string_value, bitmap);
+
+  // short tokens are interned, the others are measured first so that they
+  // are all copied into one allocation
+  size_t size = 0;
+  for (int start = nextBitmapIndex(bitmap, 0, length, false); start < length;) {
+    int end = nextBitmapIndex(bitmap, start, length, true);
+    if (end - start > INTERN_MAX_LENGTH) {
+      size += stringSize(end - start);
+    }
+    start = nextBitmapIndex(bitmap, end, length, false);
+  }
+  char *block = size > 0 ? malloc(size) : NULL;
+
+  evaluated->type = OBJ_NIL;
+  struct ConsCell *tail = NULL;
+  for (int start = nextBitmapIndex(bitmap, 0, length, false); start < length;) {
+    int end = nextBitmapIndex(bitmap, start, length, true);
+    struct Object *token = allocate(context, env);
+    token->type = OBJ_STRING;
+    if (end - start <= INTERN_MAX_LENGTH) {
+      token->string_value = internString(&str[start], end - start);
+    } else {
+      token->string_value = allocateString(block, end - start);
+      memcpy(token->string_value, &str[start], end - start);
+      block += stringSize(end - start);
+    }
+    appendToList(evaluated, &tail, token, env, context);
+    start = nextBitmapIndex(bitmap, end, length, false);
+  }
+  free(bitmap);
+}
+
+void definedFunctionListRef(struct Object *op1, struct Object *op2,
+                            struct Object *evaluated) {
+  if (op1->type != OBJ_LIST) {
+    printf("Type error: list-ref first operand must be list.\n");
+    exit(1);
+  }
+  if (op2->type != OBJ_INTEGER) {
+    printf("Type error: list-ref second operand must be integer.\n");
+    exit(1);
+  }
+  int index = op2->int_value;
+  struct ConsCell *current = op1->list_value;
+  for (int i = 0; i < index; i++) {
+    if (current->cdr->type == OBJ_NIL) {
+      printf("Index out of range.\n");
+      exit(1);
+    }
+    current = current->cdr->list_value;
+  }
+  *evaluated = *current->car;
+}
+
+void definedFunctionRemoveWhitespaces(struct Object *op1,
+                                      struct Object *evaluated) {
+  if (op1->type != OBJ_STRING) {
+    printf("Type error: remove-whitespaces operand must be string.\n");
+    exit(1);
+  }
+  char *str = op1->string_value;
+  int length = stringLength(str);
+  char *new_str = allocateString(
+      malloc(sizeof(struct StringHeader) + length + 1), length);
+  int j = removeSpaces(str, length, new_str);
+  new_str[j] = '\0';
+  stringHeader(new_str)->length = j;
+  evaluated->type = OBJ_STRING;
+  evaluated->string_value = new_str;
+}
+
+struct Binding *lookupBinding(struct Env *env, char *symbol_name);
+struct Binding *lookupLocalBinding(struct Env *env, char *symbol_name);
+struct Env *globalEnv(struct Env *env);
+
+void definedFunctionPop(struct Object *op, struct Object *evaluated,
+                        struct Env *env, struct AllocatorContext *context) {
+  // empty list is evaluted as nil
+  if (op->type == OBJ_NIL) {
+    evaluated->type = OBJ_NIL;
+    return;
+  }
+  if (op->type != OBJ_LIST) {
+    printf("Type error: pop operand must be list.\n");
+    exit(1);
+  }
+  ensureMutableList(op, env, context);
+  struct ListHeader *header = listHeader(op->list_value);
+  if (header != NULL) {
+    struct ConsCell *last = header->tail;
+    *evaluated = *last->car;
+    if (header->length > 1) {
+      last->prev->cdr->type = OBJ_NIL;
+      last->prev->cdr->list_value = NULL;
+      header->tail = last->prev;
+      header->length--;
+    }
+    return;
+  }
+
+  struct ConsCell *current = op->list_value;
+  struct ConsCell *prev = NULL;
+  while (1) {
+    if (isLastConsCell(current)) {
+      if (prev == NULL) {
+        *evaluated = *current->car;
+      } else {
+        prev->cdr->type = OBJ_NIL;
+        prev->cdr->list_value = NULL;
+        *evaluated = *current->car;
+        list_header_version++;
+      }
+      break;
+    }
+    prev = current;
+    current = current->cdr->list_value;
+  }
+}
+
+// binding is the variable op1 was read from, or NULL when it is not a
+// variable
+void definedFunctionPush(struct Object *op1, struct Object *op2,
+                         struct Object *evaluated, struct Binding *binding,
+                         struct Env *env, struct AllocatorContext *context) {
+  if (op1->type == OBJ_NIL) {
+    *evaluated = *op2;
+
+    // an empty list has no cell to append to, so the variable is rebound
+    if (binding != NULL) {
+      struct Object *new_list = allocate(context, env);
+      new_list->type = OBJ_LIST;
+      new_list->list_value = newConsCell();
+      new_list->list_value->type = CONSCELL_TYPE_CELL;
+      new_list->list_value->car = op2;
+      new_list->list_value->cdr = allocate(context, env);
+      new_list->list_value->cdr->type = OBJ_NIL;
+      attachListHeader(new_list->list_value, new_list->list_value, 1);
+      binding->value = new_list;
+    }
+
+    return;
+  }
+
+  if (op1->type != OBJ_LIST) {
+    printf("Type error: push second operand must be list.\n");
+    exit(1);
+  }
+  ensureMutableList(op1, env, context);
+
+  struct ListHeader *header = listHeader(op1->list_value);
+  struct ConsCell *current;
+  if (header != NULL) {
+    current = header->tail;
+  } else {
+    current = op1->list_value;
+    while (!isLastConsCell(current)) {
+      current = current->cdr->list_value;
+    }
+    list_header_version++;
+  }
+  struct ConsCell *new_conscell = newConsCell();
+  new_conscell->type = CONSCELL_TYPE_CELL;
+  new_conscell->car = op2;
+  new_conscell->cdr = allocate(context, env);
+  new_conscell->cdr->type = OBJ_NIL;
+  new_conscell->prev = current;
+  current->cdr->type = OBJ_LIST;
+  current->cdr->list_value = new_conscell;
+  if (header != NULL) {
+    header->tail = new_conscell;
+    header->length++;
+  }
+
+  *evaluated = *op2;
+}
+
+void definedFunctionLength(struct Object *op, struct Object *evaluated) {
+  if (op->type == OBJ_NIL) {
+    evaluated->type = OBJ_INTEGER;
+    evaluated->int_value = 0;
+    return;
+  }
+  if (op->type == OBJ_LIST) {
+    struct ListHeader *header = listHeader(op->list_value);
+    if (header != NULL) {
+      evaluated->type = OBJ_INTEGER;
+      evaluated->int_value = header->length;
+      return;
+    }
+    int length = 1;
+    struct ConsCell *current = op->list_value;
+    while (1) {
+      if (isLastConsCell(current)) {
+        break;
+      }
+      length++;
+      current = current->cdr->list_value;
+    }
+    evaluated->type = OBJ_INTEGER;
+    evaluated->int_value = length;
+  } else if (op->type == OBJ_STRING) {
+    evaluated->type = OBJ_INTEGER;
+    evaluated->int_value = stringLength(op->string_value);
+  } else {
+    printf("Type error: length operand must be list or string.\n");
+    exit(1);
+  }
+}
+
+void definedFunctionIsIntString(struct Object *op, struct Object *evaluated) {
+  if (op->type == OBJ_STRING) {
+    char *str = op->string_value;
+    int length = stringLength(str);
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = digitSpan(str, length) == length;
+  } else {
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = false;
+  }
+}
+
+void definedFunctionParseInt(struct Object *op, struct Object *evaluated) {
+  if (op->type != OBJ_STRING) {
+    printf("Type error: parse-int operand must be string.\n");
+    exit(1);
+  }
+  char *str = op->string_value;
+  int length = stringLength(str);
+  if (digitSpan(str, length) != length) {
+    printf("Type error: parse-int operand must be string of digits.\n");
+    exit(1);
+  }
+  // the digits are known to be valid, so only the significant ones are
+  // accumulated instead of scanning again with atoi. Like atoi, the value
+  // saturates at LONG_MAX before it is truncated to int.
+  int i = 0;
+  while (i < length && str[i] == '0') {
+    i++;
+  }
+  long value = 0;
+  if (length - i > 19) {
+    value = LONG_MAX;
+  }
+  for (; i < length && value != LONG_MAX; i++) {
+    int digit = str[i] - '0';
+    value = value > (LONG_MAX - digit) / 10 ? LONG_MAX : value * 10 + digit;
+  }
+  evaluated->type = OBJ_INTEGER;
+  evaluated->int_value = (int)value;
+}
+
+void definedFunctionPrint(struct Object *op, struct Object *evaluated) {
+  char *str = stringifyObject(op);
+  printf("%s\n", str);
+  free(str);
+  evaluated->type = OBJ_NIL;
+}
+
+void definedFunctionReadline(struct Object *evaluated) {
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t read;
+  if ((read = getline(&line, &len, stdin)) != -1) {
+    evaluated->type = OBJ_STRING;
+    // trim newline
+    if (read - 1 <= INTERN_MAX_LENGTH) {
+      evaluated->string_value = internString(line, read - 1);
+    } else {
+      evaluated->string_value = newString(line, read - 1);
+    }
+    free(line);
+  } else {
+    evaluated->type = OBJ_NIL;
+  }
+}
+
+void definedFunctionStringRef(struct Object *op1, struct Object *op2, struct Object *evaluated) {
+  if (op1->type != OBJ_STRING) {
+    printf("Type error: string-ref first operand must be string.\n");
+    exit(1);
+  }
+  if (op2->type != OBJ_INTEGER) {
+    printf("Type error: string-ref second operand must be integer.\n");
+    exit(1);
+  }
+  int index = op2->int_value;
+
+  if (index < 0 || index >= stringLength(op1->string_value)) {
+    printf("Index out of range.\n");
+    exit(1);
+  }
+  evaluated->type = OBJ_STRING;
+  evaluated->string_value = charString(op1->string_value[index]);
+}
+
+// the characters of op1 from op2 up to but not including op3, the whole
+// string is not copied since strings are never written to. Other results are
+// not views into op1, every string ends with its own NUL, so short ones are
+// interned like split tokens and the others copied.
+void definedFunctionSubstring(struct Object *op1, struct Object *op2,
+                              struct Object *op3, struct Object *evaluated) {
+  if (op1->type != OBJ_STRING) {
+    printf("Type error: substring first operand must be string.\n");
+    exit(1);
+  }
+  if (op2->type != OBJ_INTEGER || op3->type != OBJ_INTEGER) {
+    printf("Type error: substring second and third operands must be "
+           "integers.\n");
+    exit(1);
+  }
+  int length = stringLength(op1->string_value);
+  int start = op2->int_value;
+  int end = op3->int_value;
+  if (start < 0 || start > end || end > length) {
+    printf("Index out of range.\n");
+    exit(1);
+  }
+  evaluated->type = OBJ_STRING;
+  if (start == 0 && end == length) {
+    evaluated->string_value = op1->string_value;
+  } else if (end - start == 1) {
+    evaluated->string_value = charString(op1->string_value[start]);
+  } else if (end - start <= INTERN_MAX_LENGTH) {
+    evaluated->string_value =
+        internString(&op1->string_value[start], end - start);
+  } else {
+    evaluated->string_value =
+        newString(&op1->string_value[start], end - start);
+  }
+}
+
+void definedFunctionMakeStringBuilder(struct Object *evaluated,
+                                      struct Env *env,
+                                      struct AllocatorContext *context) {
+  (void)env;
+  evaluated->type = OBJ_STRING_BUILDER;
+  evaluated->builder_value = newStringBuilder(16, context);
+}
+
+// strings are appended as they are and other objects as they are printed,
+// the builder itself is evaluated so that appends can be chained
+void definedFunctionSbAppend(struct Object *op1, struct Object *op2,
+                             struct Object *evaluated) {
+  if (op1->type != OBJ_STRING_BUILDER) {
+    printf("Type error: sb-append first operand must be string-builder.\n");
+    exit(1);
+  }
+  if (op2->type == OBJ_STRING) {
+    appendStringBuilder(op1->builder_value, op2->string_value,
+                        stringLength(op2->string_value));
+  } else {
+    char *str = stringifyObject(op2);
+    appendStringBuilder(op1->builder_value, str, strlen(str));
+    free(str);
+  }
+  *evaluated = *op1;
+}
+
+// the builder keeps its contents and can be appended to further
+void definedFunctionSbBuild(struct Object *op, struct Object *evaluated) {
+  if (op->type != OBJ_STRING_BUILDER) {
+    printf("Type error: sb-build operand must be string-builder.\n");
+    exit(1);
+  }
+  evaluated->type = OBJ_STRING;
+  evaluated->string_value =
+      newString(op->builder_value->chars, op->builder_value->length);
+}
+
+void makeVector(struct Object **items, int count, struct Object *evaluated,
+                struct AllocatorContext *context) {
+  struct Vector *vector = newVector(count, context);
+  memcpy(vector->items, items, sizeof(struct Object *) * count);
+  vector->length = count;
+  evaluated->type = OBJ_VECTOR;
+  evaluated->vector_value = vector;
+}
+
+// the index operand of vector-ref and vector-set
+int vectorIndex(char *name, struct Object *vector, struct Object *index) {
+  if (vector->type != OBJ_VECTOR) {
+    printf("Type error: %s first operand must be vector.\n", name);
+    exit(1);
+  }
+  if (index->type != OBJ_INTEGER) {
+    printf("Type error: %s second operand must be integer.\n", name);
+    exit(1);
+  }
+  if (index->int_value < 0 || index->int_value >= vector->vector_value->length) {
+    printf("Index out of range.\n");
+    exit(1);
+  }
+  return index->int_value;
+}
+
+void definedFunctionVectorRef(struct Object *op1, struct Object *op2,
+                              struct Object *evaluated) {
+  int index = vectorIndex("vector-ref", op1, op2);
+  *evaluated = *op1->vector_value->items[index];
+}
+
+// op3 is an operand object of its own, so the vector keeps it
+void definedFunctionVectorSet(struct Object *op1, struct Object *op2,
+                              struct Object *op3, struct Object *evaluated) {
+  int index = vectorIndex("vector-set", op1, op2);
+  op1->vector_value->items[index] = op3;
+  *evaluated = *op3;
+}
+
+void definedFunctionVectorPush(struct Object *op1, struct Object *op2,
+                               struct Object *evaluated) {
+  if (op1->type != OBJ_VECTOR) {
+    printf("Type error: vector-push first operand must be vector.\n");
+    exit(1);
+  }
+  struct Vector *vector = op1->vector_value;
+  if (vector->length == vector->capacity) {
+    vector->capacity *= 2;
+    vector->items =
+        realloc(vector->items, sizeof(struct Object *) * vector->capacity);
+  }
+  vector->items[vector->length++] = op2;
+  *evaluated = *op2;
+}
+
+void definedFunctionVectorPop(struct Object *op, struct Object *evaluated) {
+  if (op->type != OBJ_VECTOR) {
+    printf("Type error: vector-pop operand must be vector.\n");
+    exit(1);
+  }
+  if (op->vector_value->length == 0) {
+    printf("vector-pop operand must not be empty.\n");
+    exit(1);
+  }
+  *evaluated = *op->vector_value->items[--op->vector_value->length];
+}
+
+void definedFunctionVectorLength(struct Object *op, struct Object *evaluated) {
+  if (op->type != OBJ_VECTOR) {
+    printf("Type error: vector-length operand must be vector.\n");
+    exit(1);
+  }
+  evaluated->type = OBJ_INTEGER;
+  evaluated->int_value = op->vector_value->length;
+}
+
+// integers are mixed with a multiplicative hash, strings hashed with FNV-1a
+// and other objects by identity like eq compares them
+uint64_t hashMapHash(struct Object *key) {
+  uint64_t hash;
+  if (key->type == OBJ_STRING) {
+    return stringHash(key->string_value);
+  } else if (key->type == OBJ_INTEGER) {
+    hash = (uint64_t)(uint32_t)key->int_value;
+  } else if (key->type == OBJ_BOOL) {
+    hash = key->bool_value;
+  } else if (key->type == OBJ_NIL) {
+    hash = 0;
+  } else if (key->type == OBJ_LIST) {
+    hash = (uintptr_t)key->list_value;
+  } else if (key->type == OBJ_VECTOR) {
+    hash = (uintptr_t)key->vector_value;
+  } else if (key->type == OBJ_HASHMAP) {
+    hash = (uintptr_t)key->hashmap_value;
+  } else if (key->type == OBJ_PVECTOR) {
+    hash = (uintptr_t)key->pvector_value;
+  } else if (key->type == OBJ_PHASH) {
+    hash = (uintptr_t)key->phash_value;
+  } else if (key->type == OBJ_STRING_BUILDER) {
+    hash = (uintptr_t)key->builder_value;
+  } else {
+    hash = (uintptr_t)key->function_value;
+  }
+  hash = (hash ^ key->type) * 0x9e3779b97f4a7c15ULL;
+  return hash ^ (hash >> 32);
+}
+
+bool isSameKey(struct Object *key1, struct Object *key2) {
+  if (key1->type == OBJ_FUNCTION && key2->type == OBJ_FUNCTION) {
+    return key1->function_value == key2->function_value;
+  }
+  return eq(key1, key2);
+}
+
+// the slot of key, or the empty slot it would be stored in
+int findHashMapSlot(struct HashMap *map, struct Object *key, uint64_t hash) {
+  int mask = map->capacity - 1;
+  int i = hash & mask;
+  while (map->entries[i].key != NULL &&
+         (map->entries[i].hash != hash || !isSameKey(map->entries[i].key, key))) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+void growHashMap(struct HashMap *map) {
+  struct HashMapEntry *entries = map->entries;
+  int capacity = map->capacity;
+  map->capacity *= 2;
+  map->entries = calloc(map->capacity, sizeof(struct HashMapEntry));
+  for (int i = 0; i < capacity; i++) {
+    if (entries[i].key != NULL) {
+      int slot = findHashMapSlot(map, entries[i].key, entries[i].hash);
+      map->entries[slot] = entries[i];
+    }
+  }
+  free(entries);
+}
+
+// stores value under key, both must be objects of the heap owned by the map
+void putHashMap(struct HashMap *map, struct Object *key, struct Object *value) {
+  // at most three quarters of the slots are used
+  if ((map->size + 1) * 4 > map->capacity * 3) {
+    growHashMap(map);
+  }
+  uint64_t hash = hashMapHash(key);
+  int slot = findHashMapSlot(map, key, hash);
+  if (map->entries[slot].key == NULL) {
+    map->entries[slot].key = key;
+    map->entries[slot].hash = hash;
+    map->size++;
+  }
+  map->entries[slot].value = value;
+}
+
+void checkHashMapOperand(char *name, struct Object *op) {
+  if (op->type != OBJ_HASHMAP) {
+    printf("Type error: %s first operand must be map.\n", name);
+    exit(1);
+  }
+}
+
+void definedFunctionMakeMap(struct Object *evaluated, struct Env *env,
+                            struct AllocatorContext *context) {
+  (void)env;
+  evaluated->type = OBJ_HASHMAP;
+  evaluated->hashmap_value = newHashMap(8, context);
+}
+
+// a missing key is evaluated as nil
+void definedFunctionMapGet(struct Object *op1, struct Object *op2,
+                           struct Object *evaluated) {
+  checkHashMapOperand("map-get", op1);
+  struct HashMap *map = op1->hashmap_value;
+  int slot = findHashMapSlot(map, op2, hashMapHash(op2));
+  if (map->entries[slot].key == NULL) {
+    evaluated->type = OBJ_NIL;
+  } else {
+    *evaluated = *map->entries[slot].value;
+  }
+}
+
+// op2 and op3 are operand objects of their own, so the map keeps them
+void definedFunctionMapSet(struct Object *op1, struct Object *op2,
+                           struct Object *op3, struct Object *evaluated) {
+  checkHashMapOperand("map-set", op1);
+  putHashMap(op1->hashmap_value, op2, op3);
+  *evaluated = *op3;
+}
+
+void definedFunctionMapHas(struct Object *op1, struct Object *op2,
+                           struct Object *evaluated) {
+  checkHashMapOperand("map-has", op1);
+  struct HashMap *map = op1->hashmap_value;
+  int slot = findHashMapSlot(map, op2, hashMapHash(op2));
+  evaluated->type = OBJ_BOOL;
+  evaluated->bool_value = map->entries[slot].key != NULL;
+}
+
+// evaluated to whether the key was present
+void definedFunctionMapDel(struct Object *op1, struct Object *op2,
+                           struct Object *evaluated) {
+  checkHashMapOperand("map-del", op1);
+  struct HashMap *map = op1->hashmap_value;
+  int mask = map->capacity - 1;
+  int hole = findHashMapSlot(map, op2, hashMapHash(op2));
+  evaluated->type = OBJ_BOOL;
+  evaluated->bool_value = map->entries[hole].key != NULL;
+  if (map->entries[hole].key == NULL) {
+    return;
+  }
+  map->size--;
+  // move back every following entry of the cluster that the hole would
+  // otherwise separate from its home slot
+  for (int i = (hole + 1) & mask; map->entries[i].key != NULL;
+       i = (i + 1) & mask) {
+    int home = map->entries[i].hash & mask;
+    bool reachable = hole <= i ? (hole < home && home <= i)
+                               : (hole < home || home <= i);
+    if (!reachable) {
+      map->entries[hole] = map->entries[i];
+      hole = i;
+    }
+  }
+  map->entries[hole].key = NULL;
+  map->entries[hole].value = NULL;
+}
+
+void definedFunctionMapKeys(struct Object *op, struct Object *evaluated,
+                            struct Env *env, struct AllocatorContext *context) {
+  checkHashMapOperand("map-keys", op);
+  struct HashMap *map = op->hashmap_value;
+  struct Object *head = allocate(context, env);
+  head->type = OBJ_NIL;
+  struct ConsCell *tail = NULL;
+  for (int i = 0; i < map->capacity; i++) {
+    if (map->entries[i].key != NULL) {
+      struct Object *key = allocate(context, env);
+      *key = *map->entries[i].key;
+      appendToList(head, &tail, key, env, context);
+    }
+  }
+  *evaluated = *head;
+}
+
+void definedFunctionMapSize(struct Object *op, struct Object *evaluated) {
+  checkHashMapOperand("map-size", op);
+  evaluated->type = OBJ_INTEGER;
+  evaluated->int_value = op->hashmap_value->size;
+}
+
+void makePVector(struct Object **items, int count, struct Object *evaluated,
+                 struct AllocatorContext *context) {
+  struct PVector *vector = newPVector(context);
+  for (int i = 0; i < count; i++) {
+    vector = assocPVector(vector, i, items[i], context);
+  }
+  evaluated->type = OBJ_PVECTOR;
+  evaluated->pvector_value = vector;
+}
+
+void checkPVectorOperand(char *name, struct Object *op) {
+  if (op->type != OBJ_PVECTOR) {
+    printf("Type error: %s first operand must be pvec.\n", name);
+    exit(1);
+  }
+}
+
+// the index operand of pvec-ref and pvec-assoc, pvec-assoc also accepts the
+// count to append
+int pvectorIndex(char *name, struct Object *vector, struct Object *index,
+                 int end) {
+  checkPVectorOperand(name, vector);
+  if (index->type != OBJ_INTEGER) {
+    printf("Type error: %s second operand must be integer.\n", name);
+    exit(1);
+  }
+  if (index->int_value < 0 || index->int_value >= end) {
+    printf("Index out of range.\n");
+    exit(1);
+  }
+  return index->int_value;
+}
+
+// op2 is an operand object of its own, so the new version keeps it
+void definedFunctionPvecConj(struct Object *op1, struct Object *op2,
+                             struct Object *evaluated, struct Env *env,
+                             struct AllocatorContext *context) {
+  (void)env;
+  checkPVectorOperand("pvec-conj", op1);
+  struct PVector *vector = op1->pvector_value;
+  evaluated->type = OBJ_PVECTOR;
+  evaluated->pvector_value = assocPVector(vector, vector->count, op2, context);
+}
+
+void definedFunctionPvecAssoc(struct Object *op1, struct Object *op2,
+                              struct Object *op3, struct Object *evaluated,
+                              struct Env *env,
+                              struct AllocatorContext *context) {
+  (void)env;
+  int index = pvectorIndex("pvec-assoc", op1, op2,
+                           op1->type == OBJ_PVECTOR
+                               ? op1->pvector_value->count + 1
+                               : 0);
+  struct PVector *vector = op1->pvector_value;
+  evaluated->type = OBJ_PVECTOR;
+  evaluated->pvector_value = assocPVector(vector, index, op3, context);
+}
+
+void definedFunctionPvecRef(struct Object *op1, struct Object *op2,
+                            struct Object *evaluated) {
+  int index = pvectorIndex("pvec-ref", op1, op2,
+                           op1->type == OBJ_PVECTOR
+                               ? op1->pvector_value->count
+                               : 0);
+  *evaluated = *pvectorItem(op1->pvector_value, index);
+}
+
+void definedFunctionPvecCount(struct Object *op, struct Object *evaluated) {
+  checkPVectorOperand("pvec-count", op);
+  evaluated->type = OBJ_INTEGER;
+  evaluated->int_value = op->pvector_value->count;
+}
+
+void checkPHashOperand(char *name, struct Object *op) {
+  if (op->type != OBJ_PHASH) {
+    printf("Type error: %s first operand must be phash.\n", name);
+    exit(1);
+  }
+}
+
+void definedFunctionMakePhash(struct Object *evaluated, struct Env *env,
+                              struct AllocatorContext *context) {
+  (void)env;
+  evaluated->type = OBJ_PHASH;
+  evaluated->phash_value = newPHash(context);
+}
+
+// op2 and op3 are operand objects of their own, so the new version keeps
+// them
+void definedFunctionPhashAssoc(struct Object *op1, struct Object *op2,
+                               struct Object *op3, struct Object *evaluated,
+                               struct Env *env,
+                               struct AllocatorContext *context) {
+  (void)env;
+  checkPHashOperand("phash-assoc", op1);
+  evaluated->type = OBJ_PHASH;
+  evaluated->phash_value = assocPHash(op1->phash_value, op2, op3, context);
+}
+
+void definedFunctionPhashDissoc(struct Object *op1, struct Object *op2,
+                                struct Object *evaluated, struct Env *env,
+                                struct AllocatorContext *context) {
+  (void)env;
+  checkPHashOperand("phash-dissoc", op1);
+  struct PHash *map = op1->phash_value;
+  bool removed = false;
+  struct PHashNode *root =
+      map->root == NULL
+          ? NULL
+          : dissocPHashNode(map->root, 0, op2, hashMapHash(op2), &removed,
+                            context);
+  // the same version when the key is not present
+  if (!removed) {
+    *evaluated = *op1;
+    return;
+  }
+  struct PHash *result = newPHash(context);
+  result->root = root;
+  result->count = map->count - 1;
+  evaluated->type = OBJ_PHASH;
+  evaluated->phash_value = result;
+}
+
+// a missing key is evaluated as nil
+void definedFunctionPhashGet(struct Object *op1, struct Object *op2,
+                             struct Object *evaluated) {
+  checkPHashOperand("phash-get", op1);
+  struct PHashEntry *entry =
+      findPHashEntry(op1->phash_value->root, op2, hashMapHash(op2));
+  if (entry == NULL) {
+    evaluated->type = OBJ_NIL;
+  } else {
+    *evaluated = *entry->value;
+  }
+}
+
+void definedFunctionPhashHas(struct Object *op1, struct Object *op2,
+                             struct Object *evaluated) {
+  checkPHashOperand("phash-has", op1);
+  evaluated->type = OBJ_BOOL;
+  evaluated->bool_value =
+      findPHashEntry(op1->phash_value->root, op2, hashMapHash(op2)) != NULL;
+}
+
+void definedFunctionPhashCount(struct Object *op, struct Object *evaluated) {
+  checkPHashOperand("phash-count", op);
+  evaluated->type = OBJ_INTEGER;
+  evaluated->int_value = op->phash_value->count;
+}
+
+void definedFunctionPhashKeys(struct Object *op, struct Object *evaluated,
+                              struct Env *env,
+                              struct AllocatorContext *context) {
+  checkPHashOperand("phash-keys", op);
+  struct PHash *map = op->phash_value;
+  struct PHashEntry **entries =
+      malloc(sizeof(struct PHashEntry *) * (map->count + 1));
+  int count = 0;
+  collectPHashEntries(map->root, entries, &count);
+  struct Object *head = allocate(context, env);
+  head->type = OBJ_NIL;
+  struct ConsCell *tail = NULL;
+  for (int i = 0; i < count; i++) {
+    struct Object *key = allocate(context, env);
+    *key = *entries[i]->key;
+    appendToList(head, &tail, key, env, context);
+  }
+  free(entries);
+  *evaluated = *head;
+}
+
+// map, filter, reduce and for-each call a user function per element
+void checkFunctionOperand(char *name, struct Object *op, int arity) {
+  if (op->type != OBJ_FUNCTION) {
+    printf("Type error: %s first operand must be function.\n", name);
+    exit(1);
+  }
+  if (op->function_value->arity != arity) {
+    printf("Arity error: function passed to %s must take %d arguments.\n",
+           name, arity);
+    exit(1);
+  }
+}
+
+void checkListOperand(char *name, struct Object *op) {
+  if (op->type != OBJ_LIST && op->type != OBJ_NIL) {
+    printf("Type error: %s list operand must be list.\n", name);
+    exit(1);
+  }
+}
+
+// every argument is copied to an object of its own, the callee can update
+// its parameters in place
+void applyFunction(struct Function *function, struct Object **args,
+                   struct Object *evaluated, struct Env *env,
+                   struct AllocatorContext *context) {
+  struct Binding frame[function->frame_size > 0 ? function->frame_size : 1];
+  for (int i = 0; i < function->arity; i++) {
+    struct Object *param = allocate(context, env);
+    *param = *args[i];
+    frame[i].symbol_name = function->param_symbol_names[i];
+    frame[i].value = param;
+  }
+  invokeFunction(function, frame, evaluated, env, context);
+}
+
+// appends item to the list of head in O(1), tail is its last cell
+void appendToList(struct Object *head, struct ConsCell **tail,
+                  struct Object *item, struct Env *env,
+                  struct AllocatorContext *context) {
+  struct ConsCell *conscell = newConsCell();
+  conscell->type = CONSCELL_TYPE_NIL;
+  conscell->car = item;
+  if (*tail == NULL) {
+    conscell->cdr = allocate(context, env);
+    conscell->cdr->type = OBJ_NIL;
+    attachListHeader(conscell, conscell, 1);
+    head->type = OBJ_LIST;
+    head->list_value = conscell;
+  } else {
+    // the terminating nil moves to the new last cell
+    conscell->cdr = (*tail)->cdr;
+    conscell->prev = *tail;
+    struct Object *link = allocate(context, env);
+    link->type = OBJ_LIST;
+    link->list_value = conscell;
+    (*tail)->type = CONSCELL_TYPE_CELL;
+    (*tail)->cdr = link;
+    head->list_value->header->tail = conscell;
+    head->list_value->header->length++;
+  }
+  *tail = conscell;
+}
+
+// the result is built behind a tail pointer, objects of an element are
+// reachable from head once it is appended, so the stack is reset per element
+void definedFunctionMap(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated, struct Env *env,
+                        struct AllocatorContext *context) {
+  checkFunctionOperand("map", op1, 1);
+  checkListOperand("map", op2);
+  struct Object *head = allocate(context, env);
+  head->type = OBJ_NIL;
+  struct ConsCell *tail = NULL;
+  int top = context->stack->top;
+  for (struct Object *cursor = op2; cursor->type == OBJ_LIST;
+       cursor = cursor->list_value->cdr) {
+    context->stack->top = top;
+    struct Object *item = allocate(context, env);
+    applyFunction(op1->function_value, &cursor->list_value->car, item, env,
+                  context);
+    appendToList(head, &tail, item, env, context);
+  }
+  context->stack->top = top;
+  *evaluated = *head;
+}
+
+void definedFunctionFilter(struct Object *op1, struct Object *op2,
+                           struct Object *evaluated, struct Env *env,
+                           struct AllocatorContext *context) {
+  checkFunctionOperand("filter", op1, 1);
+  checkListOperand("filter", op2);
+  struct Object *head = allocate(context, env);
+  head->type = OBJ_NIL;
+  struct ConsCell *tail = NULL;
+  int top = context->stack->top;
+  for (struct Object *cursor = op2; cursor->type == OBJ_LIST;
+       cursor = cursor->list_value->cdr) {
+    context->stack->top = top;
+    struct Object keep = (struct Object){};
+    applyFunction(op1->function_value, &cursor->list_value->car, &keep, env,
+                  context);
+    if (boolVal(&keep)) {
+      // elements of a constant list live outside of the heap
+      struct Object *item = allocate(context, env);
+      *item = *cursor->list_value->car;
+      appendToList(head, &tail, item, env, context);
+    }
+  }
+  context->stack->top = top;
+  *evaluated = *head;
+}
+
+// (reduce f init list) calls (f accumulated element) from the left
+void definedFunctionReduce(struct Object *op1, struct Object *op2,
+                           struct Object *op3, struct Object *evaluated,
+                           struct Env *env, struct AllocatorContext *context) {
+  checkFunctionOperand("reduce", op1, 2);
+  checkListOperand("reduce", op3);
+  struct Object *accumulated = allocate(context, env);
+  *accumulated = *op2;
+  int top = context->stack->top;
+  for (struct Object *cursor = op3; cursor->type == OBJ_LIST;
+       cursor = cursor->list_value->cdr) {
+    context->stack->top = top;
+    // the arguments are copied before the result is written
+    struct Object *args[2] = {accumulated, cursor->list_value->car};
+    applyFunction(op1->function_value, args, accumulated, env, context);
+  }
+  context->stack->top = top;
+  *evaluated = *accumulated;
+}
+
+void definedFunctionForEach(struct Object *op1, struct Object *op2,
+                            struct Object *evaluated, struct Env *env,
+                            struct AllocatorContext *context) {
+  checkFunctionOperand("for-each", op1, 1);
+  checkListOperand("for-each", op2);
+  int top = context->stack->top;
+  for (struct Object *cursor = op2; cursor->type == OBJ_LIST;
+       cursor = cursor->list_value->cdr) {
+    context->stack->top = top;
+    struct Object result = (struct Object){};
+    applyFunction(op1->function_value, &cursor->list_value->car, &result, env,
+                  context);
+  }
+  evaluated->type = OBJ_NIL;
+}
+
+// =================================================
+//   parallel map
+// =================================================
+
+// (pmap f list) is map with the calls spread over threads. Each thread has
+// an allocator of its own and steals elements from the others when it runs
+// out, and the results are copied to the heap of the caller in order.
+
+bool parallel_evaluation = false;
+int pmap_thread_count = 0;
+
+// the elements a thread has left, the owner takes from the front and thieves
+// take the back half
+struct PmapQueue {
+  pthread_mutex_t mutex;
+  int next;
+  int end;
+};
+
+struct PmapTask {
+  struct Function *function;
+  struct Object **items;
+  struct Object **results;
+  struct Env *env;
+  struct PmapQueue *queues;
+  int thread_count;
+};
+
+struct PmapWorker {
+  pthread_t thread;
+  int index;
+  struct PmapTask *task;
+  struct AllocatorContext *context;
+};
+
+bool takePmapItem(struct PmapTask *task, int self, int *index) {
+  struct PmapQueue *queue = &task->queues[self];
+  pthread_mutex_lock(&queue->mutex);
+  if (queue->next < queue->end) {
+    *index = queue->next++;
+    pthread_mutex_unlock(&queue->mutex);
+    return true;
+  }
+  pthread_mutex_unlock(&queue->mutex);
+
+  for (int i = 1; i < task->thread_count; i++) {
+    struct PmapQueue *victim =
+        &task->queues[(self + i) % task->thread_count];
+    pthread_mutex_lock(&victim->mutex);
+    int stolen = (victim->end - victim->next + 1) / 2;
+    if (stolen > 0) {
+      victim->end -= stolen;
+      int start = victim->end;
+      pthread_mutex_unlock(&victim->mutex);
+      // the first stolen element is taken now
+      pthread_mutex_lock(&queue->mutex);
+      queue->next = start + 1;
+      queue->end = start + stolen;
+      pthread_mutex_unlock(&queue->mutex);
+      *index = start;
+      return true;
+    }
+    pthread_mutex_unlock(&victim->mutex);
+  }
+  return false;
+}
+
+void runPmapItem(struct PmapWorker *worker, int index) {
+  struct PmapTask *task = worker->task;
+  struct AllocatorContext *context = worker->context;
+  // results stay on the stack of the thread until they are copied
+  struct Object *result = allocate(context, task->env);
+  int top = context->stack->top;
+  applyFunction(task->function, &task->items[index], result, task->env,
+                context);
+  context->stack->top = top;
+  task->results[index] = result;
+}
+
+void *runPmapWorker(void *arg) {
+  struct PmapWorker *worker = arg;
+  int index;
+  while (takePmapItem(worker->task, worker->index, &index)) {
+    runPmapItem(worker, index);
+  }
+  return NULL;
+}
+
+// copies an object of another heap to the heap of context
+struct Object *copyObject(struct Object *source, struct Env *env,
+                          struct AllocatorContext *context) {
+  struct Object *copy = allocate(context, env);
+  if (source->type == OBJ_VECTOR) {
+    struct Vector *vector = newVector(source->vector_value->length, context);
+    copy->type = OBJ_VECTOR;
+    copy->vector_value = vector;
+    for (int i = 0; i < source->vector_value->length; i++) {
+      vector->items[vector->length++] =
+          copyObject(source->vector_value->items[i], env, context);
+    }
+    return copy;
+  }
+  if (source->type == OBJ_PVECTOR) {
+    copy->type = OBJ_PVECTOR;
+    copy->pvector_value = newPVector(context);
+    for (int i = 0; i < source->pvector_value->count; i++) {
+      struct Object *item =
+          copyObject(pvectorItem(source->pvector_value, i), env, context);
+      copy->pvector_value = assocPVector(copy->pvector_value, i, item, context);
+    }
+    return copy;
+  }
+  if (source->type == OBJ_PHASH) {
+    struct PHash *map = source->phash_value;
+    struct PHashEntry **entries =
+        malloc(sizeof(struct PHashEntry *) * (map->count + 1));
+    int count = 0;
+    collectPHashEntries(map->root, entries, &count);
+    copy->type = OBJ_PHASH;
+    copy->phash_value = newPHash(context);
+    for (int i = 0; i < count; i++) {
+      struct Object *key = copyObject(entries[i]->key, env, context);
+      struct Object *value = copyObject(entries[i]->value, env, context);
+      copy->phash_value = assocPHash(copy->phash_value, key, value, context);
+    }
+    free(entries);
+    return copy;
+  }
+  if (source->type == OBJ_STRING_BUILDER) {
+    struct StringBuilder *builder =
+        newStringBuilder(source->builder_value->capacity, context);
+    appendStringBuilder(builder, source->builder_value->chars,
+                        source->builder_value->length);
+    copy->type = OBJ_STRING_BUILDER;
+    copy->builder_value = builder;
+    return copy;
+  }
+  if (source->type == OBJ_HASHMAP) {
+    struct HashMap *map = newHashMap(source->hashmap_value->capacity, context);
+    copy->type = OBJ_HASHMAP;
+    copy->hashmap_value = map;
+    for (int i = 0; i < map->capacity; i++) {
+      struct HashMapEntry *entry = &source->hashmap_value->entries[i];
+      if (entry->key != NULL) {
+        putHashMap(map, copyObject(entry->key, env, context),
+                   copyObject(entry->value, env, context));
+      }
+    }
+    return copy;
+  }
+  if (source->type != OBJ_LIST || source->list_value->constant) {
+    *copy = *source;
+    return copy;
+  }
+  copy->type = OBJ_NIL;
+  struct ConsCell *tail = NULL;
+  for (struct Object *cursor = source; cursor->type == OBJ_LIST;
+       cursor = cursor->list_value->cdr) {
+    struct Object *item = copyObject(cursor->list_value->car, env, context);
+    appendToList(copy, &tail, item, env, context);
+  }
+  return copy;
+}
+
+void definedFunctionPmap(struct Object *op1, struct Object *op2,
+                         struct Object *evaluated, struct Env *env,
+                         struct AllocatorContext *context) {
+  checkFunctionOperand("pmap", op1, 1);
+  checkListOperand("pmap", op2);
+  int thread_count = pmap_thread_count > 0
+                         ? pmap_thread_count
+                         : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int count = 0;
+  for (struct Object *cursor = op2; cursor->type == OBJ_LIST;
+       cursor = cursor->list_value->cdr) {
+    count++;
+  }
+  if (thread_count > count) {
+    thread_count = count;
+  }
+  // pmap in a thread of pmap runs in that thread
+  if (parallel_evaluation || thread_count <= 1) {
+    definedFunctionMap(op1, op2, evaluated, env, context);
+    return;
+  }
+
+  struct PmapTask task;
+  task.function = op1->function_value;
+  task.items = malloc(sizeof(struct Object *) * count);
+  task.results = malloc(sizeof(struct Object *) * count);
+  task.env = env;
+  task.queues = malloc(sizeof(struct PmapQueue) * thread_count);
+  task.thread_count = thread_count;
+  int i = 0;
+  for (struct Object *cursor = op2; cursor->type == OBJ_LIST;
+       cursor = cursor->list_value->cdr) {
+    task.items[i++] = cursor->list_value->car;
+  }
+  struct PmapWorker *workers =
+      malloc(sizeof(struct PmapWorker) * thread_count);
+  for (i = 0; i < thread_count; i++) {
+    pthread_mutex_init(&task.queues[i].mutex, NULL);
+    task.queues[i].next = (int)((long)count * i / thread_count);
+    task.queues[i].end = (int)((long)count * (i + 1) / thread_count);
+    workers[i].index = i;
+    workers[i].task = &task;
+    workers[i].context = initAllocator();
+  }
+
+  // the first element is mapped alone so that the code is specialized and
+  // its call sites are cached before the threads share it
+  runPmapItem(&workers[0], task.queues[0].next++);
+
+  // the calling thread is worker 0
+  parallel_evaluation = true;
+  for (i = 1; i < thread_count; i++) {
+    pthread_create(&workers[i].thread, NULL, runPmapWorker, &workers[i]);
+  }
+  runPmapWorker(&workers[0]);
+  for (i = 1; i < thread_count; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  parallel_evaluation = false;
+  // the callees may have rebound functions while caches were not kept
+  function_binding_version++;
+
+  struct Object *head = allocate(context, env);
+  head->type = OBJ_NIL;
+  struct ConsCell *tail = NULL;
+  int top = context->stack->top;
+  for (i = 0; i < count; i++) {
+    context->stack->top = top;
+    struct Object *item = copyObject(task.results[i], env, context);
+    appendToList(head, &tail, item, env, context);
+  }
+  context->stack->top = top;
+  *evaluated = *head;
+
+  for (i = 0; i < thread_count; i++) {
+    pthread_mutex_destroy(&task.queues[i].mutex);
+    freeAllocator(workers[i].context);
+  }
+  free(workers);
+  free(task.queues);
+  free(task.results);
+  free(task.items);
+}
+
+// =================================================
+//   JIT
+// =================================================
+
+// A hot function is compiled to x86-64 when its body only uses integer and
+// boolean literals, its parameters, if, progn, &&, ||, not, + - * < > eq and
+// calls of functions that can be compiled too. Such code has no side effects
+// and cannot fail, so a call whose arguments are not integers, or whose
+// callees were rebound, is evaluated by the interpreter instead.
+
+int jit_call_threshold = 0;
+
+#define JIT_REGION_SIZE (1024 * 1024)
+
+// executable memory, every function gets its own pages
+struct JitRegion {
+  uint8_t *base;
+  size_t size;
+  size_t used;
+};
+
+struct JitRegion jit_region = {NULL, 0, 0};
+
+struct JitBuffer {
+  uint8_t *code;
+  size_t size;
+  size_t capacity;
+};
+
+struct JitCompiler {
+  struct Function *function;
+  struct Env *env;
+  struct JitDependency *dependencies;
+  int dependency_count;
+  struct JitBuffer buffer;
+};
+
+typedef int (*JitEntry)(int, int, int, int, int, int);
+
+// the forms evaluateSymbolicExpression handles itself, every other builtin
+// is in compiled_builtins
+char *special_forms[] = {"if", "while", "=", "defun", "&&", "||", "progn",
+                         "dotimes", "dolist", "vector", "pvec", "push", NULL};
+
+int countOperands(struct ExpressionList *operands);
+bool isSymbolNamed(struct ExpressionNode *expression, char *name);
+struct ExpressionList *loopSpecification(struct ExpressionList *operands);
+void jitCompile(struct Function *function, struct Env *env);
+
+int jitParamIndex(struct Function *function, char *name) {
+  for (int i = 0; i < function->arity; i++) {
+    if (strcmp(function->param_symbol_names[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// returns false if the name already refers to another function
+bool addJitDependency(struct JitCompiler *compiler, char *name,
+                      struct Function *function) {
+  for (int i = 0; i < compiler->dependency_count; i++) {
+    if (strcmp(compiler->dependencies[i].name, name) == 0) {
+      return compiler->dependencies[i].function == function;
+    }
+  }
+  compiler->dependencies =
+      realloc(compiler->dependencies, sizeof(struct JitDependency) *
+                                          (compiler->dependency_count + 1));
+  compiler->dependencies[compiler->dependency_count++] =
+      (struct JitDependency){name, function};
+  return true;
+}
+
+struct Function *findJitDependency(struct JitCompiler *compiler, char *name) {
+  for (int i = 0; i < compiler->dependency_count; i++) {
+    if (strcmp(compiler->dependencies[i].name, name) == 0) {
+      return compiler->dependencies[i].function;
+    }
+  }
+  return NULL;
+}
+
+// type of the value of a compilable expression, OBJ_NIL when it cannot be
+// compiled
+ObjectType jitCheck(struct JitCompiler *compiler,
+                    struct ExpressionNode *expression) {
+  if (expression->type == EXP_LITERAL) {
+    if (expression->data.literal->type == LIT_INTERGER) {
+      return OBJ_INTEGER;
+    } else if (expression->data.literal->type == LIT_BOOLEAN) {
+      return OBJ_BOOL;
+    }
+    return OBJ_NIL;
+  } else if (expression->type == EXP_SYMBOL) {
+    // parameters are the only variables, they are integers
+    if (jitParamIndex(compiler->function,
+                      expression->data.symbol->symbol_name) >= 0) {
+      return OBJ_INTEGER;
+    }
+    return OBJ_NIL;
+  } else if (expression->type != EXP_SYMBOLIC_EXP) {
+    return OBJ_NIL;
+  }
+
+  struct ExpressionList *expressions =
+      expression->data.symbolic_exp->expressions;
+  if (expressions == NULL || expressions->expression->type != EXP_SYMBOL) {
+    return OBJ_NIL;
+  }
+  char *name = expressions->expression->data.symbol->symbol_name;
+  struct ExpressionList *operands = expressions->next;
+  int count = countOperands(operands);
+
+  if (strcmp(name, "if") == 0) {
+    if (count != 3) {
+      return OBJ_NIL;
+    }
+    ObjectType cond = jitCheck(compiler, operands->expression);
+    ObjectType then = jitCheck(compiler, operands->next->expression);
+    ObjectType els = jitCheck(compiler, operands->next->next->expression);
+    if (cond == OBJ_NIL || then != els) {
+      return OBJ_NIL;
+    }
+    return then;
+  } else if (strcmp(name, "+") == 0 || strcmp(name, "-") == 0 ||
+             strcmp(name, "*") == 0 || strcmp(name, "<") == 0 ||
+             strcmp(name, ">") == 0 || strcmp(name, "eq") == 0) {
+    if (count != 2) {
+      return OBJ_NIL;
+    }
+    ObjectType type1 = jitCheck(compiler, operands->expression);
+    ObjectType type2 = jitCheck(compiler, operands->next->expression);
+    if (strcmp(name, "eq") == 0) {
+      return type1 != OBJ_NIL && type1 == type2 ? OBJ_BOOL : OBJ_NIL;
+    }
+    if (type1 != OBJ_INTEGER || type2 != OBJ_INTEGER) {
+      return OBJ_NIL;
+    }
+    return name[0] == '<' || name[0] == '>' ? OBJ_BOOL : OBJ_INTEGER;
+  } else if (strcmp(name, "not") == 0) {
+    if (count != 1 || jitCheck(compiler, operands->expression) != OBJ_BOOL) {
+      return OBJ_NIL;
+    }
+    return OBJ_BOOL;
+  } else if (strcmp(name, "&&") == 0 || strcmp(name, "||") == 0 ||
+             strcmp(name, "progn") == 0) {
+    ObjectType type = OBJ_NIL;
+    for (; operands != NULL; operands = operands->next) {
+      type = jitCheck(compiler, operands->expression);
+      if (type == OBJ_NIL) {
+        return OBJ_NIL;
+      }
+    }
+    // the value of an empty progn is nil
+    return name[0] == 'p' ? type : OBJ_BOOL;
+  } else if (isBuiltinName(name) ||
+             jitParamIndex(compiler->function, name) >= 0) {
+    return OBJ_NIL;
+  }
+
+  // call of a defined function, compiled code calls the function of the
+  // global env and jitCall checks that no frame shadows it
+  struct Binding *binding = lookupLocalBinding(globalEnv(compiler->env), name);
+  if (binding == NULL || binding->value->type != OBJ_FUNCTION) {
+    return OBJ_NIL;
+  }
+  struct Function *callee = binding->value->function_value;
+  if (callee->arity != count) {
+    return OBJ_NIL;
+  }
+  for (; operands != NULL; operands = operands->next) {
+    if (jitCheck(compiler, operands->expression) != OBJ_INTEGER) {
+      return OBJ_NIL;
+    }
+  }
+  if (callee != compiler->function) {
+    if (callee->jit_state == JIT_NONE) {
+      jitCompile(callee, compiler->env);
+    }
+    if (callee->jit_state != JIT_COMPILED) {
+      return OBJ_NIL;
+    }
+    // the names the callee calls are resolved from the same env
+    for (int i = 0; i < callee->jit_dependency_count; i++) {
+      if (!addJitDependency(compiler, callee->jit_dependencies[i].name,
+                            callee->jit_dependencies[i].function)) {
+        return OBJ_NIL;
+      }
+    }
+  }
+  if (!addJitDependency(compiler, name, callee)) {
+    return OBJ_NIL;
+  }
+  return callee->jit_return_type;
+}
+
+void emitBytes(struct JitBuffer *buffer, uint8_t *bytes, size_t size) {
+  if (buffer->size + size > buffer->capacity) {
+    buffer->capacity = buffer->capacity == 0 ? 256 : buffer->capacity * 2;
+    buffer->code = realloc(buffer->code, buffer->capacity);
+  }
+  memcpy(&buffer->code[buffer->size], bytes, size);
+  buffer->size += size;
+}
+
+void emitInt32(struct JitBuffer *buffer, int32_t value) {
+  emitBytes(buffer, (uint8_t *)&value, sizeof(value));
+}
+
+// emits a jump and returns the offset of its displacement
+size_t emitJump(struct JitBuffer *buffer, uint8_t *opcode, size_t size) {
+  emitBytes(buffer, opcode, size);
+  emitInt32(buffer, 0);
+  return buffer->size - 4;
+}
+
+// makes the jump at offset land on the end of the buffer
+void patchJump(struct JitBuffer *buffer, size_t offset) {
+  int32_t displacement = buffer->size - (offset + 4);
+  memcpy(&buffer->code[offset], &displacement, sizeof(displacement));
+}
+
+// mov eax, value
+void emitLoadImmediate(struct JitBuffer *buffer, int value) {
+  emitBytes(buffer, (uint8_t[]){0xB8}, 1);
+  emitInt32(buffer, value);
+}
+
+// the value of every expression is left in eax, integers wrap around like
+// the int arithmetic of the interpreter
+void jitEmit(struct JitCompiler *compiler, struct ExpressionNode *expression) {
+  struct JitBuffer *buffer = &compiler->buffer;
+  if (expression->type == EXP_LITERAL) {
+    emitLoadImmediate(buffer, expression->data.literal->type == LIT_INTERGER
+                                  ? expression->data.literal->int_value
+                                  : expression->data.literal->boolean_value);
+    return;
+  } else if (expression->type == EXP_SYMBOL) {
+    // mov eax, [rbp - 8 * (index + 1)]
+    int index = jitParamIndex(compiler->function,
+                              expression->data.symbol->symbol_name);
+    emitBytes(buffer, (uint8_t[]){0x8B, 0x45, (uint8_t)(-8 * (index + 1))},
+              3);
+    return;
+  }
+
+  struct ExpressionList *expressions =
+      expression->data.symbolic_exp->expressions;
+  char *name = expressions->expression->data.symbol->symbol_name;
+  struct ExpressionList *operands = expressions->next;
+
+  if (strcmp(name, "if") == 0) {
+    // an integer condition is always true, and evaluating it has no effect
+    if (jitCheck(compiler, operands->expression) == OBJ_INTEGER) {
+      jitEmit(compiler, operands->next->expression);
+      return;
+    }
+    jitEmit(compiler, operands->expression);
+    // test eax, eax; je else
+    emitBytes(buffer, (uint8_t[]){0x85, 0xC0}, 2);
+    size_t to_else = emitJump(buffer, (uint8_t[]){0x0F, 0x84}, 2);
+    jitEmit(compiler, operands->next->expression);
+    size_t to_end = emitJump(buffer, (uint8_t[]){0xE9}, 1);
+    patchJump(buffer, to_else);
+    jitEmit(compiler, operands->next->next->expression);
+    patchJump(buffer, to_end);
+  } else if (strcmp(name, "+") == 0 || strcmp(name, "-") == 0 ||
+             strcmp(name, "*") == 0 || strcmp(name, "<") == 0 ||
+             strcmp(name, ">") == 0 || strcmp(name, "eq") == 0) {
+    // eax = operand 1, ecx = operand 2
+    jitEmit(compiler, operands->expression);
+    emitBytes(buffer, (uint8_t[]){0x50}, 1);
+    jitEmit(compiler, operands->next->expression);
+    emitBytes(buffer, (uint8_t[]){0x89, 0xC1, 0x58}, 3);
+    if (name[0] == '+') {
+      emitBytes(buffer, (uint8_t[]){0x01, 0xC8}, 2);
+    } else if (name[0] == '-') {
+      emitBytes(buffer, (uint8_t[]){0x29, 0xC8}, 2);
+    } else if (name[0] == '*') {
+      emitBytes(buffer, (uint8_t[]){0x0F, 0xAF, 0xC1}, 3);
+    } else {
+      // cmp eax, ecx; setcc al; movzx eax, al
+      uint8_t setcc = name[0] == '<' ? 0x9C : name[0] == '>' ? 0x9F : 0x94;
+      emitBytes(buffer,
+                (uint8_t[]){0x39, 0xC8, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0},
+                8);
+    }
+  } else if (strcmp(name, "not") == 0) {
+    jitEmit(compiler, operands->expression);
+    // xor eax, 1
+    emitBytes(buffer, (uint8_t[]){0x83, 0xF0, 0x01}, 3);
+  } else if (strcmp(name, "&&") == 0 || strcmp(name, "||") == 0) {
+    bool is_or = name[0] == '|';
+    size_t jumps[countOperands(operands) + 1];
+    int jump_count = 0;
+    for (; operands != NULL; operands = operands->next) {
+      if (jitCheck(compiler, operands->expression) == OBJ_INTEGER) {
+        // an integer is true, it decides || and is skipped by &&
+        if (is_or) {
+          jumps[jump_count++] = emitJump(buffer, (uint8_t[]){0xE9}, 1);
+          break;
+        }
+        continue;
+      }
+      jitEmit(compiler, operands->expression);
+      // test eax, eax; jne or je
+      emitBytes(buffer, (uint8_t[]){0x85, 0xC0}, 2);
+      jumps[jump_count++] =
+          emitJump(buffer, (uint8_t[]){0x0F, is_or ? 0x85 : 0x84}, 2);
+    }
+    emitLoadImmediate(buffer, !is_or);
+    size_t to_end = emitJump(buffer, (uint8_t[]){0xE9}, 1);
+    for (int i = 0; i < jump_count; i++) {
+      patchJump(buffer, jumps[i]);
+    }
+    emitLoadImmediate(buffer, is_or);
+    patchJump(buffer, to_end);
+  } else if (strcmp(name, "progn") == 0) {
+    // only the last expression has an effect
+    while (operands->next != NULL) {
+      operands = operands->next;
+    }
+    jitEmit(compiler, operands->expression);
+  } else {
+    // push every argument, then pop them into rdi, rsi, rdx, rcx, r8 and r9
+    int count = 0;
+    for (; operands != NULL; operands = operands->next) {
+      jitEmit(compiler, operands->expression);
+      emitBytes(buffer, (uint8_t[]){0x50}, 1);
+      count++;
+    }
+    uint8_t pops[JIT_MAX_ARITY][2] = {{0x5F}, {0x5E}, {0x5A},
+                                      {0x59}, {0x41, 0x58}, {0x41, 0x59}};
+    for (int i = count - 1; i >= 0; i--) {
+      emitBytes(buffer, pops[i], i < 4 ? 1 : 2);
+    }
+    struct Function *callee = findJitDependency(compiler, name);
+    if (callee == compiler->function) {
+      // call rel32 to the start of this function
+      emitBytes(buffer, (uint8_t[]){0xE8}, 1);
+      emitInt32(buffer, -(int32_t)(buffer->size + 4));
+    } else {
+      // mov rax, imm64; call rax
+      emitBytes(buffer, (uint8_t[]){0x48, 0xB8}, 2);
+      emitBytes(buffer, (uint8_t *)&callee->jit_code, sizeof(void *));
+      emitBytes(buffer, (uint8_t[]){0xFF, 0xD0}, 2);
+    }
+  }
+}
+
+// copies the code to executable memory, returns NULL on failure
+void *installJitCode(struct JitBuffer *buffer) {
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t size = (buffer->size + page_size - 1) / page_size * page_size;
+  if (jit_region.base == NULL || jit_region.used + size > jit_region.size) {
+    size_t region_size = size > JIT_REGION_SIZE ? size : JIT_REGION_SIZE;
+    void *base = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      return NULL;
+    }
+    // the rest of the previous region is abandoned
+    jit_region = (struct JitRegion){base, region_size, 0};
+  }
+  uint8_t *code = jit_region.base + jit_region.used;
+  memcpy(code, buffer->code, buffer->size);
+  // the pages are never written again
+  if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+    return NULL;
+  }
+  jit_region.used += size;
+  return code;
+}
+
+void jitCompile(struct Function *function, struct Env *env) {
+#if defined(__x86_64__)
+  if (function->arity > JIT_MAX_ARITY || function->body == NULL) {
+    function->jit_state = JIT_FAILED;
+    return;
+  }
+  function->jit_state = JIT_COMPILING;
+  struct JitCompiler compiler =
+      (struct JitCompiler){function, env, NULL, 0, {NULL, 0, 0}};
+
+  // recursive calls have the type the body is checked against
+  ObjectType return_types[] = {OBJ_INTEGER, OBJ_BOOL};
+  bool compilable = false;
+  for (int i = 0; i < 2 && !compilable; i++) {
+    function->jit_return_type = return_types[i];
+    compiler.dependency_count = 0;
+    compilable = jitCheck(&compiler, function->body) == return_types[i];
+  }
+  // a parameter would shadow a function called by the compiled code
+  for (int i = 0; compilable && i < compiler.dependency_count; i++) {
+    compilable = jitParamIndex(function, compiler.dependencies[i].name) < 0;
+  }
+
+  void *code = NULL;
+  if (compilable) {
+    struct JitBuffer *buffer = &compiler.buffer;
+    // push rbp; mov rbp, rsp; sub rsp, 48
+    emitBytes(buffer, (uint8_t[]){0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC,
+                                  8 * JIT_MAX_ARITY},
+              8);
+    // mov [rbp - 8 * (i + 1)], the register of argument i
+    uint8_t stores[JIT_MAX_ARITY][3] = {{0x89, 0x7D}, {0x89, 0x75},
+                                        {0x89, 0x55}, {0x89, 0x4D},
+                                        {0x44, 0x89, 0x45}, {0x44, 0x89, 0x4D}};
+    for (int i = 0; i < function->arity; i++) {
+      int size = i < 4 ? 2 : 3;
+      emitBytes(buffer, stores[i], size);
+      emitBytes(buffer, (uint8_t[]){(uint8_t)(-8 * (i + 1))}, 1);
+    }
+    jitEmit(&compiler, function->body);
+    // leave; ret
+    emitBytes(buffer, (uint8_t[]){0xC9, 0xC3}, 2);
+    code = installJitCode(buffer);
+    free(buffer->code);
+  }
+
+  if (code == NULL) {
+    free(compiler.dependencies);
+    function->jit_state = JIT_FAILED;
+    return;
+  }
+  function->jit_code = code;
+  function->jit_dependencies = compiler.dependencies;
+  function->jit_dependency_count = compiler.dependency_count;
+  function->jit_checked_version = 0;
+  function->jit_state = JIT_COMPILED;
+#else
+  (void)env;
+  function->jit_state = JIT_FAILED;
+#endif
+}
+
+// runs a call with the compiled code of function once it is hot, returns
+// false if the interpreter has to evaluate it
+bool jitCall(struct Function *function, struct Binding *frame,
+             struct Object *evaluated, struct Env *env) {
+  if (function->jit_state == JIT_NONE &&
+      ++function->call_count >= jit_call_threshold) {
+    jitCompile(function, env);
+  }
+  if (function->jit_state != JIT_COMPILED) {
+    return false;
+  }
+
+  int args[JIT_MAX_ARITY] = {0};
+  for (int i = 0; i < function->arity; i++) {
+    if (frame[i].value->type != OBJ_INTEGER) {
+      return false;
+    }
+    args[i] = frame[i].value->int_value;
+  }
+  if (function->jit_checked_version != function_binding_version) {
+    for (int i = 0; i < function->jit_dependency_count; i++) {
+      struct Binding *binding =
+          lookupBinding(env, function->jit_dependencies[i].name);
+      if (binding == NULL || binding->value->type != OBJ_FUNCTION ||
+          binding->value->function_value !=
+              function->jit_dependencies[i].function) {
+        return false;
+      }
+    }
+    function->jit_checked_version = function_binding_version;
+  }
+
+  int result = ((JitEntry)function->jit_code)(args[0], args[1], args[2],
+                                               args[3], args[4], args[5]);
+  evaluated->type = function->jit_return_type;
+  if (evaluated->type == OBJ_INTEGER) {
+    evaluated->int_value = result;
+  } else {
+    evaluated->bool_value = result;
+  }
+  return true;
+}
+
+// =================================================
+//   evaluator
+// =================================================
+
+void evaluateLiteralExpression(struct ExpressionNode *expression,
+                               struct Object *evaluated);
+
+bool isConstantListExpression(struct ExpressionNode *expression) {
+  struct ExpressionList *expressions = expression->data.list->expressions;
+  while (expressions != NULL) {
+    if (expressions->expression->type != EXP_LITERAL) {
+      return false;
+    }
+    expressions = expressions->next;
+  }
+  return true;
+}
+
+struct Object *newConstantObject(ObjectType type) {
+  struct Object *obj = malloc(sizeof(struct Object));
+  obj->marked = 0;
+  obj->type = type;
+  return obj;
+}
+
+struct Object *buildConstantList(struct ExpressionNode *expression) {
+  struct ExpressionList *expressions = expression->data.list->expressions;
+  // empty data list is evaluated as nil
+  if (expressions == NULL) {
+    return newConstantObject(OBJ_NIL);
+  }
+
+  struct Object *list = newConstantObject(OBJ_LIST);
+  struct Object *owner = list;
+  struct ConsCell *prev = NULL;
+  int length = 0;
+  while (expressions != NULL) {
+    struct ExpressionNode *expr = expressions->expression;
+    struct ConsCell *conscell = newConsCell();
+    conscell->constant = true;
+    conscell->prev = prev;
+    conscell->type = CONSCELL_TYPE_CELL;
+    conscell->car = newConstantObject(OBJ_NIL);
+    evaluateLiteralExpression(expr, conscell->car);
+    owner->list_value = conscell;
+    prev = conscell;
+    length++;
+
+    expressions = expressions->next;
+    if (expressions == NULL) {
+      conscell->type = CONSCELL_TYPE_NIL;
+      conscell->cdr = newConstantObject(OBJ_NIL);
+    } else {
+      conscell->cdr = newConstantObject(OBJ_LIST);
+      owner = conscell->cdr;
+    }
+  }
+  // the header of each evaluation is made from this one
+  attachListHeader(list->list_value, prev, length);
+  return list;
+}
+
+// copy the constant cells of a list before it is mutated, the elements are
+// immutable so only the cells and cdr objects are copied. The head cell of a
+// list is never constant, so the copy is linked into a cdr object shared by
+// every copy of the list object.
+void ensureMutableList(struct Object *list, struct Env *env,
+                       struct AllocatorContext *context) {
+  // constant cells always end the list, so a list ending with a mutable cell
+  // has none
+  struct ListHeader *list_header = listHeader(list->list_value);
+  if (list_header != NULL && !list_header->tail->constant) {
+    return;
+  }
+
+  struct Object *owner = list;
+  struct ConsCell *prev = NULL;
+  while (owner->type == OBJ_LIST && !owner->list_value->constant) {
+    prev = owner->list_value;
+    owner = owner->list_value->cdr;
+  }
+  if (owner->type != OBJ_LIST) {
+    return;
+  }
+
+  struct ConsCell *current = owner->list_value;
+  while (1) {
+    struct ConsCell *conscell = newConsCell();
+    conscell->type = current->type;
+    conscell->car = current->car;
+    conscell->prev = prev;
+    owner->list_value = conscell;
+    prev = conscell;
+    if (isLastConsCell(current)) {
+      conscell->cdr = allocate(context, env);
+      conscell->cdr->type = OBJ_NIL;
+      break;
+    }
+    conscell->cdr = allocate(context, env);
+    conscell->cdr->type = OBJ_LIST;
+    owner = conscell->cdr;
+    current = current->cdr->list_value;
+  }
+
+  // the last cell was replaced, list may also be a cons onto a list with a
+  // header that is now out of date
+  if (list_header != NULL) {
+    list_header->tail = prev;
+  } else {
+    list_header_version++;
+  }
+}
+
+void evaluateListExpression(struct ExpressionNode *expression,
+                            struct Object *evaluated, struct Env *env,
+                            struct AllocatorContext *context) {
+  struct ExpressionList *expressions = expression->data.list->expressions;
+
+  // empty data list is evaluated as nil
+  if (expressions == NULL) {
+    evaluated->type = OBJ_NIL;
+    return;
+  }
+
+  // the cells of a list of literals are built once and shared by every
+  // evaluation behind a fresh head cell, mutating builtins copy them with
+  // ensureMutableList
+  if (expression->data.list->constant == NULL && !parallel_evaluation &&
+      isConstantListExpression(expression)) {
+    expression->data.list->constant = buildConstantList(expression);
+  }
+  if (expression->data.list->constant != NULL) {
+    struct ConsCell *constant_head = expression->data.list->constant->list_value;
+    struct ConsCell *head = newConsCell();
+    head->type = constant_head->type;
+    head->car = constant_head->car;
+    head->cdr = allocate(context, env);
+    head->cdr->type = constant_head->cdr->type;
+    head->cdr->list_value = constant_head->cdr->list_value;
+    struct ListHeader *constant_header = constant_head->header;
+    attachListHeader(head,
+                     constant_header->length > 1 ? constant_header->tail
+                                                 : head,
+                     constant_header->length);
+    evaluated->type = OBJ_LIST;
+    evaluated->list_value = head;
+    return;
+  }
+
+  struct ConsCell *car_conscell = NULL;
+  struct ConsCell *prev_conscell = NULL;
+  int length = 0;
+
+  while (expressions != NULL) {
+    struct ConsCell *new_conscell = newConsCell();
+    if (car_conscell == NULL) {
+      car_conscell = new_conscell;
+    }
+
+    struct Object *evaluatedItem = allocate(context, env);
+    new_conscell->car = evaluatedItem;
+    evaluateExpression(expressions->expression, evaluatedItem, env, context);
+
+    expressions = expressions->next;
+
+    if (prev_conscell != NULL) {
+      struct Object *new_cdr = allocate(context, env);
+      new_cdr->type = OBJ_LIST;
+      new_cdr->list_value = new_conscell;
+      prev_conscell->cdr = new_cdr;
+      prev_conscell->type = CONSCELL_TYPE_CELL;
+      new_conscell->prev = prev_conscell;
+    }
+    prev_conscell = new_conscell;
+    length++;
+
+    if (expressions == NULL) {
+      struct Object *nilObj = allocate(context, env);
+      nilObj->type = OBJ_NIL;
+      prev_conscell->type = CONSCELL_TYPE_NIL;
       prev_conscell->cdr = nilObj;
     }
   }
 
-  evaluated->list_value = car_conscell;
+  attachListHeader(car_conscell, prev_conscell, length);
+  // evaluated is a GC root, so it becomes a list only once the cells are
+  // complete
+  evaluated->type = OBJ_LIST;
+  evaluated->list_value = car_conscell;
+}
+
+// builds a list of evaluated items with the same cells as
+// evaluateListExpression, for programs translated by worspc
+void makeList(struct Object **items, int count, struct Object *evaluated,
+              struct Env *env, struct AllocatorContext *context) {
+  if (count == 0) {
+    evaluated->type = OBJ_NIL;
+    return;
+  }
+
+  struct ConsCell *car_conscell = NULL;
+  struct ConsCell *prev_conscell = NULL;
+  int length = 0;
+  for (int i = 0; i < count; i++) {
+    struct ConsCell *new_conscell = newConsCell();
+    if (car_conscell == NULL) {
+      car_conscell = new_conscell;
+    }
+    new_conscell->car = items[i];
+    if (prev_conscell != NULL) {
+      struct Object *new_cdr = allocate(context, env);
+      new_cdr->type = OBJ_LIST;
+      new_cdr->list_value = new_conscell;
+      prev_conscell->cdr = new_cdr;
+      prev_conscell->type = CONSCELL_TYPE_CELL;
+      new_conscell->prev = prev_conscell;
+    }
+    prev_conscell = new_conscell;
+    length++;
+  }
+  struct Object *nilObj = allocate(context, env);
+  nilObj->type = OBJ_NIL;
+  prev_conscell->type = CONSCELL_TYPE_NIL;
+  prev_conscell->cdr = nilObj;
+  attachListHeader(car_conscell, prev_conscell, length);
+
+  evaluated->type = OBJ_LIST;
+  evaluated->list_value = car_conscell;
+}
+
+_Atomic unsigned long function_binding_version = 1;
+_Atomic unsigned long global_function_version = 1;
+
+// keeps the node when its form is released in stream mode. The threads of
+// pmap only evaluate the bodies of functions, which are retained with their
+// definition, so they never write the flag.
+void retainExpression(struct ExpressionNode *expression) {
+  if (!parallel_evaluation && !expression->retained) {
+    expression->retained = true;
+  }
+}
+
+// binds obj to a parameter or local of the function of the frame env
+void setFrameSlot(struct Env *env, struct Binding *slot, struct Object *obj) {
+  // call sites may have resolved the name to the global function it shadows
+  if (slot->value == NULL && env->shadows_global_function) {
+    function_binding_version++;
+  }
+  slot->value = obj;
+}
+
+bool setObjectToEnv(struct Env *env, char *symbolName, struct Object *obj) {
+  // call sites only cache the functions of the global env
+  bool global = env->parent == NULL;
+  if (global && obj->type == OBJ_FUNCTION) {
+    function_binding_version++;
+    global_function_version++;
+  }
+
+  // search binding that has the symbol name
+  for (int i = 0; i < env->size; i++) {
+    if (strcmp(env->bindings[i].symbol_name, symbolName) == 0) {
+      if (env->bindings[i].value == NULL) {
+        setFrameSlot(env, &env->bindings[i], obj);
+        return false;
+      }
+      if (global && env->bindings[i].value->type == OBJ_FUNCTION) {
+        function_binding_version++;
+        global_function_version++;
+      }
+      env->bindings[i].value = obj;
+      return false;
+    }
+  }
+
+  // if not found, add a new binding, call sites may have resolved the name
+  // to the global function it shadows
+  if (env->shadows_global_function) {
+    function_binding_version++;
+  }
+  if (env->size == env->capacity) {
+    if (env->frame) {
+      printf("Too many bindings in function frame.\n");
+      exit(1);
+    }
+    env->capacity *= 2;
+    env->bindings =
+        realloc(env->bindings, sizeof(struct Binding) * env->capacity);
+  }
+  env->bindings[env->size].symbol_name = symbolName;
+  env->bindings[env->size].value = obj;
+  env->size++;
+  return true;
+}
+
+// the slots of locals that are not bound yet hold NULL, the name refers to a
+// binding of a caller then
+struct Binding *lookupBinding(struct Env *env, char *symbol_name) {
+  while (env != NULL) {
+    for (int i = 0; i < env->size; i++) {
+      if (env->bindings[i].value != NULL &&
+          strcmp(env->bindings[i].symbol_name, symbol_name) == 0) {
+        return &env->bindings[i];
+      }
+    }
+    // look up the parent env if not found
+    env = env->parent;
+  }
+  return NULL;
+}
+
+// the binding of symbol_name in env itself, not in its parents
+struct Binding *lookupLocalBinding(struct Env *env, char *symbol_name) {
+  for (int i = 0; i < env->size; i++) {
+    if (env->bindings[i].value != NULL &&
+        strcmp(env->bindings[i].symbol_name, symbol_name) == 0) {
+      return &env->bindings[i];
+    }
+  }
+  return NULL;
+}
+
+// the frame slot of a symbol that names a parameter or a local of the
+// function being evaluated, NULL when it names none
+struct Binding *frameBinding(struct SymbolNode *symbol, struct Env *env) {
+  if (symbol->slot < 0 || !env->frame || symbol->slot >= env->size) {
+    return NULL;
+  }
+  return &env->bindings[symbol->slot];
+}
+
+// lookupBinding reading the frame slot of a local of the function being
+// evaluated instead of comparing names
+struct Binding *lookupSymbolBinding(struct SymbolNode *symbol,
+                                    struct Env *env) {
+  struct Binding *binding = frameBinding(symbol, env);
+  if (binding == NULL) {
+    return lookupBinding(env, symbol->symbol_name);
+  }
+  if (binding->value != NULL) {
+    return binding;
+  }
+  return lookupBinding(env->parent, symbol->symbol_name);
+}
+
+// the global env, the root of every chain of frames
+struct Env *globalEnv(struct Env *env) {
+  while (env->parent != NULL) {
+    env = env->parent;
+  }
+  return env;
+}
+
+// the function of binding, which was looked up by symbol_name
+struct Function *bindingFunction(struct Binding *binding, char *symbol_name) {
+  if (binding == NULL) {
+    printf("Undefined function: %s\n", symbol_name);
+    exit(1);
+  }
+  if (binding->value->type != OBJ_FUNCTION) {
+    printf("Type error: %s is not a function.\n", symbol_name);
+    exit(1);
+  }
+  return binding->value->function_value;
+}
+
+struct Function *lookupFunction(struct Env *env, char *symbol_name) {
+  return bindingFunction(lookupBinding(env, symbol_name), symbol_name);
+}
+
+// resolves a call through the inline cache of its call site. Only functions
+// bound in the global env are cached: the frame binding a function is gone
+// once its call returns, and a frame shadowing a global function
+// invalidates the caches when it binds the name.
+struct Function *lookupCachedFunction(struct Env *env, char *symbol_name,
+                                      struct Function **cached_function,
+                                      unsigned long *cached_version) {
+  if (*cached_function != NULL &&
+      *cached_version == function_binding_version) {
+    return *cached_function;
+  }
+  struct Binding *binding = lookupLocalBinding(env, symbol_name);
+  while (binding == NULL && env->parent != NULL) {
+    env = env->parent;
+    binding = lookupLocalBinding(env, symbol_name);
+  }
+  struct Function *function = bindingFunction(binding, symbol_name);
+  // the threads of pmap only read the cache
+  if (env->parent == NULL && !parallel_evaluation) {
+    *cached_function = function;
+    *cached_version = function_binding_version;
+  }
+  return function;
+}
+
+bool isFrameSlotName(struct Function *function, char **locals, int count,
+                     char *name) {
+  for (int i = 0; i < function->arity; i++) {
+    if (strcmp(function->param_symbol_names[i], name) == 0) {
+      return true;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (strcmp(locals[i], name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int collectFrameLocals(struct ExpressionNode *expression,
+                       struct Function *function, char ***locals, int count) {
+  struct ExpressionList *expressions = NULL;
+  if (expression->type == EXP_SYMBOLIC_EXP) {
+    expressions = expression->data.symbolic_exp->expressions;
+    // = and defun bind their name in the frame they are evaluated in, and
+    // dotimes and dolist their variable
+    if (expressions != NULL && expressions->expression->type == EXP_SYMBOL &&
+        expressions->next != NULL) {
+      char *head = expressions->expression->data.symbol->symbol_name;
+      bool is_defun = strcmp(head, "defun") == 0;
+      struct ExpressionNode *variable = expressions->next->expression;
+      if (strcmp(head, "dotimes") == 0 || strcmp(head, "dolist") == 0) {
+        struct ExpressionList *specification =
+            loopSpecification(expressions->next);
+        variable = specification != NULL ? specification->expression : NULL;
+      } else if (!is_defun && strcmp(head, "=") != 0) {
+        variable = NULL;
+      }
+      if (variable != NULL && variable->type == EXP_SYMBOL &&
+          !isFrameSlotName(function, *locals, count,
+                           variable->data.symbol->symbol_name)) {
+        char *name = variable->data.symbol->symbol_name;
+        *locals = realloc(*locals, sizeof(char *) * (count + 1));
+        (*locals)[count++] = name;
+      }
+      // the body of a nested function binds in its own frame
+      if (is_defun) {
+        return count;
+      }
+    }
+  } else if (expression->type == EXP_LIST) {
+    expressions = expression->data.list->expressions;
+  }
+  while (expressions != NULL) {
+    count = collectFrameLocals(expressions->expression, function, locals,
+                               count);
+    expressions = expressions->next;
+  }
+  return count;
+}
+
+// the NULL terminated names of the bindings a call of function can add
+// besides its parameters, count is set to their number
+char **frameLocalNames(struct ExpressionNode *body, struct Function *function,
+                       int *count) {
+  char **locals = NULL;
+  *count = collectFrameLocals(body, function, &locals, 0);
+  locals = realloc(locals, sizeof(char *) * (*count + 1));
+  locals[*count] = NULL;
+  return locals;
+}
+
+// the slot of name in the frame of a call of function, -1 when it is neither
+// a parameter nor a local
+int frameSlot(struct Function *function, char *name) {
+  for (int i = 0; i < function->arity; i++) {
+    if (strcmp(function->param_symbol_names[i], name) == 0) {
+      return i;
+    }
+  }
+  for (int i = 0; function->local_symbol_names[i] != NULL; i++) {
+    if (strcmp(function->local_symbol_names[i], name) == 0) {
+      return function->arity + i;
+    }
+  }
+  return -1;
+}
+
+// resolves the symbols of the body of function to the slots of its frame
+// once, so that evaluating them compares no names. The body of a nested
+// function is resolved when its definition is evaluated.
+void assignFrameSlots(struct ExpressionNode *expression,
+                      struct Function *function) {
+  struct ExpressionList *expressions = NULL;
+  if (expression->type == EXP_SYMBOL) {
+    struct SymbolNode *symbol = expression->data.symbol;
+    // nil is never looked up
+    symbol->slot = strcmp(symbol->symbol_name, "nil") == 0
+                       ? -1
+                       : frameSlot(function, symbol->symbol_name);
+    return;
+  } else if (expression->type == EXP_SYMBOLIC_EXP) {
+    expressions = expression->data.symbolic_exp->expressions;
+    // only the name of a nested function is bound in this frame
+    if (expressions != NULL && expressions->expression->type == EXP_SYMBOL &&
+        strcmp(expressions->expression->data.symbol->symbol_name, "defun") ==
+            0 &&
+        expressions->next != NULL) {
+      assignFrameSlots(expressions->next->expression, function);
+      return;
+    }
+  } else if (expression->type == EXP_LIST) {
+    expressions = expression->data.list->expressions;
+  }
+  for (; expressions != NULL; expressions = expressions->next) {
+    assignFrameSlots(expressions->expression, function);
+  }
+}
+
+struct Function *newFunction(char **param_symbol_names, int arity,
+                             char **local_symbol_names, int frame_size,
+                             struct ExpressionNode *body,
+                             NativeFunction native) {
+  struct Function *function = malloc(sizeof(struct Function));
+  function->param_symbol_names = param_symbol_names;
+  function->arity = arity;
+  function->local_symbol_names = local_symbol_names;
+  function->frame_size = frame_size;
+  function->body = body;
+  function->native = native;
+  function->call_count = 0;
+  function->jit_state = JIT_NONE;
+  function->jit_code = NULL;
+  function->jit_dependencies = NULL;
+  function->jit_dependency_count = 0;
+  function->jit_checked_version = 0;
+  function->shadows_global_function = false;
+  function->shadow_checked_version = 0;
+  return function;
+}
+
+// the threads of pmap share the AST, they evaluate it without specializing
+// it any further
+void specialize(struct SymbolicExpNode *node,
+                enum Specialization specialization) {
+  if (!parallel_evaluation) {
+    node->specialization = specialization;
+  }
+}
+
+// an integer literal or a variable, which superinstructions read in place
+bool isLocalOperand(struct ExpressionNode *operand) {
+  if (operand->type == EXP_LITERAL) {
+    return operand->data.literal->type == LIT_INTERGER;
+  }
+  return operand->type == EXP_SYMBOL &&
+         strcmp(operand->data.symbol->symbol_name, "nil") != 0;
+}
+
+// (< i n), (> i n) or (eq i n) on locals, the condition of a counted loop is
+// specialized before its first evaluation
+bool isCountedLoopCondition(struct ExpressionNode *cond) {
+  if (cond->type != EXP_SYMBOLIC_EXP) {
+    return false;
+  }
+  struct SymbolicExpNode *node = cond->data.symbolic_exp;
+  if (countOperands(node->expressions) != 3 ||
+      !isLocalOperand(node->expressions->next->expression) ||
+      !isLocalOperand(node->expressions->next->next->expression)) {
+    return false;
+  }
+  enum Specialization specialization;
+  if (isSymbolNamed(node->expressions->expression, "<")) {
+    specialization = SPECIALIZATION_LT_LOCALS;
+  } else if (isSymbolNamed(node->expressions->expression, ">")) {
+    specialization = SPECIALIZATION_GT_LOCALS;
+  } else if (isSymbolNamed(node->expressions->expression, "eq")) {
+    specialization = SPECIALIZATION_EQ_LOCALS;
+  } else {
+    return false;
+  }
+  if (node->specialization == SPECIALIZATION_NONE) {
+    specialize(node, specialization);
+  }
+  return node->specialization == specialization;
+}
+
+// specialize a builtin call after its first evaluation, if its operands
+// were integers
+void quicken(struct ExpressionNode *expression, struct Object *op1,
+             struct Object *op2, enum Specialization specialization) {
+  struct SymbolicExpNode *node = expression->data.symbolic_exp;
+  if (node->specialization != SPECIALIZATION_NONE) {
+    return;
+  }
+  if (op1->type == OBJ_INTEGER && op2->type == OBJ_INTEGER) {
+    specialize(node, specialization);
+  } else {
+    specialize(node, SPECIALIZATION_GENERIC);
+    return;
+  }
+
+  // comparisons of variables and literals read them in place
+  struct ExpressionList *operands = node->expressions->next;
+  if (!isLocalOperand(operands->expression) ||
+      !isLocalOperand(operands->next->expression)) {
+    return;
+  }
+  if (specialization == SPECIALIZATION_LT_INT) {
+    specialize(node, SPECIALIZATION_LT_LOCALS);
+  } else if (specialization == SPECIALIZATION_GT_INT) {
+    specialize(node, SPECIALIZATION_GT_LOCALS);
+  } else if (specialization == SPECIALIZATION_EQ_INT) {
+    specialize(node, SPECIALIZATION_EQ_LOCALS);
+  }
+}
+
+// reads an integer operand of a superinstruction without evaluating it,
+// returns false when it does not hold an integer
+bool readLocalInt(struct ExpressionNode *operand, struct Env *env,
+                  int *value) {
+  if (operand->type == EXP_LITERAL) {
+    *value = operand->data.literal->int_value;
+    return true;
+  }
+  struct Binding *binding = lookupSymbolBinding(operand->data.symbol, env);
+  if (binding == NULL || binding->value->type != OBJ_INTEGER) {
+    return false;
+  }
+  *value = binding->value->int_value;
+  return true;
+}
+
+// a condition specialized to compare locals, returns false after
+// deoptimizing it when it has to be evaluated
+bool compareLocals(struct ExpressionNode *expression, struct Env *env,
+                   bool *result) {
+  if (expression->type != EXP_SYMBOLIC_EXP) {
+    return false;
+  }
+  struct SymbolicExpNode *node = expression->data.symbolic_exp;
+  if (node->specialization < SPECIALIZATION_LT_LOCALS ||
+      node->specialization > SPECIALIZATION_EQ_LOCALS) {
+    return false;
+  }
+  int a;
+  int b;
+  if (!readLocalInt(node->expressions->next->expression, env, &a) ||
+      !readLocalInt(node->expressions->next->next->expression, env, &b)) {
+    specialize(node, SPECIALIZATION_GENERIC);
+    return false;
+  }
+  if (node->specialization == SPECIALIZATION_LT_LOCALS) {
+    *result = a < b;
+  } else if (node->specialization == SPECIALIZATION_GT_LOCALS) {
+    *result = a > b;
+  } else {
+    *result = a == b;
+  }
+  return true;
+}
+
+// (= x (+ x y)) or (= x (- x y)) after its first evaluation
+void classifyAssignment(struct ExpressionNode *expression,
+                        struct Object *value) {
+  struct SymbolicExpNode *node = expression->data.symbolic_exp;
+  if (node->specialization != SPECIALIZATION_NONE) {
+    return;
+  }
+  specialize(node, SPECIALIZATION_GENERIC);
+  char *name = node->expressions->next->expression->data.symbol->symbol_name;
+  struct ExpressionNode *value_expression =
+      node->expressions->next->next->expression;
+  if (value->type != OBJ_INTEGER ||
+      value_expression->type != EXP_SYMBOLIC_EXP ||
+      countOperands(value_expression->data.symbolic_exp->expressions) != 3) {
+    return;
+  }
+  struct ExpressionList *operation =
+      value_expression->data.symbolic_exp->expressions;
+  if (!isSymbolNamed(operation->next->expression, name) ||
+      !isLocalOperand(operation->next->next->expression)) {
+    return;
+  }
+  if (isSymbolNamed(operation->expression, "+")) {
+    specialize(node, SPECIALIZATION_ADD_TO_LOCAL);
+  } else if (isSymbolNamed(operation->expression, "-")) {
+    specialize(node, SPECIALIZATION_SUB_FROM_LOCAL);
+  }
+}
+
+void evaluateCountedLoop(struct ExpressionNode *cond,
+                         struct ExpressionNode *body, struct Object *evaluated,
+                         struct Env *env, struct AllocatorContext *context) {
+  int top = context->stack->top;
+  while (1) {
+    context->stack->top = top;
+    bool result;
+    if (!compareLocals(cond, env, &result)) {
+      struct Object condObj = (struct Object){};
+      evaluateExpression(cond, &condObj, env, context);
+      result = boolVal(&condObj);
+    }
+    if (!result) {
+      evaluated->type = OBJ_NIL;
+      break;
+    }
+    evaluateExpression(body, evaluated, env, context);
+  }
+}
+
+// the variable and the count or list of (dotimes (i n) ...) and
+// (dolist (x list) ...), NULL when the form is malformed
+struct ExpressionList *loopSpecification(struct ExpressionList *operands) {
+  if (operands == NULL || operands->expression->type != EXP_SYMBOLIC_EXP) {
+    return NULL;
+  }
+  struct ExpressionList *specification =
+      operands->expression->data.symbolic_exp->expressions;
+  if (countOperands(specification) != 2 ||
+      specification->expression->type != EXP_SYMBOL) {
+    return NULL;
+  }
+  return specification;
+}
+
+// binds variable in the current env and returns its slot, which stays the
+// same while the loop runs since bindings are only appended
+int bindLoopVariable(char *name, struct Object *variable, struct Env *env) {
+  setObjectToEnv(env, name, variable);
+  return lookupLocalBinding(env, name) - env->bindings;
+}
+
+// the body may have bound another object to the loop variable
+void restoreLoopVariable(int slot, struct Object *variable, struct Env *env) {
+  if (env->bindings[slot].value != variable) {
+    setObjectToEnv(env, env->bindings[slot].symbol_name, variable);
+  }
+}
+
+// dotimes and dolist update one object bound to the variable in place and
+// walk the list with a cursor, an iteration allocates nothing itself
+void evaluateLoopForm(char *name, struct ExpressionList *operands,
+                      struct Object *evaluated, struct Env *env,
+                      struct AllocatorContext *context) {
+  bool is_dolist = strcmp(name, "dolist") == 0;
+  struct ExpressionList *specification = loopSpecification(operands);
+  if (specification == NULL) {
+    printf("%s must have a variable and %s.\n", name,
+           is_dolist ? "a list" : "a count");
+    exit(1);
+  }
+  struct Object *source = allocate(context, env);
+  evaluateExpression(specification->next->expression, source, env, context);
+  if (is_dolist && source->type != OBJ_LIST && source->type != OBJ_NIL) {
+    printf("Type error: dolist operand must be list.\n");
+    exit(1);
+  }
+  if (!is_dolist && source->type != OBJ_INTEGER) {
+    printf("Type error: dotimes operand must be integer.\n");
+    exit(1);
+  }
+
+  struct Object *variable = allocate(context, env);
+  variable->type = OBJ_NIL;
+  char *variable_name = specification->expression->data.symbol->symbol_name;
+  struct Binding *local = frameBinding(specification->expression->data.symbol,
+                                       env);
+  int slot;
+  if (local != NULL) {
+    setFrameSlot(env, local, variable);
+    slot = local - env->bindings;
+  } else {
+    slot = bindLoopVariable(variable_name, variable, env);
+    if (env->bindings[slot].symbol_name == variable_name) {
+      retainExpression(specification->expression);
+    }
+  }
+  struct Object *cursor = source;
+  int index = 0;
+  int top = context->stack->top;
+  while (is_dolist ? cursor->type == OBJ_LIST : index < source->int_value) {
+    // temporaries of the previous iteration are unreachable now
+    context->stack->top = top;
+    if (is_dolist) {
+      *variable = *cursor->list_value->car;
+      cursor = cursor->list_value->cdr;
+    } else {
+      variable->type = OBJ_INTEGER;
+      variable->int_value = index++;
+    }
+    restoreLoopVariable(slot, variable, env);
+    struct Object operand = (struct Object){};
+    for (struct ExpressionList *body = operands->next; body != NULL;
+         body = body->next) {
+      evaluateExpression(body->expression, &operand, env, context);
+    }
+  }
+  evaluated->type = OBJ_NIL;
+}
+
+// returns false after deoptimizing when the generic evaluation has to run,
+// nothing has been evaluated then
+bool evaluateSuperinstruction(struct ExpressionNode *expression,
+                              struct Object *evaluated, struct Env *env,
+                              struct AllocatorContext *context) {
+  struct SymbolicExpNode *node = expression->data.symbolic_exp;
+  struct ExpressionList *operands = node->expressions->next;
+  bool result;
+  switch (node->specialization) {
+  case SPECIALIZATION_LT_LOCALS:
+  case SPECIALIZATION_GT_LOCALS:
+  case SPECIALIZATION_EQ_LOCALS:
+    if (!compareLocals(expression, env, &result)) {
+      return false;
+    }
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = result;
+    return true;
+  case SPECIALIZATION_ADD_TO_LOCAL:
+  case SPECIALIZATION_SUB_FROM_LOCAL: {
+    // the object of a binding is never shared, so it is updated in place
+    struct SymbolNode *symbol = operands->expression->data.symbol;
+    struct Binding *binding = frameBinding(symbol, env);
+    if (binding == NULL) {
+      binding = lookupLocalBinding(env, symbol->symbol_name);
+    }
+    struct ExpressionNode *operand = operands->next->expression->data
+                                         .symbolic_exp->expressions->next->next
+                                         ->expression;
+    int delta;
+    if (binding != NULL && binding->value != NULL &&
+        binding->value->type == OBJ_INTEGER &&
+        readLocalInt(operand, env, &delta)) {
+      if (node->specialization == SPECIALIZATION_ADD_TO_LOCAL) {
+        binding->value->int_value =
+            WRAPPING_INT(binding->value->int_value, +, delta);
+      } else {
+        binding->value->int_value =
+            WRAPPING_INT(binding->value->int_value, -, delta);
+      }
+      *evaluated = *binding->value;
+      return true;
+    }
+    break;
+  }
+  case SPECIALIZATION_COUNTED_LOOP:
+    evaluateCountedLoop(operands->expression, operands->next->expression,
+                        evaluated, env, context);
+    return true;
+  default:
+    break;
+  }
+  specialize(node, SPECIALIZATION_GENERIC);
+  return false;
 }
 
-void setObjectToEnv(struct Env *env, char *symbolName, struct Object *obj) {
-  // search binding that has the symbol name
-  int i = 0;
-  while (env->bindings[i].symbol_name != NULL) {
-    if (strcmp(env->bindings[i].symbol_name, symbolName) == 0) {
-      env->bindings[i].value = obj;
+void evaluateSpecialized(struct ExpressionNode *expression,
+                         struct Object *evaluated, struct Env *env,
+                         struct AllocatorContext *context) {
+  struct SymbolicExpNode *node = expression->data.symbolic_exp;
+  // integer operands hold no references, so they need no heap objects
+  struct Object op1 = (struct Object){};
+  struct Object op2 = (struct Object){};
+  evaluateExpression(node->expressions->next->expression, &op1, env, context);
+  evaluateExpression(node->expressions->next->next->expression, &op2, env,
+                     context);
+
+  if (op1.type == OBJ_INTEGER && op2.type == OBJ_INTEGER) {
+    int a = op1.int_value;
+    int b = op2.int_value;
+    switch (node->specialization) {
+    case SPECIALIZATION_ADD_INT:
+      evaluated->type = OBJ_INTEGER;
+      evaluated->int_value = WRAPPING_INT(a, +, b);
+      return;
+    case SPECIALIZATION_SUB_INT:
+      evaluated->type = OBJ_INTEGER;
+      evaluated->int_value = WRAPPING_INT(a, -, b);
+      return;
+    case SPECIALIZATION_MUL_INT:
+      evaluated->type = OBJ_INTEGER;
+      evaluated->int_value = WRAPPING_INT(a, *, b);
+      return;
+    case SPECIALIZATION_LT_INT:
+      evaluated->type = OBJ_BOOL;
+      evaluated->bool_value = a < b;
+      return;
+    case SPECIALIZATION_GT_INT:
+      evaluated->type = OBJ_BOOL;
+      evaluated->bool_value = a > b;
+      return;
+    case SPECIALIZATION_EQ_INT:
+      evaluated->type = OBJ_BOOL;
+      evaluated->bool_value = a == b;
       return;
+    default:
+      break;
     }
-    i++;
   }
 
-  // if not found, set to parent env
-  struct Binding *binding = malloc(sizeof(struct Binding));
-  binding->symbol_name = symbolName;
-  binding->value = obj;
-  i = 0;
-  while (env->bindings[i].symbol_name != NULL) {
-    i++;
+  // deoptimize, the operands are already evaluated so the generic builtin
+  // finishes this evaluation
+  enum Specialization specialization = node->specialization;
+  specialize(node, SPECIALIZATION_GENERIC);
+  if (specialization == SPECIALIZATION_ADD_INT) {
+    definedFunctionAdd(&op1, &op2, evaluated);
+  } else if (specialization == SPECIALIZATION_SUB_INT) {
+    definedFunctionSub(&op1, &op2, evaluated);
+  } else if (specialization == SPECIALIZATION_MUL_INT) {
+    definedFunctionMul(&op1, &op2, evaluated);
+  } else if (specialization == SPECIALIZATION_LT_INT) {
+    definedFunctionLt(&op1, &op2, evaluated);
+  } else if (specialization == SPECIALIZATION_GT_INT) {
+    definedFunctionGt(&op1, &op2, evaluated);
+  } else {
+    definedFunctionEq(&op1, &op2, evaluated);
+  }
+}
+
+// whether a call of function binds the name of a function of the global
+// env. Global functions are only rebound at the top level, so the answer
+// holds while the frame of a call is active.
+bool shadowsGlobalFunction(struct Function *function, struct Env *env) {
+  if (function->shadow_checked_version == global_function_version) {
+    return function->shadows_global_function;
+  }
+  struct Env *global = globalEnv(env);
+  char **names[] = {function->param_symbol_names,
+                    function->local_symbol_names};
+  bool shadows = false;
+  for (int i = 0; i < 2 && !shadows; i++) {
+    for (char **name = names[i]; name != NULL && *name != NULL; name++) {
+      struct Binding *binding = lookupLocalBinding(global, *name);
+      if (binding != NULL && binding->value->type == OBJ_FUNCTION) {
+        shadows = true;
+        break;
+      }
+    }
+  }
+  if (!parallel_evaluation) {
+    function->shadows_global_function = shadows;
+    function->shadow_checked_version = global_function_version;
+  }
+  return shadows;
+}
+
+// runs a call whose arguments are bound in the first arity slots of frame
+void invokeFunction(struct Function *function, struct Binding *frame,
+                    struct Object *evaluated, struct Env *env,
+                    struct AllocatorContext *context) {
+  if (jit_call_threshold > 0 && !parallel_evaluation &&
+      jitCall(function, frame, evaluated, env)) {
+    return;
+  }
+  // locals have their slots from the start, unbound until the body binds
+  // them
+  for (int i = function->arity; i < function->frame_size; i++) {
+    frame[i].symbol_name = function->local_symbol_names[i - function->arity];
+    frame[i].value = NULL;
+  }
+  bool shadows = shadowsGlobalFunction(function, env);
+  struct Env new_env = (struct Env){
+      frame, function->frame_size, function->frame_size, true, env, shadows};
+  if (shadows) {
+    // call sites may have cached the functions its parameters shadow
+    function_binding_version++;
+  }
+  if (function->native != NULL) {
+    function->native(evaluated, &new_env, context);
+  } else {
+    evaluateExpression(function->body, evaluated, &new_env, context);
   }
-  env->bindings[i] = *binding;
 }
 
 void evaluateSymbolicExpression(struct ExpressionNode *expression,
                                 struct Object *evaluated, struct Env *env,
                                 struct AllocatorContext *context) {
+  enum Specialization specialization =
+      expression->data.symbolic_exp->specialization;
+  if (specialization >= SPECIALIZATION_LT_LOCALS) {
+    if (evaluateSuperinstruction(expression, evaluated, env, context)) {
+      return;
+    }
+  } else if (specialization > SPECIALIZATION_GENERIC) {
+    evaluateSpecialized(expression, evaluated, env, context);
+    return;
+  }
+
   struct ExpressionList *expressions = expression->data.list->expressions;
   if (expressions != NULL) {
     struct ExpressionNode *expr = expressions->expression;
@@ -1085,9 +5237,14 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
           printf("if must have then clause.\n");
           exit(1);
         }
-        struct Object *condObj = allocate(context, env);
-        evaluateExpression(cond, condObj, env, context);
-        if (boolVal(condObj)) {
+        // the condition is only tested, so it needs no heap object
+        bool cond_value;
+        if (!compareLocals(cond, env, &cond_value)) {
+          struct Object condObj = (struct Object){};
+          evaluateExpression(cond, &condObj, env, context);
+          cond_value = boolVal(&condObj);
+        }
+        if (cond_value) {
           evaluateExpression(then, evaluated, env, context);
         } else {
           if (expressions->next->next->next != NULL) {
@@ -1110,16 +5267,29 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
           printf("if must have then clause.\n");
           exit(1);
         }
+        if (isCountedLoopCondition(cond)) {
+          specialize(expression->data.symbolic_exp,
+                     SPECIALIZATION_COUNTED_LOOP);
+          evaluateCountedLoop(cond, then, evaluated, env, context);
+          return;
+        }
+        int top = context->stack->top;
         while (1) {
-          struct Object *condObj = allocate(context, env);
-          evaluateExpression(cond, condObj, env, context);
-          if (boolVal(condObj)) {
+          // temporaries of the previous iteration are unreachable now
+          context->stack->top = top;
+          struct Object condObj = (struct Object){};
+          evaluateExpression(cond, &condObj, env, context);
+          if (boolVal(&condObj)) {
             evaluateExpression(then, evaluated, env, context);
           } else {
             evaluated->type = OBJ_NIL;
             break;
           }
         }
+      } else if (strcmp(expr->data.symbol->symbol_name, "dotimes") == 0 ||
+                 strcmp(expr->data.symbol->symbol_name, "dolist") == 0) {
+        evaluateLoopForm(expr->data.symbol->symbol_name, expressions->next,
+                         evaluated, env, context);
       } else if (strcmp(expr->data.symbol->symbol_name, "=") == 0) {
         // assignment
         struct ExpressionNode symbolExpr = *expressions->next->expression;
@@ -1138,8 +5308,15 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
         evaluateExpression(expr, evaluatedExpr, env, context);
         *evaluated = *evaluatedExpr;
 
-        // set value to current env
-        setObjectToEnv(env, symbol_name, evaluatedExpr);
+        // set value to current env, a new binding keeps the name of the
+        // symbol, the name of a slot belongs to the body of the function
+        struct Binding *slot = frameBinding(symbolExpr.data.symbol, env);
+        if (slot != NULL) {
+          setFrameSlot(env, slot, evaluatedExpr);
+        } else if (setObjectToEnv(env, symbol_name, evaluatedExpr)) {
+          retainExpression(expressions->next->expression);
+        }
+        classifyAssignment(expression, evaluatedExpr);
       } else if ((strcmp(expr->data.symbol->symbol_name, "defun") == 0)) {
         // define function
         // (defun fn (n) (+ n 1))
@@ -1162,9 +5339,13 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
 
         struct ExpressionList *params =
             paramsExpr->data.symbolic_exp->expressions;
-        // check all elements are symbol and get symbol names
-
-        char **param_symbol_names = malloc(sizeof(char *) * MAX_BINDINGS);
+        // check all elements are distinct symbols and get symbol names
+        int arity = 0;
+        for (struct ExpressionList *param = params; param != NULL;
+             param = param->next) {
+          arity++;
+        }
+        char **param_symbol_names = malloc(sizeof(char *) * (arity + 1));
 
         int i = 0;
         while (params != NULL) {
@@ -1172,26 +5353,48 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
             printf("Function parameter must be symbol.\n");
             exit(1);
           }
-          param_symbol_names[i] = params->expression->data.symbol->symbol_name;
+          char *param_name = params->expression->data.symbol->symbol_name;
+          for (int j = 0; j < i; j++) {
+            if (strcmp(param_symbol_names[j], param_name) == 0) {
+              printf("Duplicate parameter: %s\n", param_name);
+              exit(1);
+            }
+          }
+          param_symbol_names[i] = param_name;
           i++;
           params = params->next;
         }
+        param_symbol_names[arity] = NULL;
 
-        struct ExpressionNode *bodyExpr =
-            expressions->next->next->next->expression;
-        if (bodyExpr == NULL) {
+        if (expressions->next->next->next == NULL) {
           printf("Function must have body.\n");
           exit(1);
         }
+        struct ExpressionNode *bodyExpr =
+            expressions->next->next->next->expression;
 
-        struct Function *function = malloc(sizeof(struct Function));
-        function->param_symbol_names = param_symbol_names;
-        function->body = bodyExpr;
+        struct Function *function =
+            newFunction(param_symbol_names, arity, NULL, arity, bodyExpr, NULL);
+        int local_count;
+        function->local_symbol_names =
+            frameLocalNames(bodyExpr, function, &local_count);
+        function->frame_size += local_count;
+        // the threads of pmap share the body, it is resolved by the first
+        // evaluation of the definition outside of them
+        if (!parallel_evaluation) {
+          assignFrameSlots(bodyExpr, function);
+        }
 
-        evaluated->type = OBJ_FUNCTION;
-        evaluated->function_value = function;
+        // the binding gets its own object, evaluated may be a temporary
+        struct Object *function_obj = allocate(context, env);
+        function_obj->type = OBJ_FUNCTION;
+        function_obj->function_value = function;
+        *evaluated = *function_obj;
 
-        setObjectToEnv(env, symbol_name, evaluated);
+        // the function refers to the parameters and the body of the
+        // definition
+        retainExpression(expression);
+        setObjectToEnv(env, symbol_name, function_obj);
       } else {
         // function call
         if (strcmp(expr->data.symbol->symbol_name, "+") == 0) {
@@ -1203,6 +5406,7 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
           evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
           definedFunctionAdd(operand1, operand2, evaluated);
+          quicken(expression, operand1, operand2, SPECIALIZATION_ADD_INT);
         } else if (strcmp(expr->data.symbol->symbol_name, "-") == 0) {
           // -
           struct Object *operand1 = allocate(context, env);
@@ -1212,6 +5416,7 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
           evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
           definedFunctionSub(operand1, operand2, evaluated);
+          quicken(expression, operand1, operand2, SPECIALIZATION_SUB_INT);
         } else if (strcmp(expr->data.symbol->symbol_name, "*") == 0) {
           // *
           struct Object *operand1 = allocate(context, env);
@@ -1221,6 +5426,7 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
           evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
           definedFunctionMul(operand1, operand2, evaluated);
+          quicken(expression, operand1, operand2, SPECIALIZATION_MUL_INT);
         } else if (strcmp(expr->data.symbol->symbol_name, "/") == 0) {
           // /
           struct Object *operand1 = allocate(context, env);
@@ -1280,6 +5486,7 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
           evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
           definedFunctionLt(operand1, operand2, evaluated);
+          quicken(expression, operand1, operand2, SPECIALIZATION_LT_INT);
         } else if (strcmp(expr->data.symbol->symbol_name, ">") == 0) {
           // >
           struct Object *operand1 = allocate(context, env);
@@ -1288,273 +5495,1828 @@ void evaluateSymbolicExpression(struct ExpressionNode *expression,
                              context);
           evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
-          definedFunctionGt(operand1, operand2, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "eq") == 0) {
-          // eq
+          definedFunctionGt(operand1, operand2, evaluated);
+          quicken(expression, operand1, operand2, SPECIALIZATION_GT_INT);
+        } else if (strcmp(expr->data.symbol->symbol_name, "eq") == 0) {
+          // eq
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          definedFunctionEq(operand1, operand2, evaluated);
+          quicken(expression, operand1, operand2, SPECIALIZATION_EQ_INT);
+        } else if (strcmp(expr->data.symbol->symbol_name, "not") == 0) {
+          // not
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionNot(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "print") == 0) {
+          // print
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionPrint(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "car") == 0) {
+          // car
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionCar(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "cdr") == 0) {
+          // cdr
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionCdr(operand, evaluated, env, context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "cons") == 0) {
+          // cons
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          definedFunctionCons(operand1, operand2, evaluated, env, context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "readline") == 0) {
+          // readline
+          definedFunctionReadline(evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "split") == 0) {
+          // split
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          definedFunctionSplit(operand1, operand2, evaluated, env, context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "list-ref") == 0) {
+          // list-ref
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          definedFunctionListRef(operand1, operand2, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "progn") == 0) {
+          // progn
+          // operands are copied out of their result, so it needs no heap
+          // object
+          struct ExpressionList *exprs = expressions->next;
+          struct Object operand;
+          operand.type = OBJ_NIL;
+          int top = context->stack->top;
+          while (exprs != NULL) {
+            context->stack->top = top;
+            evaluateExpression(exprs->expression, &operand, env, context);
+            exprs = exprs->next;
+          }
+          *evaluated = operand;
+        } else if (strcmp(expr->data.symbol->symbol_name,
+                          "remove-whitespaces") == 0) {
+          // remove-whitespaces
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionRemoveWhitespaces(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "pop") == 0) {
+          // pop
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionPop(operand, evaluated, env, context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "push") == 0) {
+          // push
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->expression, operand2, env,
+                             context);
+          struct Binding *binding = NULL;
+          if (expressions->next->expression->type == EXP_SYMBOL) {
+            binding = lookupSymbolBinding(
+                expressions->next->expression->data.symbol, env);
+          }
+          definedFunctionPush(operand2, operand1, evaluated, binding, env,
+                              context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "length") == 0) {
+          // length
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionLength(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "is-int-string") ==
+                   0) {
+          // is-int-string
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionIsIntString(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "parse-int") == 0) {
+          // parse-int
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionParseInt(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "string-ref") == 0) {
+          // string-ref
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                              context);
+          definedFunctionStringRef(operand1, operand2, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "substring") == 0) {
+          // substring
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          struct Object *operand3 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          evaluateExpression(expressions->next->next->next->expression,
+                             operand3, env, context);
+          definedFunctionSubstring(operand1, operand2, operand3, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name,
+                          "make-string-builder") == 0) {
+          // make-string-builder
+          definedFunctionMakeStringBuilder(evaluated, env, context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "sb-append") == 0) {
+          // sb-append
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          definedFunctionSbAppend(operand1, operand2, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "sb-build") == 0) {
+          // sb-build
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionSbBuild(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "vector") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "pvec") == 0) {
+          // vector, pvec
+          int count = countOperands(expressions->next);
+          struct Object **items =
+              malloc(sizeof(struct Object *) * (count > 0 ? count : 1));
+          struct ExpressionList *item = expressions->next;
+          for (int i = 0; i < count; i++) {
+            items[i] = allocate(context, env);
+            evaluateExpression(item->expression, items[i], env, context);
+            item = item->next;
+          }
+          if (strcmp(expr->data.symbol->symbol_name, "vector") == 0) {
+            makeVector(items, count, evaluated, context);
+          } else {
+            makePVector(items, count, evaluated, context);
+          }
+          free(items);
+        } else if (strcmp(expr->data.symbol->symbol_name, "vector-ref") == 0) {
+          // vector-ref
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          definedFunctionVectorRef(operand1, operand2, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "vector-set") == 0) {
+          // vector-set
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          struct Object *operand3 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          evaluateExpression(expressions->next->next->next->expression,
+                             operand3, env, context);
+          definedFunctionVectorSet(operand1, operand2, operand3, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "vector-push") == 0) {
+          // vector-push
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          definedFunctionVectorPush(operand1, operand2, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "vector-pop") == 0) {
+          // vector-pop
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionVectorPop(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "vector-length") ==
+                   0) {
+          // vector-length
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          definedFunctionVectorLength(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "make-map") == 0) {
+          // make-map
+          definedFunctionMakeMap(evaluated, env, context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "map-get") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "map-has") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "map-del") == 0) {
+          // map-get, map-has, map-del
+          struct Object *operand1 = allocate(context, env);
+          struct Object *operand2 = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand1, env,
+                             context);
+          evaluateExpression(expressions->next->next->expression, operand2, env,
+                             context);
+          char *name = expr->data.symbol->symbol_name;
+          if (strcmp(name, "map-get") == 0) {
+            definedFunctionMapGet(operand1, operand2, evaluated);
+          } else if (strcmp(name, "map-has") == 0) {
+            definedFunctionMapHas(operand1, operand2, evaluated);
+          } else {
+            definedFunctionMapDel(operand1, operand2, evaluated);
+          }
+        } else if (strcmp(expr->data.symbol->symbol_name, "map-set") == 0) {
+          // map-set
           struct Object *operand1 = allocate(context, env);
           struct Object *operand2 = allocate(context, env);
+          struct Object *operand3 = allocate(context, env);
           evaluateExpression(expressions->next->expression, operand1, env,
                              context);
           evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
-          definedFunctionEq(operand1, operand2, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "not") == 0) {
-          // not
-          struct Object *operand = allocate(context, env);
-          evaluateExpression(expressions->next->expression, operand, env,
-                             context);
-          definedFunctionNot(operand, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "print") == 0) {
-          // print
-          struct Object *operand = allocate(context, env);
-          evaluateExpression(expressions->next->expression, operand, env,
-                             context);
-          char *str = stringifyObject(operand);
-          printf("%s\n", str);
-          free(str);
-          evaluated->type = OBJ_NIL;
-        } else if (strcmp(expr->data.symbol->symbol_name, "car") == 0) {
-          // car
+          evaluateExpression(expressions->next->next->next->expression,
+                             operand3, env, context);
+          definedFunctionMapSet(operand1, operand2, operand3, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "map-keys") == 0) {
+          // map-keys
           struct Object *operand = allocate(context, env);
           evaluateExpression(expressions->next->expression, operand, env,
                              context);
-          definedFunctionCar(operand, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "cdr") == 0) {
-          // cdr
+          definedFunctionMapKeys(operand, evaluated, env, context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "map-size") == 0) {
+          // map-size
           struct Object *operand = allocate(context, env);
           evaluateExpression(expressions->next->expression, operand, env,
                              context);
-          definedFunctionCdr(operand, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "cons") == 0) {
-          // cons
+          definedFunctionMapSize(operand, evaluated);
+        } else if (strcmp(expr->data.symbol->symbol_name, "pvec-conj") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "pvec-ref") == 0) {
+          // pvec-conj, pvec-ref
           struct Object *operand1 = allocate(context, env);
           struct Object *operand2 = allocate(context, env);
           evaluateExpression(expressions->next->expression, operand1, env,
                              context);
           evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
-          definedFunctionCons(operand1, operand2, evaluated, env, context);
-        } else if (strcmp(expr->data.symbol->symbol_name, "readline") == 0) {
-          // readline
-          char *line = NULL;
-          size_t len = 0;
-          ssize_t read;
-          if ((read = getline(&line, &len, stdin)) != -1) {
-            evaluated->type = OBJ_STRING;
-            // trim newline
-            line[read - 1] = '\0';
-            evaluated->string_value = line;
+          if (strcmp(expr->data.symbol->symbol_name, "pvec-conj") == 0) {
+            definedFunctionPvecConj(operand1, operand2, evaluated, env,
+                                    context);
           } else {
-            evaluated->type = OBJ_NIL;
+            definedFunctionPvecRef(operand1, operand2, evaluated);
           }
-        } else if (strcmp(expr->data.symbol->symbol_name, "split") == 0) {
-          // split
+        } else if (strcmp(expr->data.symbol->symbol_name, "pvec-assoc") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "phash-assoc") == 0) {
+          // pvec-assoc, phash-assoc
           struct Object *operand1 = allocate(context, env);
           struct Object *operand2 = allocate(context, env);
+          struct Object *operand3 = allocate(context, env);
           evaluateExpression(expressions->next->expression, operand1, env,
                              context);
           evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
-          definedFunctionSplit(operand1, operand2, evaluated, env, context);
-        } else if (strcmp(expr->data.symbol->symbol_name, "list-ref") == 0) {
-          // list-ref
+          evaluateExpression(expressions->next->next->next->expression,
+                             operand3, env, context);
+          if (strcmp(expr->data.symbol->symbol_name, "pvec-assoc") == 0) {
+            definedFunctionPvecAssoc(operand1, operand2, operand3, evaluated,
+                                     env, context);
+          } else {
+            definedFunctionPhashAssoc(operand1, operand2, operand3, evaluated,
+                                      env, context);
+          }
+        } else if (strcmp(expr->data.symbol->symbol_name, "pvec-count") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "phash-count") == 0) {
+          // pvec-count, phash-count
+          struct Object *operand = allocate(context, env);
+          evaluateExpression(expressions->next->expression, operand, env,
+                             context);
+          if (strcmp(expr->data.symbol->symbol_name, "pvec-count") == 0) {
+            definedFunctionPvecCount(operand, evaluated);
+          } else {
+            definedFunctionPhashCount(operand, evaluated);
+          }
+        } else if (strcmp(expr->data.symbol->symbol_name, "make-phash") == 0) {
+          // make-phash
+          definedFunctionMakePhash(evaluated, env, context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "phash-dissoc") ==
+                       0 ||
+                   strcmp(expr->data.symbol->symbol_name, "phash-get") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "phash-has") == 0) {
+          // phash-dissoc, phash-get, phash-has
           struct Object *operand1 = allocate(context, env);
           struct Object *operand2 = allocate(context, env);
           evaluateExpression(expressions->next->expression, operand1, env,
                              context);
           evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
-          definedFunctionListRef(operand1, operand2, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "progn") == 0) {
-          // progn
-          struct ExpressionList *exprs = expressions->next;
-          struct Object *operand = NULL;
-          while (exprs != NULL) {
-            operand = allocate(context, env);
-            evaluateExpression(exprs->expression, operand, env, context);
-            exprs = exprs->next;
-          }
-          if (operand != NULL) {
-            *evaluated = *operand;
+          char *name = expr->data.symbol->symbol_name;
+          if (strcmp(name, "phash-dissoc") == 0) {
+            definedFunctionPhashDissoc(operand1, operand2, evaluated, env,
+                                       context);
+          } else if (strcmp(name, "phash-get") == 0) {
+            definedFunctionPhashGet(operand1, operand2, evaluated);
           } else {
-            evaluated->type = OBJ_NIL;
+            definedFunctionPhashHas(operand1, operand2, evaluated);
           }
-        } else if (strcmp(expr->data.symbol->symbol_name,
-                          "remove-whitespaces") == 0) {
-          // remove-whitespaces
-          struct Object *operand = allocate(context, env);
-          evaluateExpression(expressions->next->expression, operand, env,
-                             context);
-          definedFunctionRemoveWhitespaces(operand, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "pop") == 0) {
-          // pop
+        } else if (strcmp(expr->data.symbol->symbol_name, "phash-keys") == 0) {
+          // phash-keys
           struct Object *operand = allocate(context, env);
           evaluateExpression(expressions->next->expression, operand, env,
                              context);
-          definedFunctionPop(operand, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "push") == 0) {
-          // push
+          definedFunctionPhashKeys(operand, evaluated, env, context);
+        } else if (strcmp(expr->data.symbol->symbol_name, "map") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "filter") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "for-each") == 0 ||
+                   strcmp(expr->data.symbol->symbol_name, "pmap") == 0) {
+          // map, filter, for-each, pmap
           struct Object *operand1 = allocate(context, env);
           struct Object *operand2 = allocate(context, env);
-          evaluateExpression(expressions->next->next->expression, operand1, env,
-                             context);
-          evaluateExpression(expressions->next->expression, operand2, env,
-                             context);
-          definedFunctionPush(operand2, operand1, evaluated, env, context);
-        } else if (strcmp(expr->data.symbol->symbol_name, "length") == 0) {
-          // length
-          struct Object *operand = allocate(context, env);
-          evaluateExpression(expressions->next->expression, operand, env,
-                             context);
-          definedFunctionLength(operand, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "is-int-string") ==
-                   0) {
-          // is-int-string
-          struct Object *operand = allocate(context, env);
-          evaluateExpression(expressions->next->expression, operand, env,
+          evaluateExpression(expressions->next->expression, operand1, env,
                              context);
-          definedFunctionIsIntString(operand, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "parse-int") == 0) {
-          // parse-int
-          struct Object *operand = allocate(context, env);
-          evaluateExpression(expressions->next->expression, operand, env,
+          evaluateExpression(expressions->next->next->expression, operand2, env,
                              context);
-          definedFunctionParseInt(operand, evaluated);
-        } else if (strcmp(expr->data.symbol->symbol_name, "string-ref") == 0) {
-          // string-ref
+          char *name = expr->data.symbol->symbol_name;
+          if (strcmp(name, "map") == 0) {
+            definedFunctionMap(operand1, operand2, evaluated, env, context);
+          } else if (strcmp(name, "pmap") == 0) {
+            definedFunctionPmap(operand1, operand2, evaluated, env, context);
+          } else if (strcmp(name, "filter") == 0) {
+            definedFunctionFilter(operand1, operand2, evaluated, env, context);
+          } else {
+            definedFunctionForEach(operand1, operand2, evaluated, env, context);
+          }
+        } else if (strcmp(expr->data.symbol->symbol_name, "reduce") == 0) {
+          // reduce
           struct Object *operand1 = allocate(context, env);
           struct Object *operand2 = allocate(context, env);
+          struct Object *operand3 = allocate(context, env);
           evaluateExpression(expressions->next->expression, operand1, env,
                              context);
           evaluateExpression(expressions->next->next->expression, operand2, env,
-                              context);
-          definedFunctionStringRef(operand1, operand2, evaluated);
+                             context);
+          evaluateExpression(expressions->next->next->next->expression,
+                             operand3, env, context);
+          definedFunctionReduce(operand1, operand2, operand3, evaluated, env,
+                                context);
         } else {
           // function call
-          int i = 0;
-          struct Env *current_env = env;
-          struct Env *looked_up_env = current_env;
-          while (looked_up_env->bindings[i].symbol_name != NULL) {
-            if (strcmp(looked_up_env->bindings[i].symbol_name,
-                       expr->data.symbol->symbol_name) == 0) {
-              struct Function *function =
-                  looked_up_env->bindings[i].value->function_value;
-              struct Env *new_env = malloc(sizeof(struct Env));
-              new_env->parent = current_env;
-              int j = 0;
-              struct ExpressionList *param_expr = expressions->next;
-              while (function->param_symbol_names[j] != NULL) {
-                struct Object *param = allocate(context, env);
-                evaluateExpression(param_expr->expression, param, current_env,
-                                   context);
-                param_expr = param_expr->next;
-                setObjectToEnv(new_env, function->param_symbol_names[j], param);
-                j++;
-              }
-              evaluateExpression(function->body, evaluated, new_env, context);
-              return;
-            }
-            i++;
-            // look up the parent env if not found
-            if (env->bindings[i].symbol_name == NULL) {
-              looked_up_env = looked_up_env->parent;
-              i = 0;
-            }
+          struct SymbolicExpNode *call = expression->data.symbolic_exp;
+          struct Binding *local = frameBinding(expr->data.symbol, env);
+          struct Function *function =
+              local != NULL && local->value != NULL
+                  ? bindingFunction(local, expr->data.symbol->symbol_name)
+                  : lookupCachedFunction(env, expr->data.symbol->symbol_name,
+                                         &call->cached_function,
+                                         &call->cached_version);
+
+          // nothing refers to the frame of a call once it returns
+          struct Binding frame[function->frame_size > 0 ? function->frame_size
+                                                         : 1];
+          int j = 0;
+          struct ExpressionList *param_expr = expressions->next;
+          while (j < function->arity && param_expr != NULL) {
+            struct Object *param = allocate(context, env);
+            evaluateExpression(param_expr->expression, param, env, context);
+            frame[j].symbol_name = function->param_symbol_names[j];
+            frame[j].value = param;
+            param_expr = param_expr->next;
+            j++;
           }
-          printf("Undefined function: %s\n", expr->data.symbol->symbol_name);
-          exit(1);
+          if (j < function->arity || param_expr != NULL) {
+            printf("Arity error: %s takes %d arguments.\n",
+                   expr->data.symbol->symbol_name, function->arity);
+            exit(1);
+          }
+          invokeFunction(function, frame, evaluated, env, context);
         }
       }
     } else {
-      printf("S-exp must be started with symbol.\n");
-      exit(1);
+      printf("S-exp must be started with symbol.\n");
+      exit(1);
+    }
+  } else {
+    evaluated->type = OBJ_NIL;
+  }
+}
+
+void evaluateLiteralExpression(struct ExpressionNode *expression,
+                               struct Object *evaluated) {
+  if (expression->data.literal->type == LIT_INTERGER) {
+    evaluated->type = OBJ_INTEGER;
+    evaluated->int_value = expression->data.literal->int_value;
+  } else if (expression->data.literal->type == LIT_STRING) {
+    evaluated->type = OBJ_STRING;
+    evaluated->string_value = expression->data.literal->string_value;
+    // the object shares the characters, interned ones are never freed
+    if (!stringHeader(evaluated->string_value)->interned) {
+      retainExpression(expression);
+    }
+  } else if (expression->data.literal->type == LIT_BOOLEAN) {
+    evaluated->type = OBJ_BOOL;
+    evaluated->bool_value = expression->data.literal->boolean_value;
+  }
+}
+
+void loadSymbol(char *symbol_name, struct Object *evaluated,
+                struct Env *env) {
+  if (strcmp(symbol_name, "nil") == 0) {
+    evaluated->type = OBJ_NIL;
+  } else {
+    // get symbol value from env, evaluated is a copy so that it can be a
+    // temporary of the caller
+    struct Binding *binding = lookupBinding(env, symbol_name);
+    if (binding == NULL) {
+      printf("Undefined symbol: %s\n", symbol_name);
+      exit(1);
+    }
+    *evaluated = *binding->value;
+  }
+}
+
+void evaluateSymbolExpression(struct ExpressionNode *expression,
+                              struct Object *evaluated, struct Env *env) {
+  struct Binding *local = frameBinding(expression->data.symbol, env);
+  if (local != NULL && local->value != NULL) {
+    *evaluated = *local->value;
+    return;
+  }
+  loadSymbol(expression->data.symbol->symbol_name, evaluated, env);
+}
+
+void evaluateExpression(struct ExpressionNode *expression,
+                        struct Object *evaluated, struct Env *env,
+                        struct AllocatorContext *context) {
+  // objects allocated while evaluating stay on the stack until the result is
+  // stored in evaluated
+  int top = context->stack->top;
+  pushObjectStack(context->stack, evaluated);
+  if (expression->type == EXP_LIST) {
+    evaluateListExpression(expression, evaluated, env, context);
+  } else if (expression->type == EXP_SYMBOLIC_EXP) {
+    evaluateSymbolicExpression(expression, evaluated, env, context);
+  } else if (expression->type == EXP_LITERAL) {
+    evaluateLiteralExpression(expression, evaluated);
+  } else if (expression->type == EXP_SYMBOL) {
+    evaluateSymbolExpression(expression, evaluated, env);
+  }
+  context->stack->top = top;
+}
+
+void evaluateExpressionWithContext(struct ExpressionNode *expression,
+                                   struct Object *evaluated, struct Env *env) {
+  struct AllocatorContext *context = initAllocator();
+  evaluateExpression(expression, evaluated, env, context);
+}
+
+void initEnv(struct Env *env) {
+  env->bindings = malloc(sizeof(struct Binding) * ENV_INITIAL_CAPACITY);
+  env->size = 0;
+  env->capacity = ENV_INITIAL_CAPACITY;
+  env->frame = false;
+  env->parent = NULL;
+  env->shadows_global_function = false;
+}
+
+void evaluateProgram(struct ProgramNode *program) {
+  struct ExpressionList *expressions = program->expressions;
+
+  struct Env *env = malloc(sizeof(struct Env));
+  initEnv(env);
+
+  struct AllocatorContext *context = initAllocator();
+
+  while (expressions != NULL) {
+    struct Object *evaluated = allocate(context, env);
+    evaluateExpression(expressions->expression, evaluated, env, context);
+    popObjectStack(context->stack);
+    expressions = expressions->next;
+  }
+}
+
+void evaluate(struct ParseResult *result) { evaluateProgram(result->program); }
+
+// =================================================
+//   optimizer
+//     -O1 folds pure builtins on literal operands and prunes constant
+//         conditions of if, && and ||
+//     -O2 also flattens nested progn and drops side-effect-free operands
+//         of progn that are not in tail position
+// =================================================
+
+struct Optimizer {
+  int level;
+  // replaced nodes were allocated with malloc and can be freed
+  bool release;
+  // folding evaluates the builtins themselves
+  struct AllocatorContext *context;
+  struct Env env;
+};
+
+bool isSymbolNamed(struct ExpressionNode *expression, char *name) {
+  return expression->type == EXP_SYMBOL &&
+         strcmp(expression->data.symbol->symbol_name, name) == 0;
+}
+
+bool isLiteralOfType(struct ExpressionNode *expression, enum LiteralType type) {
+  return expression->type == EXP_LITERAL &&
+         expression->data.literal->type == type;
+}
+
+// side-effect-free expressions whose value is known before evaluation
+bool isConstantExpression(struct ExpressionNode *expression) {
+  return expression->type == EXP_LITERAL || isSymbolNamed(expression, "nil") ||
+         (expression->type == EXP_LIST && isConstantListExpression(expression));
+}
+
+bool constantTruth(struct ExpressionNode *expression) {
+  if (expression->type == EXP_LITERAL) {
+    return expression->data.literal->type != LIT_BOOLEAN ||
+           expression->data.literal->boolean_value;
+  } else if (expression->type == EXP_LIST) {
+    // empty data list is evaluated as nil
+    return expression->data.list->expressions != NULL;
+  }
+  return false;
+}
+
+void releaseExpressionList(struct Optimizer *optimizer,
+                           struct ExpressionList *expressions,
+                           struct ExpressionNode *kept) {
+  if (!optimizer->release) {
+    return;
+  }
+  while (expressions != NULL) {
+    struct ExpressionList *next = expressions->next;
+    if (expressions->expression == kept) {
+      // its contents were moved to the replaced expression
+      free(kept);
+    } else {
+      freeExpression(expressions->expression);
+    }
+    free(expressions);
+    expressions = next;
+  }
+}
+
+// replace a symbolic expression by one of its operands
+void replaceWithOperand(struct Optimizer *optimizer,
+                        struct ExpressionNode *expression,
+                        struct ExpressionNode *operand) {
+  struct SymbolicExpNode *symbolic_exp = expression->data.symbolic_exp;
+  *expression = *operand;
+  releaseExpressionList(optimizer, symbolic_exp->expressions, operand);
+  if (optimizer->release) {
+    free(symbolic_exp);
+  }
+}
+
+void replaceWithLiteral(struct Optimizer *optimizer,
+                        struct ExpressionNode *expression,
+                        struct LiteralNode *literal) {
+  struct SymbolicExpNode *symbolic_exp = expression->data.symbolic_exp;
+  expression->type = EXP_LITERAL;
+  expression->data.literal = literal;
+  releaseExpressionList(optimizer, symbolic_exp->expressions, NULL);
+  if (optimizer->release) {
+    free(symbolic_exp);
+  }
+}
+
+void replaceWithBoolean(struct Optimizer *optimizer,
+                        struct ExpressionNode *expression, bool value) {
+  struct LiteralNode *literal = malloc(sizeof(struct LiteralNode));
+  literal->type = LIT_BOOLEAN;
+  literal->boolean_value = value;
+  replaceWithLiteral(optimizer, expression, literal);
+}
+
+void replaceWithNil(struct Optimizer *optimizer,
+                    struct ExpressionNode *expression) {
+  struct SymbolicExpNode *symbolic_exp = expression->data.symbolic_exp;
+  struct SymbolNode *symbol = malloc(sizeof(struct SymbolNode));
+  symbol->symbol_name = strdup("nil");
+  symbol->slot = -1;
+  expression->type = EXP_SYMBOL;
+  expression->data.symbol = symbol;
+  releaseExpressionList(optimizer, symbolic_exp->expressions, NULL);
+  if (optimizer->release) {
+    free(symbolic_exp);
+  }
+}
+
+void removeOperand(struct Optimizer *optimizer, struct ExpressionList **link) {
+  struct ExpressionList *removed = *link;
+  *link = removed->next;
+  if (optimizer->release) {
+    freeExpression(removed->expression);
+    free(removed);
+  }
+}
+
+int countOperands(struct ExpressionList *operands) {
+  int count = 0;
+  while (operands != NULL) {
+    count++;
+    operands = operands->next;
+  }
+  return count;
+}
+
+// check that evaluating the builtin on the literal operands cannot fail, so
+// that folding does not move a runtime error
+bool isFoldable(char *name, struct ExpressionList *operands) {
+  int count = countOperands(operands);
+  for (struct ExpressionList *op = operands; op != NULL; op = op->next) {
+    if (op->expression->type != EXP_LITERAL) {
+      return false;
+    }
+  }
+  struct ExpressionNode *op1 = count > 0 ? operands->expression : NULL;
+  struct ExpressionNode *op2 = count > 1 ? operands->next->expression : NULL;
+
+  if (count == 2 && strcmp(name, "+") == 0) {
+    return (isLiteralOfType(op1, LIT_INTERGER) &&
+            isLiteralOfType(op2, LIT_INTERGER)) ||
+           (isLiteralOfType(op1, LIT_STRING) &&
+            isLiteralOfType(op2, LIT_STRING));
+  } else if (count == 2 &&
+             (strcmp(name, "-") == 0 || strcmp(name, "*") == 0 ||
+              strcmp(name, "<") == 0 || strcmp(name, ">") == 0)) {
+    return isLiteralOfType(op1, LIT_INTERGER) &&
+           isLiteralOfType(op2, LIT_INTERGER);
+  } else if (count == 2 && (strcmp(name, "/") == 0 || strcmp(name, "%") == 0)) {
+    return isLiteralOfType(op1, LIT_INTERGER) &&
+           isLiteralOfType(op2, LIT_INTERGER) &&
+           op2->data.literal->int_value != 0 &&
+           !(op1->data.literal->int_value == INT_MIN &&
+             op2->data.literal->int_value == -1);
+  } else if (count == 2 && strcmp(name, "eq") == 0) {
+    return true;
+  } else if (count == 2 && strcmp(name, "string-ref") == 0) {
+    return isLiteralOfType(op1, LIT_STRING) &&
+           isLiteralOfType(op2, LIT_INTERGER) &&
+           op2->data.literal->int_value >= 0 &&
+           op2->data.literal->int_value <
+               stringLength(op1->data.literal->string_value);
+  } else if (count == 1 && strcmp(name, "not") == 0) {
+    return isLiteralOfType(op1, LIT_BOOLEAN);
+  } else if (count == 1 && strcmp(name, "is-int-string") == 0) {
+    return true;
+  } else if (count == 1 && strcmp(name, "parse-int") == 0) {
+    if (!isLiteralOfType(op1, LIT_STRING)) {
+      return false;
+    }
+    for (char *c = op1->data.literal->string_value; *c; c++) {
+      if (!isdigit(*c)) {
+        return false;
+      }
+    }
+    return true;
+  } else if (count == 1 && (strcmp(name, "length") == 0 ||
+                            strcmp(name, "remove-whitespaces") == 0)) {
+    return isLiteralOfType(op1, LIT_STRING);
+  }
+  return false;
+}
+
+void foldBuiltin(struct Optimizer *optimizer,
+                 struct ExpressionNode *expression) {
+  struct Object folded;
+  evaluateExpression(expression, &folded, &optimizer->env, optimizer->context);
+
+  // builtins return fresh strings, so the literal can own them
+  struct LiteralNode *literal = malloc(sizeof(struct LiteralNode));
+  if (folded.type == OBJ_INTEGER) {
+    literal->type = LIT_INTERGER;
+    literal->int_value = folded.int_value;
+  } else if (folded.type == OBJ_STRING) {
+    literal->type = LIT_STRING;
+    literal->string_value = folded.string_value;
+  } else {
+    literal->type = LIT_BOOLEAN;
+    literal->boolean_value = folded.bool_value;
+  }
+  replaceWithLiteral(optimizer, expression, literal);
+}
+
+void optimizeIf(struct Optimizer *optimizer,
+                struct ExpressionNode *expression) {
+  struct ExpressionList *operands =
+      expression->data.symbolic_exp->expressions->next;
+  int count = countOperands(operands);
+  if ((count != 2 && count != 3) || !isConstantExpression(operands->expression)) {
+    return;
+  }
+  if (constantTruth(operands->expression)) {
+    replaceWithOperand(optimizer, expression, operands->next->expression);
+  } else if (count == 3) {
+    replaceWithOperand(optimizer, expression,
+                       operands->next->next->expression);
+  } else {
+    replaceWithNil(optimizer, expression);
+  }
+}
+
+// && and || always evaluate to a boolean, so only constant operands are
+// removed and the form is kept while a non-constant one is left
+void optimizeLogical(struct Optimizer *optimizer,
+                     struct ExpressionNode *expression, bool is_or) {
+  struct ExpressionList **link =
+      &expression->data.symbolic_exp->expressions->next;
+  while (*link != NULL) {
+    struct ExpressionNode *operand = (*link)->expression;
+    if (!isConstantExpression(operand)) {
+      link = &(*link)->next;
+      continue;
+    }
+    if (constantTruth(operand) == is_or) {
+      // the result is decided here, later operands are never evaluated
+      while ((*link)->next != NULL) {
+        removeOperand(optimizer, &(*link)->next);
+      }
+      if (link == &expression->data.symbolic_exp->expressions->next) {
+        replaceWithBoolean(optimizer, expression, is_or);
+      }
+      return;
+    }
+    removeOperand(optimizer, link);
+  }
+  if (expression->data.symbolic_exp->expressions->next == NULL) {
+    replaceWithBoolean(optimizer, expression, !is_or);
+  }
+}
+
+bool isProgn(struct ExpressionNode *expression) {
+  return expression->type == EXP_SYMBOLIC_EXP &&
+         expression->data.symbolic_exp->expressions != NULL &&
+         isSymbolNamed(expression->data.symbolic_exp->expressions->expression,
+                       "progn");
+}
+
+void optimizeProgn(struct Optimizer *optimizer,
+                   struct ExpressionNode *expression) {
+  struct ExpressionList **link =
+      &expression->data.symbolic_exp->expressions->next;
+  while (*link != NULL) {
+    struct ExpressionList *item = *link;
+    if (isProgn(item->expression) &&
+        item->expression->data.symbolic_exp->expressions->next != NULL) {
+      // splice the operands of the nested progn in place of it
+      struct ExpressionList *head =
+          item->expression->data.symbolic_exp->expressions;
+      struct ExpressionList *last = head->next;
+      while (last->next != NULL) {
+        last = last->next;
+      }
+      last->next = item->next;
+      *link = head->next;
+      if (optimizer->release) {
+        freeExpression(head->expression);
+        free(head);
+        free(item->expression->data.symbolic_exp);
+        free(item->expression);
+        free(item);
+      }
+      continue;
+    }
+    if (item->next != NULL && isConstantExpression(item->expression)) {
+      removeOperand(optimizer, link);
+      continue;
+    }
+    link = &item->next;
+  }
+}
+
+void optimizeExpression(struct Optimizer *optimizer,
+                        struct ExpressionNode *expression) {
+  struct ExpressionList *expressions = NULL;
+  if (expression->type == EXP_SYMBOLIC_EXP) {
+    expressions = expression->data.symbolic_exp->expressions;
+  } else if (expression->type == EXP_LIST) {
+    expressions = expression->data.list->expressions;
+  }
+  for (struct ExpressionList *item = expressions; item != NULL;
+       item = item->next) {
+    optimizeExpression(optimizer, item->expression);
+  }
+
+  if (expression->type != EXP_SYMBOLIC_EXP || expressions == NULL ||
+      expressions->expression->type != EXP_SYMBOL) {
+    return;
+  }
+  // builtins are looked up before user functions, so their names always refer
+  // to them
+  char *name = expressions->expression->data.symbol->symbol_name;
+  if (strcmp(name, "if") == 0) {
+    optimizeIf(optimizer, expression);
+  } else if (strcmp(name, "&&") == 0 || strcmp(name, "||") == 0) {
+    optimizeLogical(optimizer, expression, strcmp(name, "||") == 0);
+  } else if (strcmp(name, "progn") == 0) {
+    if (optimizer->level >= 2) {
+      optimizeProgn(optimizer, expression);
+    }
+  } else if (isFoldable(name, expressions->next)) {
+    foldBuiltin(optimizer, expression);
+  }
+}
+
+void optimizeProgram(struct ProgramNode *program, int level, bool release) {
+  if (level <= 0) {
+    return;
+  }
+  struct Optimizer optimizer;
+  optimizer.level = level;
+  optimizer.release = release;
+  optimizer.context = initAllocator();
+  initEnv(&optimizer.env);
+
+  for (struct ExpressionList *expressions = program->expressions;
+       expressions != NULL; expressions = expressions->next) {
+    optimizeExpression(&optimizer, expressions->expression);
+  }
+  freeAllocator(optimizer.context);
+}
+
+// =================================================
+//   ahead-of-time compiler
+//     Translates a program to C for worspc. Every expression becomes the
+//     statements evaluateExpression would run for it, calling the builtins
+//     of the runtime directly, and every defun gets a C function for its
+//     body. Variables and calls are still resolved through the env, so the
+//     dynamic scoping of the interpreter is kept.
+// =================================================
+
+struct Compiler {
+  FILE *out;
+  int indent;
+  // names of temporaries and call site caches
+  int temp_count;
+  // the body of defun i is translated to wsp_function_i
+  struct ExpressionNode **functions;
+  int function_count;
+};
+
+// a builtin that evaluates its operands and calls definedFunction*
+struct CompiledBuiltin {
+  char *name;
+  int operand_count;
+  char *function;
+  // the builtin takes the env and the allocator after evaluated
+  bool allocates;
+  // operator computing the result inline when both operands are integers
+  char *integer_operator;
+  ObjectType integer_result;
+};
+
+struct CompiledBuiltin compiled_builtins[] = {
+    {"+", 2, "definedFunctionAdd", false, "+", OBJ_INTEGER},
+    {"-", 2, "definedFunctionSub", false, "-", OBJ_INTEGER},
+    {"*", 2, "definedFunctionMul", false, "*", OBJ_INTEGER},
+    {"<", 2, "definedFunctionLt", false, "<", OBJ_BOOL},
+    {">", 2, "definedFunctionGt", false, ">", OBJ_BOOL},
+    {"eq", 2, "definedFunctionEq", false, "==", OBJ_BOOL},
+    {"/", 2, "definedFunctionDiv", false, NULL, OBJ_NIL},
+    {"%", 2, "definedFunctionMod", false, NULL, OBJ_NIL},
+    {"list-ref", 2, "definedFunctionListRef", false, NULL, OBJ_NIL},
+    {"string-ref", 2, "definedFunctionStringRef", false, NULL, OBJ_NIL},
+    {"cons", 2, "definedFunctionCons", true, NULL, OBJ_NIL},
+    {"split", 2, "definedFunctionSplit", true, NULL, OBJ_NIL},
+    {"not", 1, "definedFunctionNot", false, NULL, OBJ_NIL},
+    {"print", 1, "definedFunctionPrint", false, NULL, OBJ_NIL},
+    {"car", 1, "definedFunctionCar", false, NULL, OBJ_NIL},
+    {"length", 1, "definedFunctionLength", false, NULL, OBJ_NIL},
+    {"is-int-string", 1, "definedFunctionIsIntString", false, NULL, OBJ_NIL},
+    {"parse-int", 1, "definedFunctionParseInt", false, NULL, OBJ_NIL},
+    {"remove-whitespaces", 1, "definedFunctionRemoveWhitespaces", false, NULL,
+     OBJ_NIL},
+    {"cdr", 1, "definedFunctionCdr", true, NULL, OBJ_NIL},
+    {"pop", 1, "definedFunctionPop", true, NULL, OBJ_NIL},
+    {"map", 2, "definedFunctionMap", true, NULL, OBJ_NIL},
+    {"filter", 2, "definedFunctionFilter", true, NULL, OBJ_NIL},
+    {"for-each", 2, "definedFunctionForEach", true, NULL, OBJ_NIL},
+    {"pmap", 2, "definedFunctionPmap", true, NULL, OBJ_NIL},
+    {"substring", 3, "definedFunctionSubstring", false, NULL, OBJ_NIL},
+    {"make-string-builder", 0, "definedFunctionMakeStringBuilder", true, NULL,
+     OBJ_NIL},
+    {"sb-append", 2, "definedFunctionSbAppend", false, NULL, OBJ_NIL},
+    {"sb-build", 1, "definedFunctionSbBuild", false, NULL, OBJ_NIL},
+    {"vector-ref", 2, "definedFunctionVectorRef", false, NULL, OBJ_NIL},
+    {"vector-set", 3, "definedFunctionVectorSet", false, NULL, OBJ_NIL},
+    {"vector-push", 2, "definedFunctionVectorPush", false, NULL, OBJ_NIL},
+    {"vector-pop", 1, "definedFunctionVectorPop", false, NULL, OBJ_NIL},
+    {"vector-length", 1, "definedFunctionVectorLength", false, NULL, OBJ_NIL},
+    {"make-map", 0, "definedFunctionMakeMap", true, NULL, OBJ_NIL},
+    {"map-get", 2, "definedFunctionMapGet", false, NULL, OBJ_NIL},
+    {"map-set", 3, "definedFunctionMapSet", false, NULL, OBJ_NIL},
+    {"map-has", 2, "definedFunctionMapHas", false, NULL, OBJ_NIL},
+    {"map-del", 2, "definedFunctionMapDel", false, NULL, OBJ_NIL},
+    {"map-keys", 1, "definedFunctionMapKeys", true, NULL, OBJ_NIL},
+    {"map-size", 1, "definedFunctionMapSize", false, NULL, OBJ_NIL},
+    {"pvec-conj", 2, "definedFunctionPvecConj", true, NULL, OBJ_NIL},
+    {"pvec-assoc", 3, "definedFunctionPvecAssoc", true, NULL, OBJ_NIL},
+    {"pvec-ref", 2, "definedFunctionPvecRef", false, NULL, OBJ_NIL},
+    {"pvec-count", 1, "definedFunctionPvecCount", false, NULL, OBJ_NIL},
+    {"make-phash", 0, "definedFunctionMakePhash", true, NULL, OBJ_NIL},
+    {"phash-assoc", 3, "definedFunctionPhashAssoc", true, NULL, OBJ_NIL},
+    {"phash-dissoc", 2, "definedFunctionPhashDissoc", true, NULL, OBJ_NIL},
+    {"phash-get", 2, "definedFunctionPhashGet", false, NULL, OBJ_NIL},
+    {"phash-has", 2, "definedFunctionPhashHas", false, NULL, OBJ_NIL},
+    {"phash-count", 1, "definedFunctionPhashCount", false, NULL, OBJ_NIL},
+    {"phash-keys", 1, "definedFunctionPhashKeys", true, NULL, OBJ_NIL},
+    {"reduce", 3, "definedFunctionReduce", true, NULL, OBJ_NIL},
+    {"readline", 0, "definedFunctionReadline", false, NULL, OBJ_NIL},
+    {NULL, 0, NULL, false, NULL, OBJ_NIL},
+};
+
+// every name evaluateSymbolicExpression handles before defined functions
+bool isBuiltinName(char *name) {
+  for (int i = 0; special_forms[i] != NULL; i++) {
+    if (strcmp(special_forms[i], name) == 0) {
+      return true;
+    }
+  }
+  for (int i = 0; compiled_builtins[i].name != NULL; i++) {
+    if (strcmp(compiled_builtins[i].name, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void compileExpression(struct Compiler *compiler,
+                       struct ExpressionNode *expression, char *target);
+
+void emitLine(struct Compiler *compiler, char *format, ...) {
+  fprintf(compiler->out, "%*s", compiler->indent * 2, "");
+  va_list args;
+  va_start(args, format);
+  vfprintf(compiler->out, format, args);
+  va_end(args);
+  fputc('\n', compiler->out);
+}
+
+// C string literal with the same characters as str
+char *quoteCString(char *str) {
+  char *quoted = malloc(strlen(str) * 4 + 3);
+  char *p = quoted;
+  *p++ = '"';
+  for (; *str != '\0'; str++) {
+    unsigned char ch = *str;
+    if (ch == '"' || ch == '\\') {
+      *p++ = '\\';
+      *p++ = ch;
+    } else if (isprint(ch)) {
+      *p++ = ch;
+    } else {
+      p += sprintf(p, "\\%03o", ch);
     }
-  } else {
-    evaluated->type = OBJ_NIL;
   }
+  *p++ = '"';
+  *p = '\0';
+  return quoted;
 }
 
-void evaluateLiteralExpression(struct ExpressionNode *expression,
-                               struct Object *evaluated) {
-  if (expression->data.literal->type == LIT_INTERGER) {
-    evaluated->type = OBJ_INTEGER;
-    evaluated->int_value = expression->data.literal->int_value;
-  } else if (expression->data.literal->type == LIT_STRING) {
-    evaluated->type = OBJ_STRING;
-    evaluated->string_value = expression->data.literal->string_value;
-  } else if (expression->data.literal->type == LIT_BOOLEAN) {
-    evaluated->type = OBJ_BOOL;
-    evaluated->bool_value = expression->data.literal->boolean_value;
+// static char *<prefix><id>[] = {"a", "b", NULL}; for NULL terminated names
+void emitNameArray(struct Compiler *compiler, char *prefix, int id,
+                   char **names) {
+  fprintf(compiler->out, "%*sstatic char *%s%d[] = {", compiler->indent * 2, "",
+          prefix, id);
+  for (; *names != NULL; names++) {
+    char *quoted = quoteCString(*names);
+    fprintf(compiler->out, "%s, ", quoted);
+    free(quoted);
   }
+  fprintf(compiler->out, "NULL};\n");
 }
 
-void evaluateSymbolExpression(struct ExpressionNode *expression,
-                              struct Object *evaluated, struct Env *env,
-                              struct AllocatorContext *context) {
-  if (strcmp(expression->data.symbol->symbol_name, "nil") == 0) {
-    evaluated->type = OBJ_NIL;
+// a temporary object allocated like the operands of the interpreter
+char *emitTemporary(struct Compiler *compiler) {
+  char *name = malloc(16);
+  snprintf(name, 16, "t%d", compiler->temp_count++);
+  emitLine(compiler, "struct Object *%s = allocate(context, env);", name);
+  return name;
+}
+
+void emitError(struct Compiler *compiler, char *message) {
+  char *quoted = quoteCString(message);
+  emitLine(compiler, "printf(\"%%s\\n\", %s);", quoted);
+  emitLine(compiler, "exit(1);");
+  free(quoted);
+}
+
+// the operand expressions of a form, NULL when there are fewer
+struct ExpressionNode *operandAt(struct ExpressionList *operands, int index) {
+  for (int i = 0; i < index && operands != NULL; i++) {
+    operands = operands->next;
+  }
+  return operands != NULL ? operands->expression : NULL;
+}
+
+bool isWellFormedDefun(struct ExpressionList *expressions) {
+  struct ExpressionNode *params = operandAt(expressions->next, 1);
+  if (operandAt(expressions->next, 0)->type != EXP_SYMBOL || params == NULL ||
+      params->type != EXP_SYMBOLIC_EXP ||
+      operandAt(expressions->next, 2) == NULL) {
+    return false;
+  }
+  for (struct ExpressionList *param = params->data.symbolic_exp->expressions;
+       param != NULL; param = param->next) {
+    if (param->expression->type != EXP_SYMBOL) {
+      return false;
+    }
+    for (struct ExpressionList *other = param->next; other != NULL;
+         other = other->next) {
+      if (other->expression->type == EXP_SYMBOL &&
+          strcmp(other->expression->data.symbol->symbol_name,
+                 param->expression->data.symbol->symbol_name) == 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool isDefunForm(struct ExpressionNode *expression) {
+  if (expression->type != EXP_SYMBOLIC_EXP) {
+    return false;
+  }
+  struct ExpressionList *expressions =
+      expression->data.symbolic_exp->expressions;
+  return expressions != NULL && expressions->next != NULL &&
+         isSymbolNamed(expressions->expression, "defun") &&
+         isWellFormedDefun(expressions);
+}
+
+void collectFunctions(struct Compiler *compiler,
+                      struct ExpressionNode *expression) {
+  struct ExpressionList *expressions = NULL;
+  if (expression->type == EXP_SYMBOLIC_EXP) {
+    expressions = expression->data.symbolic_exp->expressions;
+  } else if (expression->type == EXP_LIST) {
+    expressions = expression->data.list->expressions;
+  }
+  if (isDefunForm(expression)) {
+    compiler->functions =
+        realloc(compiler->functions, sizeof(struct ExpressionNode *) *
+                                         (compiler->function_count + 1));
+    compiler->functions[compiler->function_count++] = expression;
+  }
+  for (; expressions != NULL; expressions = expressions->next) {
+    collectFunctions(compiler, expressions->expression);
+  }
+}
+
+int functionIndex(struct Compiler *compiler,
+                  struct ExpressionNode *expression) {
+  for (int i = 0; i < compiler->function_count; i++) {
+    if (compiler->functions[i] == expression) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void compileDefun(struct Compiler *compiler, struct ExpressionNode *expression,
+                  char *target) {
+  struct ExpressionList *operands =
+      expression->data.symbolic_exp->expressions->next;
+  struct ExpressionNode *params = operandAt(operands, 1);
+  // the same checks as the interpreter, in the same order
+  if (operandAt(operands, 0) == NULL ||
+      operandAt(operands, 0)->type != EXP_SYMBOL) {
+    emitError(compiler, "Function name must be symbol.");
+    return;
+  }
+  if (params == NULL || params->type != EXP_SYMBOLIC_EXP) {
+    emitError(compiler, "Function parameter must be list.");
+    return;
+  }
+  int arity = 0;
+  for (struct ExpressionList *param = params->data.symbolic_exp->expressions;
+       param != NULL; param = param->next) {
+    if (param->expression->type != EXP_SYMBOL) {
+      emitError(compiler, "Function parameter must be symbol.");
+      return;
+    }
+    for (struct ExpressionList *prev = params->data.symbolic_exp->expressions;
+         prev != param; prev = prev->next) {
+      if (strcmp(prev->expression->data.symbol->symbol_name,
+                 param->expression->data.symbol->symbol_name) == 0) {
+        char *param_name = param->expression->data.symbol->symbol_name;
+        char *message = malloc(strlen(param_name) + 32);
+        sprintf(message, "Duplicate parameter: %s", param_name);
+        emitError(compiler, message);
+        free(message);
+        return;
+      }
+    }
+    arity++;
+  }
+  if (operandAt(operands, 2) == NULL) {
+    emitError(compiler, "Function must have body.");
+    return;
+  }
+
+  char **param_symbol_names = malloc(sizeof(char *) * (arity + 1));
+  int i = 0;
+  for (struct ExpressionList *param = params->data.symbolic_exp->expressions;
+       param != NULL; param = param->next) {
+    param_symbol_names[i++] = param->expression->data.symbol->symbol_name;
+  }
+  param_symbol_names[arity] = NULL;
+  struct Function function = (struct Function){};
+  function.param_symbol_names = param_symbol_names;
+  function.arity = arity;
+  int local_count;
+  char **local_symbol_names =
+      frameLocalNames(operandAt(operands, 2), &function, &local_count);
+
+  int id = compiler->temp_count++;
+  emitNameArray(compiler, "params", id, param_symbol_names);
+  emitNameArray(compiler, "locals", id, local_symbol_names);
+  free(param_symbol_names);
+  free(local_symbol_names);
+
+  char *name = quoteCString(operandAt(operands, 0)->data.symbol->symbol_name);
+  emitLine(compiler, "struct Object *function%d = allocate(context, env);",
+           id);
+  emitLine(compiler, "function%d->type = OBJ_FUNCTION;", id);
+  emitLine(compiler,
+           "function%d->function_value = newFunction(params%d, %d, locals%d, "
+           "%d, NULL, wsp_function_%d);",
+           id, id, arity, id, arity + local_count,
+           functionIndex(compiler, expression));
+  emitLine(compiler, "*%s = *function%d;", target, id);
+  emitLine(compiler, "setObjectToEnv(env, %s, function%d);", name, id);
+  free(name);
+}
+
+void compileCall(struct Compiler *compiler, char *symbol_name,
+                 struct ExpressionList *operands, char *target) {
+  int id = compiler->temp_count++;
+  char *name = quoteCString(symbol_name);
+  // an inline cache like the one of the call sites of the interpreter
+  emitLine(compiler, "static struct Function *cached_function%d = NULL;", id);
+  emitLine(compiler, "static unsigned long cached_version%d = 0;", id);
+  emitLine(compiler,
+           "struct Function *function%d = lookupCachedFunction(env, %s, "
+           "&cached_function%d, &cached_version%d);",
+           id, name, id, id);
+  emitLine(compiler,
+           "struct Binding frame%d[function%d->frame_size > 0 ? "
+           "function%d->frame_size : 1];",
+           id, id, id);
+  int count = 0;
+  for (; operands != NULL; operands = operands->next) {
+    // arguments past the arity are not evaluated before the arity error
+    emitLine(compiler, "if (function%d->arity > %d) {", id, count);
+    compiler->indent++;
+    char *arg = emitTemporary(compiler);
+    compileExpression(compiler, operands->expression, arg);
+    emitLine(compiler,
+             "frame%d[%d].symbol_name = function%d->param_symbol_names[%d];",
+             id, count, id, count);
+    emitLine(compiler, "frame%d[%d].value = %s;", id, count, arg);
+    free(arg);
+    compiler->indent--;
+    emitLine(compiler, "}");
+    count++;
+  }
+  emitLine(compiler, "if (function%d->arity != %d) {", id, count);
+  emitLine(compiler,
+           "  printf(\"Arity error: %%s takes %%d arguments.\\n\", %s, "
+           "function%d->arity);",
+           name, id);
+  emitLine(compiler, "  exit(1);");
+  emitLine(compiler, "}");
+  emitLine(compiler,
+           "invokeFunction(function%d, frame%d, %s, env, context);", id, id,
+           target);
+  free(name);
+}
+
+void compileBuiltin(struct Compiler *compiler, struct CompiledBuiltin *builtin,
+                    struct ExpressionList *operands, char *target) {
+  char *ops[3];
+  for (int i = 0; i < builtin->operand_count; i++) {
+    ops[i] = emitTemporary(compiler);
+  }
+  for (int i = 0; i < builtin->operand_count; i++) {
+    compileExpression(compiler, operandAt(operands, i), ops[i]);
+  }
+
+  if (builtin->integer_operator != NULL) {
+    bool is_integer = builtin->integer_result == OBJ_INTEGER;
+    emitLine(compiler,
+             "if (%s->type == OBJ_INTEGER && %s->type == OBJ_INTEGER) {",
+             ops[0], ops[1]);
+    emitLine(compiler, "  %s->type = %s;", target,
+             is_integer ? "OBJ_INTEGER" : "OBJ_BOOL");
+    // the arithmetic wraps like the interpreter's, the translated code is
+    // built at -O2 which assumes that int operations never overflow
+    if (is_integer) {
+      emitLine(compiler,
+               "  %s->int_value = WRAPPING_INT(%s->int_value, %s, "
+               "%s->int_value);",
+               target, ops[0], builtin->integer_operator, ops[1]);
+    } else {
+      emitLine(compiler, "  %s->bool_value = %s->int_value %s %s->int_value;",
+               target, ops[0], builtin->integer_operator, ops[1]);
+    }
+    emitLine(compiler, "} else {");
+    compiler->indent++;
+  }
+  // the operands, then target and the env and the allocator if it needs them
+  char args[64] = "";
+  for (int i = 0; i < builtin->operand_count; i++) {
+    strcat(args, ops[i]);
+    strcat(args, ", ");
+  }
+  emitLine(compiler, "%s(%s%s%s);", builtin->function, args, target,
+           builtin->allocates ? ", env, context" : "");
+  if (builtin->integer_operator != NULL) {
+    compiler->indent--;
+    emitLine(compiler, "}");
+  }
+  for (int i = 0; i < builtin->operand_count; i++) {
+    free(ops[i]);
+  }
+}
+
+// mirrors evaluateLoopForm
+void compileLoopForm(struct Compiler *compiler, char *name,
+                     struct ExpressionList *operands, char *target) {
+  bool is_dolist = strcmp(name, "dolist") == 0;
+  struct ExpressionList *specification = loopSpecification(operands);
+  if (specification == NULL) {
+    emitError(compiler, is_dolist ? "dolist must have a variable and a list."
+                                  : "dotimes must have a variable and a count.");
+    return;
+  }
+  char *source = emitTemporary(compiler);
+  compileExpression(compiler, specification->next->expression, source);
+  if (is_dolist) {
+    emitLine(compiler, "if (%s->type != OBJ_LIST && %s->type != OBJ_NIL) {",
+             source, source);
+  } else {
+    emitLine(compiler, "if (%s->type != OBJ_INTEGER) {", source);
+  }
+  compiler->indent++;
+  emitError(compiler, is_dolist ? "Type error: dolist operand must be list."
+                                : "Type error: dotimes operand must be integer.");
+  compiler->indent--;
+  emitLine(compiler, "}");
+
+  int id = compiler->temp_count++;
+  char *variable =
+      quoteCString(specification->expression->data.symbol->symbol_name);
+  emitLine(compiler, "struct Object *loop_variable%d = allocate(context, env);",
+           id);
+  emitLine(compiler, "loop_variable%d->type = OBJ_NIL;", id);
+  emitLine(compiler, "int loop_slot%d = bindLoopVariable(%s, loop_variable%d, env);",
+           id, variable, id);
+  emitLine(compiler, "struct Object *cursor%d = %s;", id, source);
+  emitLine(compiler, "int index%d = 0;", id);
+  emitLine(compiler, "int loop_top%d = context->stack->top;", id);
+  if (is_dolist) {
+    emitLine(compiler, "while (cursor%d->type == OBJ_LIST) {", id);
   } else {
-    // get symbol value from env
+    emitLine(compiler, "while (index%d < %s->int_value) {", id, source);
+  }
+  compiler->indent++;
+  emitLine(compiler, "context->stack->top = loop_top%d;", id);
+  if (is_dolist) {
+    emitLine(compiler, "*loop_variable%d = *cursor%d->list_value->car;", id, id);
+    emitLine(compiler, "cursor%d = cursor%d->list_value->cdr;", id, id);
+  } else {
+    emitLine(compiler, "loop_variable%d->type = OBJ_INTEGER;", id);
+    emitLine(compiler, "loop_variable%d->int_value = index%d++;", id, id);
+  }
+  emitLine(compiler, "restoreLoopVariable(loop_slot%d, loop_variable%d, env);",
+           id, id);
+  for (struct ExpressionList *body = operands->next; body != NULL;
+       body = body->next) {
+    char *operand = emitTemporary(compiler);
+    compileExpression(compiler, body->expression, operand);
+    free(operand);
+  }
+  compiler->indent--;
+  emitLine(compiler, "}");
+  emitLine(compiler, "%s->type = OBJ_NIL;", target);
+  free(variable);
+  free(source);
+}
+
+void compileSymbolicExpression(struct Compiler *compiler,
+                               struct ExpressionNode *expression,
+                               char *target) {
+  struct ExpressionList *expressions =
+      expression->data.symbolic_exp->expressions;
+  if (expressions == NULL) {
+    emitLine(compiler, "%s->type = OBJ_NIL;", target);
+    return;
+  }
+  if (expressions->expression->type != EXP_SYMBOL) {
+    emitError(compiler, "S-exp must be started with symbol.");
+    return;
+  }
+  char *name = expressions->expression->data.symbol->symbol_name;
+  struct ExpressionList *operands = expressions->next;
+
+  if (strcmp(name, "if") == 0 || strcmp(name, "while") == 0) {
+    if (operandAt(operands, 0) == NULL) {
+      emitError(compiler, "if must have condition.");
+      return;
+    }
+    if (operandAt(operands, 1) == NULL) {
+      emitError(compiler, "if must have then clause.");
+      return;
+    }
+    bool is_while = name[0] == 'w';
+    int id = compiler->temp_count++;
+    if (is_while) {
+      // temporaries of the previous iteration are unreachable
+      emitLine(compiler, "int loop_top%d = context->stack->top;", id);
+      emitLine(compiler, "while (1) {");
+      compiler->indent++;
+      emitLine(compiler, "context->stack->top = loop_top%d;", id);
+    }
+    char *cond = emitTemporary(compiler);
+    compileExpression(compiler, operands->expression, cond);
+    emitLine(compiler, "if (boolVal(%s)) {", cond);
+    compiler->indent++;
+    compileExpression(compiler, operands->next->expression, target);
+    compiler->indent--;
+    emitLine(compiler, "} else {");
+    compiler->indent++;
+    if (!is_while && operandAt(operands, 2) != NULL) {
+      compileExpression(compiler, operandAt(operands, 2), target);
+    } else {
+      emitLine(compiler, "%s->type = OBJ_NIL;", target);
+    }
+    if (is_while) {
+      emitLine(compiler, "break;");
+    }
+    compiler->indent--;
+    emitLine(compiler, "}");
+    if (is_while) {
+      compiler->indent--;
+      emitLine(compiler, "}");
+    }
+    free(cond);
+  } else if (strcmp(name, "=") == 0) {
+    if (operands == NULL || operands->expression->type != EXP_SYMBOL) {
+      emitError(compiler, "Variable name must be symbol.");
+      return;
+    }
+    if (operandAt(operands, 1) == NULL) {
+      emitError(compiler, "assignment must have expression.");
+      return;
+    }
+    char *value = emitTemporary(compiler);
+    compileExpression(compiler, operands->next->expression, value);
+    char *variable = quoteCString(operands->expression->data.symbol->symbol_name);
+    emitLine(compiler, "*%s = *%s;", target, value);
+    emitLine(compiler, "setObjectToEnv(env, %s, %s);", variable, value);
+    free(variable);
+    free(value);
+  } else if (strcmp(name, "dotimes") == 0 || strcmp(name, "dolist") == 0) {
+    compileLoopForm(compiler, name, operands, target);
+  } else if (strcmp(name, "defun") == 0) {
+    compileDefun(compiler, expression, target);
+  } else if (strcmp(name, "&&") == 0 || strcmp(name, "||") == 0) {
+    bool is_or = name[0] == '|';
+    emitLine(compiler, "do {");
+    compiler->indent++;
+    for (; operands != NULL; operands = operands->next) {
+      char *operand = emitTemporary(compiler);
+      compileExpression(compiler, operands->expression, operand);
+      emitLine(compiler, "if (%sboolVal(%s)) {", is_or ? "" : "!", operand);
+      emitLine(compiler, "  %s->type = OBJ_BOOL;", target);
+      emitLine(compiler, "  %s->bool_value = %d;", target, is_or);
+      emitLine(compiler, "  break;");
+      emitLine(compiler, "}");
+      free(operand);
+    }
+    emitLine(compiler, "%s->type = OBJ_BOOL;", target);
+    emitLine(compiler, "%s->bool_value = %d;", target, !is_or);
+    compiler->indent--;
+    emitLine(compiler, "} while (0);");
+  } else if (strcmp(name, "progn") == 0) {
+    if (operands == NULL) {
+      emitLine(compiler, "%s->type = OBJ_NIL;", target);
+      return;
+    }
+    int id = compiler->temp_count++;
+    emitLine(compiler, "int progn_top%d = context->stack->top;", id);
+    for (; operands != NULL; operands = operands->next) {
+      emitLine(compiler, "context->stack->top = progn_top%d;", id);
+      // the last operand is evaluated into target after it is allocated
+      char *operand = emitTemporary(compiler);
+      compileExpression(compiler, operands->expression, operand);
+      if (operands->next == NULL) {
+        emitLine(compiler, "*%s = *%s;", target, operand);
+      }
+      free(operand);
+    }
+  } else if (strcmp(name, "vector") == 0 || strcmp(name, "pvec") == 0) {
+    int count = countOperands(operands);
+    int id = compiler->temp_count++;
+    emitLine(compiler, "struct Object *items%d[%d];", id, count > 0 ? count : 1);
     int i = 0;
-    while (env->bindings[i].symbol_name != NULL) {
-      if (strcmp(env->bindings[i].symbol_name,
-                 expression->data.symbol->symbol_name) == 0) {
-        *evaluated = *env->bindings[i].value;
-        env->bindings[i].value = evaluated;
+    for (; operands != NULL; operands = operands->next) {
+      char *item = emitTemporary(compiler);
+      emitLine(compiler, "items%d[%d] = %s;", id, i++, item);
+      compileExpression(compiler, operands->expression, item);
+      free(item);
+    }
+    if (strcmp(name, "vector") == 0) {
+      emitLine(compiler, "makeVector(items%d, %d, %s, context);", id, count,
+               target);
+    } else {
+      emitLine(compiler, "makePVector(items%d, %d, %s, context);", id, count,
+               target);
+    }
+  } else if (strcmp(name, "push") == 0) {
+    // the value is evaluated before the list
+    char *value = emitTemporary(compiler);
+    char *list = emitTemporary(compiler);
+    compileExpression(compiler, operandAt(operands, 1), value);
+    compileExpression(compiler, operandAt(operands, 0), list);
+    if (operands != NULL && operands->expression->type == EXP_SYMBOL) {
+      char *variable =
+          quoteCString(operands->expression->data.symbol->symbol_name);
+      emitLine(compiler,
+               "definedFunctionPush(%s, %s, %s, lookupBinding(env, %s), env, "
+               "context);",
+               list, value, target, variable);
+      free(variable);
+    } else {
+      emitLine(compiler,
+               "definedFunctionPush(%s, %s, %s, NULL, env, context);", list,
+               value, target);
+    }
+    free(value);
+    free(list);
+  } else {
+    for (int i = 0; compiled_builtins[i].name != NULL; i++) {
+      if (strcmp(compiled_builtins[i].name, name) == 0) {
+        compileBuiltin(compiler, &compiled_builtins[i], operands, target);
         return;
       }
-      i++;
     }
-    if (env->parent != NULL) {
-      evaluateSymbolExpression(expression, evaluated, env->parent, context);
+    compileCall(compiler, name, operands, target);
+  }
+}
+
+// emits statements storing the value of expression in the object target
+// points to
+void compileExpression(struct Compiler *compiler,
+                       struct ExpressionNode *expression, char *target) {
+  if (expression == NULL) {
+    emitLine(compiler, "%s->type = OBJ_NIL;", target);
+    return;
+  }
+  if (expression->type == EXP_LITERAL) {
+    struct LiteralNode *literal = expression->data.literal;
+    if (literal->type == LIT_INTERGER) {
+      emitLine(compiler, "%s->type = OBJ_INTEGER;", target);
+      emitLine(compiler, "%s->int_value = %d;", target, literal->int_value);
+    } else if (literal->type == LIT_STRING) {
+      // a static string with the layout of struct StringHeader
+      char *quoted = quoteCString(literal->string_value);
+      int length = stringLength(literal->string_value);
+      int id = compiler->temp_count++;
+      emitLine(compiler,
+               "static struct { uint64_t hash; int length; bool interned; "
+               "char chars[%d]; } literal%d = {0, %d, false, %s};",
+               length + 1, id, length, quoted);
+      emitLine(compiler, "%s->type = OBJ_STRING;", target);
+      emitLine(compiler, "%s->string_value = literal%d.chars;", target, id);
+      free(quoted);
     } else {
-      printf("Undefined symbol: %s\n", expression->data.symbol->symbol_name);
-      exit(1);
+      emitLine(compiler, "%s->type = OBJ_BOOL;", target);
+      emitLine(compiler, "%s->bool_value = %d;", target,
+               literal->boolean_value);
+    }
+    return;
+  } else if (expression->type == EXP_SYMBOL) {
+    char *quoted = quoteCString(expression->data.symbol->symbol_name);
+    emitLine(compiler, "loadSymbol(%s, %s, env);", quoted, target);
+    free(quoted);
+    return;
+  }
+
+  // objects allocated while evaluating stay on the stack until the result is
+  // stored in target
+  int id = compiler->temp_count++;
+  emitLine(compiler, "{");
+  compiler->indent++;
+  emitLine(compiler, "int top%d = context->stack->top;", id);
+  emitLine(compiler, "pushObjectStack(context->stack, %s);", target);
+  if (expression->type == EXP_LIST) {
+    int count = countOperands(expression->data.list->expressions);
+    emitLine(compiler, "struct Object *items%d[%d];", id, count > 0 ? count : 1);
+    int i = 0;
+    for (struct ExpressionList *item = expression->data.list->expressions;
+         item != NULL; item = item->next) {
+      char *name = emitTemporary(compiler);
+      emitLine(compiler, "items%d[%d] = %s;", id, i++, name);
+      compileExpression(compiler, item->expression, name);
+      free(name);
     }
+    emitLine(compiler, "makeList(items%d, %d, %s, env, context);", id, count,
+             target);
+  } else {
+    compileSymbolicExpression(compiler, expression, target);
   }
+  emitLine(compiler, "context->stack->top = top%d;", id);
+  compiler->indent--;
+  emitLine(compiler, "}");
 }
 
-void evaluateExpression(struct ExpressionNode *expression,
-                        struct Object *evaluated, struct Env *env,
-                        struct AllocatorContext *context) {
-  pushObjectStack(context->stack, evaluated);
-  if (expression->type == EXP_LIST) {
-    evaluateListExpression(expression, evaluated, env, context);
-  } else if (expression->type == EXP_SYMBOLIC_EXP) {
-    evaluateSymbolicExpression(expression, evaluated, env, context);
+void compileProgram(struct ProgramNode *program, FILE *out) {
+  struct Compiler compiler = (struct Compiler){out, 0, 0, NULL, 0};
+  for (struct ExpressionList *expressions = program->expressions;
+       expressions != NULL; expressions = expressions->next) {
+    collectFunctions(&compiler, expressions->expression);
+  }
+
+  fprintf(out, "// generated by worspc\n\n");
+  fprintf(out, "#include \"worsp.h\"\n#include <stdio.h>\n#include "
+               "<stdlib.h>\n#include <string.h>\n\n");
+  for (int i = 0; i < compiler.function_count; i++) {
+    fprintf(out,
+            "void wsp_function_%d(struct Object *evaluated, struct Env *env, "
+            "struct AllocatorContext *context);\n",
+            i);
+  }
+  for (int i = 0; i < compiler.function_count; i++) {
+    struct ExpressionNode *body = operandAt(
+        compiler.functions[i]->data.symbolic_exp->expressions->next, 2);
+    fprintf(out,
+            "\nvoid wsp_function_%d(struct Object *evaluated, struct Env *env, "
+            "struct AllocatorContext *context) {\n",
+            i);
+    compiler.indent = 1;
+    compileExpression(&compiler, body, "evaluated");
+    fprintf(out, "}\n");
+  }
+
+  fprintf(out, "\nint main(int argc, char *argv[]) {\n");
+  compiler.indent = 1;
+  // the program takes the --pmap-threads option of main
+  emitLine(&compiler, "for (int i = 1; i < argc; i++) {");
+  emitLine(&compiler, "  if (strncmp(argv[i], \"--pmap-threads=\", 15) == 0) {");
+  emitLine(&compiler, "    pmap_thread_count = atoi(&argv[i][15]);");
+  emitLine(&compiler, "  }");
+  emitLine(&compiler, "}");
+  emitLine(&compiler, "struct Env *env = malloc(sizeof(struct Env));");
+  emitLine(&compiler, "initEnv(env);");
+  emitLine(&compiler, "struct AllocatorContext *context = initAllocator();");
+  for (struct ExpressionList *expressions = program->expressions;
+       expressions != NULL; expressions = expressions->next) {
+    emitLine(&compiler, "{");
+    compiler.indent++;
+    emitLine(&compiler, "struct Object *evaluated = allocate(context, env);");
+    compileExpression(&compiler, expressions->expression, "evaluated");
+    emitLine(&compiler, "popObjectStack(context->stack);");
+    compiler.indent--;
+    emitLine(&compiler, "}");
+  }
+  emitLine(&compiler, "return 0;");
+  fprintf(out, "}\n");
+  free(compiler.functions);
+}
+
+// =================================================
+//   stream evaluator
+// =================================================
+
+void freeExpressionList(struct ExpressionList *expressions);
+
+void freeExpression(struct ExpressionNode *expression) {
+  if (expression->type == EXP_SYMBOLIC_EXP) {
+    freeExpressionList(expression->data.symbolic_exp->expressions);
+    free(expression->data.symbolic_exp);
+  } else if (expression->type == EXP_LIST) {
+    freeExpressionList(expression->data.list->expressions);
+    free(expression->data.list);
   } else if (expression->type == EXP_LITERAL) {
-    evaluateLiteralExpression(expression, evaluated);
+    if (expression->data.literal->type == LIT_STRING) {
+      freeString(expression->data.literal->string_value);
+    }
+    free(expression->data.literal);
   } else if (expression->type == EXP_SYMBOL) {
-    evaluateSymbolExpression(expression, evaluated, env, context);
+    free(expression->data.symbol->symbol_name);
+    free(expression->data.symbol);
+  }
+  free(expression);
+}
+
+void freeExpressionList(struct ExpressionList *expressions) {
+  while (expressions != NULL) {
+    struct ExpressionList *next = expressions->next;
+    freeExpression(expressions->expression);
+    free(expressions);
+    expressions = next;
+  }
+}
+
+// frees a form after it was evaluated, retained nodes stay with everything
+// below them
+void releaseExpression(struct ExpressionNode *expression) {
+  if (expression->retained) {
+    return;
+  }
+  struct ExpressionList *expressions = NULL;
+  if (expression->type == EXP_SYMBOLIC_EXP) {
+    expressions = expression->data.symbolic_exp->expressions;
+    free(expression->data.symbolic_exp);
+  } else if (expression->type == EXP_LIST) {
+    expressions = expression->data.list->expressions;
+    free(expression->data.list);
+  } else {
+    freeExpression(expression);
+    return;
   }
+  while (expressions != NULL) {
+    struct ExpressionList *next = expressions->next;
+    releaseExpression(expressions->expression);
+    free(expressions);
+    expressions = next;
+  }
+  free(expression);
+}
+
+void evaluateTopLevelExpression(struct ExpressionNode *expression,
+                                struct Env *env,
+                                struct AllocatorContext *context) {
+  struct Object *evaluated = allocate(context, env);
+  evaluateExpression(expression, evaluated, env, context);
   popObjectStack(context->stack);
+  releaseExpression(expression);
 }
 
-void evaluateExpressionWithContext(struct ExpressionNode *expression,
-                                   struct Object *evaluated, struct Env *env) {
+void evaluateStream(FILE *file, int optimize_level) {
+  struct StreamReader *reader = initStreamReader(file);
+
+  struct Env *env = malloc(sizeof(struct Env));
+  initEnv(env);
+
   struct AllocatorContext *context = initAllocator();
-  evaluateExpression(expression, evaluated, env, context);
+
+  while (readTopLevelForm(reader)) {
+    struct ParseState state = (struct ParseState){NULL, 0, NULL};
+    struct ParseResult result = (struct ParseResult){NULL};
+    parse(reader->form, &state, &result);
+    optimizeProgram(result.program, optimize_level, true);
+
+    struct ExpressionList *expressions = result.program->expressions;
+    while (expressions != NULL) {
+      struct ExpressionList *next = expressions->next;
+      evaluateTopLevelExpression(expressions->expression, env, context);
+      free(expressions);
+      expressions = next;
+    }
+
+    free(state.token);
+    free(result.program);
+  }
+
+  freeStreamReader(reader);
 }
 
-void initEnv(struct Env *env) {
-  env->parent = NULL;
-  env->bindings[0].symbol_name = NULL;
-  env->bindings[0].value = NULL;
+// =================================================
+//   pipelined evaluator
+//     A parser thread reads top-level forms and hands them over through a
+//     bounded queue while the main thread evaluates them in order.
+// =================================================
+
+void initializeExpressionQueue(struct ExpressionQueue *queue) {
+  queue->head = 0;
+  queue->tail = 0;
+  queue->count = 0;
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
 }
 
-void evaluateProgram(struct ProgramNode *program) {
-  struct ExpressionList *expressions = program->expressions;
+void destroyExpressionQueue(struct ExpressionQueue *queue) {
+  pthread_mutex_destroy(&queue->mutex);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+}
+
+void pushExpressionQueue(struct ExpressionQueue *queue,
+                         struct ExpressionNode *expression) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->count == EXPRESSION_QUEUE_SIZE) {
+    pthread_cond_wait(&queue->not_full, &queue->mutex);
+  }
+  queue->expressions[queue->tail] = expression;
+  queue->tail = (queue->tail + 1) % EXPRESSION_QUEUE_SIZE;
+  queue->count++;
+  // the consumer only waits when the queue was empty
+  if (queue->count == 1) {
+    pthread_cond_signal(&queue->not_empty);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+struct ExpressionNode *popExpressionQueue(struct ExpressionQueue *queue) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->count == 0) {
+    pthread_cond_wait(&queue->not_empty, &queue->mutex);
+  }
+  struct ExpressionNode *expression = queue->expressions[queue->head];
+  queue->head = (queue->head + 1) % EXPRESSION_QUEUE_SIZE;
+  queue->count--;
+  // the producer only waits when the queue was full
+  if (queue->count == EXPRESSION_QUEUE_SIZE - 1) {
+    pthread_cond_signal(&queue->not_full);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return expression;
+}
+
+struct ParserThreadArgs {
+  FILE *file;
+  struct ExpressionQueue *queue;
+  int optimize_level;
+};
+
+void *runParserThread(void *arg) {
+  struct ParserThreadArgs *args = arg;
+  struct StreamReader *reader = initStreamReader(args->file);
+
+  while (readTopLevelForm(reader)) {
+    struct ParseState state = (struct ParseState){NULL, 0, NULL};
+    struct ParseResult result = (struct ParseResult){NULL};
+    parse(reader->form, &state, &result);
+    optimizeProgram(result.program, args->optimize_level, true);
+
+    struct ExpressionList *expressions = result.program->expressions;
+    while (expressions != NULL) {
+      struct ExpressionList *next = expressions->next;
+      pushExpressionQueue(args->queue, expressions->expression);
+      free(expressions);
+      expressions = next;
+    }
+
+    free(state.token);
+    free(result.program);
+  }
+
+  // NULL tells the evaluator that the stream is over
+  pushExpressionQueue(args->queue, NULL);
+  freeStreamReader(reader);
+  return NULL;
+}
+
+void evaluatePipelined(FILE *file, int optimize_level) {
+  struct ExpressionQueue *queue = malloc(sizeof(struct ExpressionQueue));
+  initializeExpressionQueue(queue);
+
+  // syntax errors still exit immediately, which can happen before the forms
+  // preceding them were evaluated
+  struct ParserThreadArgs args =
+      (struct ParserThreadArgs){file, queue, optimize_level};
+  pthread_t parser_thread;
+  if (pthread_create(&parser_thread, NULL, runParserThread, &args) != 0) {
+    printf("Failed to start parser thread.\n");
+    exit(1);
+  }
 
   struct Env *env = malloc(sizeof(struct Env));
   initEnv(env);
 
   struct AllocatorContext *context = initAllocator();
 
-  while (expressions != NULL) {
-    struct Object *evaluated = allocate(context, env);
-    evaluateExpression(expressions->expression, evaluated, env, context);
-    expressions = expressions->next;
+  struct ExpressionNode *expression;
+  while ((expression = popExpressionQueue(queue)) != NULL) {
+    evaluateTopLevelExpression(expression, env, context);
   }
-}
 
-void evaluate(struct ParseResult *result) { evaluateProgram(result->program); }
+  pthread_join(parser_thread, NULL);
+  destroyExpressionQueue(queue);
+  free(queue);
+}
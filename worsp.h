@@ -1,8 +1,10 @@
 #ifndef WORST_H
 #define WORST_H
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 // =================================================
 //   tokenizer & parser
@@ -27,9 +29,21 @@ struct Token {
   char *str;
 };
 
+#define PARSE_ARENA_BLOCK_SIZE (64 * 1024)
+
+// bump allocator for AST nodes, expressions allocated from it must not be
+// passed to freeExpression
+struct ParseArena {
+  char *block;
+  size_t used;
+  size_t capacity;
+};
+
 struct ParseState {
   struct Token *token;
   int pos;
+  // NULL allocates AST nodes with malloc
+  struct ParseArena *arena;
 };
 
 struct ProgramNode {
@@ -50,6 +64,10 @@ struct ExpressionList {
 
 struct ExpressionNode {
   enum ExpressionType type;
+  // set once something outside of the AST refers to the node, e.g. a function
+  // to its definition, a binding to its name or a string object to the
+  // characters of its literal. Releasing a form leaves such nodes alone.
+  bool retained;
   union {
     struct SymbolicExpNode *symbolic_exp;
     struct ListNode *list;
@@ -58,12 +76,43 @@ struct ExpressionNode {
   } data;
 };
 
+// variants a symbolic expression is rewritten to on its first evaluation
+enum Specialization {
+  SPECIALIZATION_NONE,
+  // operands were not integers, or a specialized variant deoptimized
+  SPECIALIZATION_GENERIC,
+  SPECIALIZATION_ADD_INT,
+  SPECIALIZATION_SUB_INT,
+  SPECIALIZATION_MUL_INT,
+  SPECIALIZATION_LT_INT,
+  SPECIALIZATION_GT_INT,
+  SPECIALIZATION_EQ_INT,
+  // superinstructions for loop idioms, they allocate nothing
+  // (< a b), (> a b) and (eq a b) on integer variables or literals
+  SPECIALIZATION_LT_LOCALS,
+  SPECIALIZATION_GT_LOCALS,
+  SPECIALIZATION_EQ_LOCALS,
+  // (= x (+ x y)) and (= x (- x y)) on an integer bound in the current env
+  SPECIALIZATION_ADD_TO_LOCAL,
+  SPECIALIZATION_SUB_FROM_LOCAL,
+  // while whose condition compares locals
+  SPECIALIZATION_COUNTED_LOOP,
+};
+
 struct SymbolicExpNode {
   struct ExpressionList *expressions;
+  enum Specialization specialization;
+  // inline cache of the function of the global env called here, valid while
+  // cached_version is equal to function_binding_version
+  struct Function *cached_function;
+  unsigned long cached_version;
 };
 
 struct ListNode {
   struct ExpressionList *expressions;
+  // evaluated list shared by every evaluation when all elements are literals,
+  // built on the first evaluation
+  struct Object *constant;
 };
 
 enum LiteralType { LIT_INTERGER, LIT_STRING, LIT_BOOLEAN };
@@ -79,6 +128,9 @@ struct LiteralNode {
 
 struct SymbolNode {
   char *symbol_name;
+  // frame slot of the parameter or local it names when it is in the body of
+  // a function, -1 otherwise
+  int slot;
 };
 
 struct ParseResult {
@@ -89,6 +141,62 @@ int match(struct ParseState *state, TokenKind kind);
 void next(char *source, struct ParseState *state);
 void parse(char *source, struct ParseState *state, struct ParseResult *result);
 
+void parseParallel(char *source, int thread_count, struct ParseResult *result);
+
+#define SCRIPT_CACHE_MAGIC "WSPC"
+// bumped whenever the format of the image changes
+#define SCRIPT_CACHE_VERSION 1
+
+struct ScriptCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t layout;
+  uint64_t hash;
+  uint64_t size;
+  uint64_t program_offset;
+};
+
+uint64_t hashSource(char *source, size_t length);
+int writeScriptCache(char *path, uint64_t hash, struct ProgramNode *program);
+// returns NULL when the cache is missing, was written for another source or
+// is not a valid image
+struct ProgramNode *loadScriptCache(char *path, uint64_t hash);
+
+enum FormScanResult {
+  SCAN_CONTINUE,
+  SCAN_DONE,        // the form ends with this character
+  SCAN_DONE_BEFORE, // the form ended before this character
+};
+
+// finds the end of a top-level form one character at a time
+struct FormScanner {
+  int depth;
+  bool started;
+  bool in_string;
+  bool in_comment;
+};
+
+void initializeFormScanner(struct FormScanner *scanner);
+enum FormScanResult scanFormChar(struct FormScanner *scanner, int ch);
+int scanTopLevelForm(char *source, int pos);
+
+#define STREAM_BUFFER_SIZE 4096
+
+struct StreamReader {
+  FILE *file;
+  char buffer[STREAM_BUFFER_SIZE];
+  size_t buffer_pos;
+  size_t buffer_len;
+  // text of the last top-level form, NUL terminated
+  char *form;
+  size_t form_len;
+  size_t form_capacity;
+};
+
+struct StreamReader *initStreamReader(FILE *file);
+void freeStreamReader(struct StreamReader *reader);
+int readTopLevelForm(struct StreamReader *reader);
+
 // =================================================
 //   evaluator
 // =================================================
@@ -100,6 +208,11 @@ typedef enum {
   OBJ_LIST,
   OBJ_NIL,
   OBJ_FUNCTION,
+  OBJ_VECTOR,
+  OBJ_HASHMAP,
+  OBJ_PVECTOR,
+  OBJ_PHASH,
+  OBJ_STRING_BUILDER,
 } ObjectType;
 
 typedef enum {
@@ -107,32 +220,275 @@ typedef enum {
   CONSCELL_TYPE_NIL,
 } ConsCellType;
 
+struct ConsCell;
+
+// the last cell and the length of a list, kept by its first cell so that
+// push, pop and length do not walk the list. Lists whose cells may be shared
+// with another list, e.g. results of cdr, have none and are walked instead.
+struct ListHeader {
+  struct ConsCell *tail;
+  int length;
+  // the header is up to date while this equals list_header_version
+  unsigned long version;
+};
+
 struct ConsCell {
   ConsCellType type;
+  // constant cells are shared by every evaluation of a quoted literal list
+  // and must be copied before being mutated
+  bool constant;
   struct Object *car;
   struct Object *cdr;
+  // the cell linking to this one, so that pop can unlink the last cell
+  struct ConsCell *prev;
+  // NULL unless the cell is the first one of a list built with a header
+  struct ListHeader *header;
+};
+
+struct AllocatorContext;
+
+typedef enum {
+  BUFFER_VECTOR,
+  BUFFER_HASHMAP,
+  BUFFER_PVECTOR,
+  BUFFER_PVECTOR_NODE,
+  BUFFER_PHASH,
+  BUFFER_PHASH_NODE,
+  BUFFER_STRING_BUILDER,
+} HeapBufferType;
+
+// memory an object refers to besides its own cells, e.g. the items of a
+// vector. Copies of an object share it, so it has a mark of its own and the
+// heap that allocated it frees it once no live object refers to it.
+struct HeapBuffer {
+  uint32_t marked;
+  HeapBufferType type;
+  struct AllocatorContext *owner;
+  // the buffers of a heap are linked
+  struct HeapBuffer *next;
+};
+
+// a growable array, its elements are objects of the heap kept alive by the
+// vector
+struct Vector {
+  struct HeapBuffer buffer;
+  struct Object **items;
+  int length;
+  int capacity;
+};
+
+// a slot of a hash map, it is empty while key is NULL
+struct HashMapEntry {
+  struct Object *key;
+  struct Object *value;
+  uint64_t hash;
+};
+
+// open addressing with linear probing, a deletion shifts the following
+// entries back instead of leaving a tombstone. The keys and values are
+// objects of the heap kept alive by the map.
+struct HashMap {
+  struct HeapBuffer buffer;
+  struct HashMapEntry *entries;
+  // a power of two
+  int capacity;
+  int size;
+};
+
+// persistent collections never change, an update returns a new version
+// that copies the path to the changed slot and shares every other node
+#define PERSISTENT_BITS 5
+#define PERSISTENT_WIDTH (1 << PERSISTENT_BITS)
+
+// a node of the 32-way trie of a persistent vector, the nodes at the bottom
+// hold the items
+struct PVectorNode {
+  struct HeapBuffer buffer;
+  union {
+    struct PVectorNode *children[PERSISTENT_WIDTH];
+    struct Object *items[PERSISTENT_WIDTH];
+  };
+};
+
+struct PVector {
+  struct HeapBuffer buffer;
+  int count;
+  // bits of an index consumed above the bottom nodes
+  int shift;
+  struct PVectorNode *root;
+};
+
+// an entry of a node of a hash array mapped trie, either a key and its value
+// or, when node is not NULL, the node for the next bits of the hash
+struct PHashEntry {
+  struct Object *key;
+  struct Object *value;
+  uint64_t hash;
+  struct PHashNode *node;
+};
+
+struct PHashNode {
+  struct HeapBuffer buffer;
+  // bit i is set when the node has an entry for hash bits i, entries are
+  // stored in the order of the bits
+  uint32_t bitmap;
+  int length;
+  // every bit of the hash is consumed, the entries are keys with the same
+  // hash and the bitmap is unused
+  bool collision;
+  struct PHashEntry entries[];
+};
+
+struct PHash {
+  struct HeapBuffer buffer;
+  int count;
+  // NULL when the map is empty
+  struct PHashNode *root;
+};
+
+enum JitState {
+  JIT_NONE,
+  JIT_COMPILING,
+  JIT_COMPILED,
+  // the body uses a form the JIT does not support
+  JIT_FAILED,
+};
+
+// a function called by compiled code and the name it was resolved from
+struct JitDependency {
+  char *name;
+  struct Function *function;
 };
 
+struct Object;
+struct Env;
+struct AllocatorContext;
+
+// body of a function translated to C by worspc
+typedef void (*NativeFunction)(struct Object *evaluated, struct Env *env,
+                               struct AllocatorContext *context);
+
 struct Function {
+  // parameter i is bound in slot i of the frame of a call
   char **param_symbol_names;
+  int arity;
+  // NULL terminated names of every local the body can bind, local i is bound
+  // in slot arity + i
+  char **local_symbol_names;
+  // slots for the parameters and every local the body can bind with = or
+  // defun
+  int frame_size;
+  // NULL when the function is native
   struct ExpressionNode *body;
+  NativeFunction native;
+  // for the JIT, calls are counted until the function is compiled
+  int call_count;
+  enum JitState jit_state;
+  // machine code taking the integer arguments, returns an integer or a
+  // boolean
+  void *jit_code;
+  ObjectType jit_return_type;
+  // compiled code calls these functions directly, it is entered only while
+  // every name still resolves to the same function
+  struct JitDependency *jit_dependencies;
+  int jit_dependency_count;
+  unsigned long jit_checked_version;
+  // whether a call binds the name of a function of the global env, valid
+  // while shadow_checked_version is equal to global_function_version
+  bool shadows_global_function;
+  unsigned long shadow_checked_version;
+};
+
+// the characters of a string object or a string literal are preceded by
+// their length and hash, string_value points at chars which are NUL
+// terminated so that they can still be passed to C functions
+struct StringHeader {
+  // 0 until the hash is needed
+  uint64_t hash;
+  int length;
+  // canonical strings of the intern table, two of them are equal only when
+  // they are the same string. They are never freed.
+  bool interned;
+  char chars[];
+};
+
+// string literals, split tokens and readline results up to this length are
+// interned, longer ones rarely repeat
+#define INTERN_MAX_LENGTH 16
+
+// a growable buffer that sb-append fills in place, so that building a string
+// of n pieces copies each piece once instead of the whole prefix every time
+struct StringBuilder {
+  struct HeapBuffer buffer;
+  char *chars;
+  int length;
+  int capacity;
 };
 
 struct Object {
-  // for mark and sweep GC
-  bool marked;
+  // for mark and sweep GC, an object is live when it is marked with the
+  // current epoch of the allocator
+  uint32_t marked;
   ObjectType type;
   union {
+    // links free objects in the allocator
+    struct Object *next_free;
     int int_value;
     char *string_value;
     int bool_value;
     struct ConsCell *list_value;
     struct Function *function_value;
+    struct Vector *vector_value;
+    struct HashMap *hashmap_value;
+    struct PVector *pvector_value;
+    struct PHash *phash_value;
+    struct StringBuilder *builder_value;
   };
 };
 
-#define MAX_BINDINGS 10
+// incremented whenever a binding of the global env to a function is created,
+// changed or dropped, or a frame binding the name of a global function is
+// entered, which invalidates the inline caches of every call site
+extern _Atomic unsigned long function_binding_version;
+
+// incremented whenever a binding of the global env to a function is created,
+// changed or dropped
+extern _Atomic unsigned long global_function_version;
+
+// true while the threads of pmap evaluate, they read inline caches but
+// neither fill them nor specialize or compile the shared code
+extern bool parallel_evaluation;
+
+// number of threads of pmap, 0 uses every online processor
+extern int pmap_thread_count;
+
+// number of calls before a function is compiled to machine code, 0 disables
+// the JIT
+extern int jit_call_threshold;
+
+typedef enum {
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_AVX2,
+} SimdLevel;
+
+// the widest instructions the string builtins may use, the kernels only use
+// those the CPU supports
+extern SimdLevel simd_level;
+
+// delimiter sets of split up to this size are compared with SIMD
+#define SIMD_MAX_DELIMITERS 8
+
+// int arithmetic wraps around on overflow in every mode, the operands are
+// computed unsigned where overflow is defined
+#define WRAPPING_INT(a, op, b) ((int)((unsigned)(a) op (unsigned)(b)))
+
+#define JIT_DEFAULT_CALL_THRESHOLD 100
+// arguments are passed in registers
+#define JIT_MAX_ARITY 6
+
 #define MAX_SYMBOL_NAME_LENGTH 20
+#define ENV_INITIAL_CAPACITY 8
 
 struct Binding {
   char *symbol_name;
@@ -140,26 +496,60 @@ struct Binding {
 };
 
 struct Env {
-  struct Binding bindings[MAX_BINDINGS];
+  struct Binding *bindings;
+  int size;
+  int capacity;
+  // frames of function calls live on the C stack and never grow
+  bool frame;
   struct Env *parent;
+  // a frame binding the name of a global function, caches that resolved the
+  // name to the global function are invalidated when it binds the name
+  bool shadows_global_function;
 };
 
+// initial number of objects in the heap
 #define OBJECT_NUMBER 50
-#define BLOCK_SIZE sizeof(struct Object)
-#define MEMORY_SIZE (BLOCK_SIZE * OBJECT_NUMBER)
-#define FREE_BITMAP_SIZE (MEMORY_SIZE / BLOCK_SIZE)
 
 struct ObjectStack {
-  struct Object *objects[OBJECT_NUMBER];
+  struct Object **objects;
+  int capacity;
   int top;
 };
 
+// blocks of the heap are made of chunks of this many bytes that are aligned
+// to their size, so that the block of an object is found from its address
+#define HEAP_CHUNK_BITS 12
+#define HEAP_CHUNK_BYTES (1UL << HEAP_CHUNK_BITS)
+
+struct MemoryBlock {
+  struct Object *objects;
+  uint8_t *free_bitmap;
+  unsigned long size;
+  struct MemoryBlock *next;
+};
+
+struct HeapChunk {
+  uintptr_t address;
+  struct MemoryBlock *block;
+};
+
 // for gc
 struct AllocatorContext {
   int gc_less_mode;
   struct ObjectStack *stack;
-  struct Object *memory_pool;
-  uint8_t free_bitmap[FREE_BITMAP_SIZE];
+  struct MemoryBlock *blocks;
+  struct Object *free_list;
+  unsigned long object_count;
+  unsigned long free_count;
+  // total number of objects allocated from the heap
+  unsigned long allocation_count;
+  uint32_t epoch;
+  struct HeapBuffer *buffers;
+  // open addressing table from the address of every chunk of the blocks to
+  // its block
+  struct HeapChunk *chunks;
+  unsigned long chunk_capacity;
+  unsigned long chunk_count;
 };
 
 void evaluateExpression(struct ExpressionNode *expression,
@@ -170,13 +560,203 @@ void evaluateExpressionWithContext(struct ExpressionNode *expression,
 void evaluate(struct ParseResult *result);
 char *stringifyObject(struct Object *obj);
 void initEnv(struct Env *env);
+void freeExpression(struct ExpressionNode *expression);
+void evaluateStream(FILE *file, int optimize_level);
+// frees an evaluated form except for its retained nodes
+void releaseExpression(struct ExpressionNode *expression);
+void optimizeProgram(struct ProgramNode *program, int level, bool release);
+
+#define EXPRESSION_QUEUE_SIZE 256
+
+// bounded single-producer/single-consumer queue of top-level expressions
+struct ExpressionQueue {
+  struct ExpressionNode *expressions[EXPRESSION_QUEUE_SIZE];
+  int head;
+  int tail;
+  int count;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+};
+
+void initializeExpressionQueue(struct ExpressionQueue *queue);
+void destroyExpressionQueue(struct ExpressionQueue *queue);
+void pushExpressionQueue(struct ExpressionQueue *queue,
+                         struct ExpressionNode *expression);
+struct ExpressionNode *popExpressionQueue(struct ExpressionQueue *queue);
+void evaluatePipelined(FILE *file, int optimize_level);
 
 // =================================================
 //   garbage collector
 // =================================================
 
 struct AllocatorContext *initAllocator();
+void freeAllocator(struct AllocatorContext *context);
 
 struct Object *allocate(struct AllocatorContext *context, struct Env *env);
+struct ConsCell *newConsCell();
+
+// =================================================
+//   runtime of programs translated by worspc
+// =================================================
+
+void pushObjectStack(struct ObjectStack *stack, struct Object *obj);
+struct Object *popObjectStack(struct ObjectStack *stack);
+
+bool boolVal(struct Object *obj);
+void definedFunctionAdd(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated);
+void definedFunctionSub(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated);
+void definedFunctionMul(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated);
+void definedFunctionDiv(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated);
+void definedFunctionMod(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated);
+void definedFunctionLt(struct Object *op1, struct Object *op2,
+                       struct Object *evaluated);
+void definedFunctionGt(struct Object *op1, struct Object *op2,
+                       struct Object *evaluated);
+void definedFunctionEq(struct Object *op1, struct Object *op2,
+                       struct Object *evaluated);
+void definedFunctionCar(struct Object *op, struct Object *evaluated);
+void definedFunctionCdr(struct Object *op, struct Object *evaluated,
+                        struct Env *env, struct AllocatorContext *context);
+void definedFunctionCons(struct Object *op1, struct Object *op2,
+                         struct Object *evaluated, struct Env *env,
+                         struct AllocatorContext *context);
+void definedFunctionNot(struct Object *op, struct Object *evaluated);
+void definedFunctionSplit(struct Object *op1, struct Object *op2,
+                          struct Object *evaluated, struct Env *env,
+                          struct AllocatorContext *context);
+void definedFunctionListRef(struct Object *op1, struct Object *op2,
+                            struct Object *evaluated);
+void definedFunctionRemoveWhitespaces(struct Object *op1,
+                                      struct Object *evaluated);
+void definedFunctionPop(struct Object *op, struct Object *evaluated,
+                        struct Env *env, struct AllocatorContext *context);
+void definedFunctionPush(struct Object *op1, struct Object *op2,
+                         struct Object *evaluated, struct Binding *binding,
+                         struct Env *env, struct AllocatorContext *context);
+void definedFunctionLength(struct Object *op, struct Object *evaluated);
+void definedFunctionIsIntString(struct Object *op, struct Object *evaluated);
+void definedFunctionParseInt(struct Object *op, struct Object *evaluated);
+void definedFunctionPrint(struct Object *op, struct Object *evaluated);
+void definedFunctionReadline(struct Object *evaluated);
+void definedFunctionStringRef(struct Object *op1, struct Object *op2,
+                              struct Object *evaluated);
+void definedFunctionSubstring(struct Object *op1, struct Object *op2,
+                              struct Object *op3, struct Object *evaluated);
+void definedFunctionMakeStringBuilder(struct Object *evaluated,
+                                      struct Env *env,
+                                      struct AllocatorContext *context);
+void definedFunctionSbAppend(struct Object *op1, struct Object *op2,
+                             struct Object *evaluated);
+void definedFunctionSbBuild(struct Object *op, struct Object *evaluated);
+void definedFunctionVectorRef(struct Object *op1, struct Object *op2,
+                              struct Object *evaluated);
+void definedFunctionVectorSet(struct Object *op1, struct Object *op2,
+                              struct Object *op3, struct Object *evaluated);
+void definedFunctionVectorPush(struct Object *op1, struct Object *op2,
+                               struct Object *evaluated);
+void definedFunctionVectorPop(struct Object *op, struct Object *evaluated);
+void definedFunctionVectorLength(struct Object *op, struct Object *evaluated);
+void definedFunctionMakeMap(struct Object *evaluated, struct Env *env,
+                            struct AllocatorContext *context);
+void definedFunctionMapGet(struct Object *op1, struct Object *op2,
+                           struct Object *evaluated);
+void definedFunctionMapSet(struct Object *op1, struct Object *op2,
+                           struct Object *op3, struct Object *evaluated);
+void definedFunctionMapHas(struct Object *op1, struct Object *op2,
+                           struct Object *evaluated);
+void definedFunctionMapDel(struct Object *op1, struct Object *op2,
+                           struct Object *evaluated);
+void definedFunctionMapKeys(struct Object *op, struct Object *evaluated,
+                            struct Env *env, struct AllocatorContext *context);
+void definedFunctionMapSize(struct Object *op, struct Object *evaluated);
+void definedFunctionPvecConj(struct Object *op1, struct Object *op2,
+                             struct Object *evaluated, struct Env *env,
+                             struct AllocatorContext *context);
+void definedFunctionPvecAssoc(struct Object *op1, struct Object *op2,
+                              struct Object *op3, struct Object *evaluated,
+                              struct Env *env,
+                              struct AllocatorContext *context);
+void definedFunctionPvecRef(struct Object *op1, struct Object *op2,
+                            struct Object *evaluated);
+void definedFunctionPvecCount(struct Object *op, struct Object *evaluated);
+void definedFunctionMakePhash(struct Object *evaluated, struct Env *env,
+                              struct AllocatorContext *context);
+void definedFunctionPhashAssoc(struct Object *op1, struct Object *op2,
+                               struct Object *op3, struct Object *evaluated,
+                               struct Env *env,
+                               struct AllocatorContext *context);
+void definedFunctionPhashDissoc(struct Object *op1, struct Object *op2,
+                                struct Object *evaluated, struct Env *env,
+                                struct AllocatorContext *context);
+void definedFunctionPhashGet(struct Object *op1, struct Object *op2,
+                             struct Object *evaluated);
+void definedFunctionPhashHas(struct Object *op1, struct Object *op2,
+                             struct Object *evaluated);
+void definedFunctionPhashCount(struct Object *op, struct Object *evaluated);
+void definedFunctionPhashKeys(struct Object *op, struct Object *evaluated,
+                              struct Env *env,
+                              struct AllocatorContext *context);
+void definedFunctionMap(struct Object *op1, struct Object *op2,
+                        struct Object *evaluated, struct Env *env,
+                        struct AllocatorContext *context);
+void definedFunctionFilter(struct Object *op1, struct Object *op2,
+                           struct Object *evaluated, struct Env *env,
+                           struct AllocatorContext *context);
+void definedFunctionReduce(struct Object *op1, struct Object *op2,
+                           struct Object *op3, struct Object *evaluated,
+                           struct Env *env, struct AllocatorContext *context);
+void definedFunctionForEach(struct Object *op1, struct Object *op2,
+                            struct Object *evaluated, struct Env *env,
+                            struct AllocatorContext *context);
+void definedFunctionPmap(struct Object *op1, struct Object *op2,
+                         struct Object *evaluated, struct Env *env,
+                         struct AllocatorContext *context);
+
+void loadSymbol(char *symbol_name, struct Object *evaluated, struct Env *env);
+void makeList(struct Object **items, int count, struct Object *evaluated,
+              struct Env *env, struct AllocatorContext *context);
+void makeVector(struct Object **items, int count, struct Object *evaluated,
+                struct AllocatorContext *context);
+char *newString(const char *chars, int length);
+struct StringHeader *stringHeader(char *str);
+int stringLength(char *str);
+char *charString(char c);
+char *internString(const char *chars, int length);
+int digitSpan(const char *str, int length);
+int removeSpaces(const char *src, int length, char *dst);
+void delimiterBitmap(const char *str, int length, const char *delimiters,
+                     uint64_t *bitmap);
+int nextBitmapIndex(const uint64_t *bitmap, int start, int length, bool set);
+void freeString(char *str);
+void makePVector(struct Object **items, int count, struct Object *evaluated,
+                 struct AllocatorContext *context);
+// true when a binding was added, it refers to symbolName itself
+bool setObjectToEnv(struct Env *env, char *symbolName, struct Object *obj);
+struct Binding *lookupBinding(struct Env *env, char *symbol_name);
+struct Function *lookupFunction(struct Env *env, char *symbol_name);
+struct Function *lookupCachedFunction(struct Env *env, char *symbol_name,
+                                      struct Function **cached_function,
+                                      unsigned long *cached_version);
+struct Function *newFunction(char **param_symbol_names, int arity,
+                             char **local_symbol_names, int frame_size,
+                             struct ExpressionNode *body,
+                             NativeFunction native);
+void invokeFunction(struct Function *function, struct Binding *frame,
+                    struct Object *evaluated, struct Env *env,
+                    struct AllocatorContext *context);
+int bindLoopVariable(char *name, struct Object *variable, struct Env *env);
+void restoreLoopVariable(int slot, struct Object *variable, struct Env *env);
+
+// true when name is evaluated as a builtin rather than a defined function
+bool isBuiltinName(char *name);
+
+// writes a C translation unit that runs program when linked with worsp.c
+void compileProgram(struct ProgramNode *program, FILE *out);
 
 #endif
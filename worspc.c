@@ -0,0 +1,41 @@
+#include "worsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// translates a worsp program to C, the output is compiled together with
+// worsp.c into a standalone executable
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("filepath is required.\n");
+    return 1;
+  }
+
+  FILE *file = fopen(argv[1], "rb");
+  if (file == NULL) {
+    perror("Cannot open file");
+    return 1;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long file_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char *file_contents = (char *)malloc(file_size + 1);
+  if (file_contents == NULL) {
+    perror("Failed to malloc");
+    fclose(file);
+    return 1;
+  }
+
+  fread(file_contents, 1, file_size, file);
+  file_contents[file_size] = '\0';
+
+  fclose(file);
+
+  struct ParseState state = (struct ParseState){NULL, 0, NULL};
+  struct ParseResult result = (struct ParseResult){NULL};
+  parse(file_contents, &state, &result);
+  compileProgram(result.program, stdout);
+
+  return 0;
+}